@@ -1,8 +1,17 @@
 #include "structs.h"
+#include "contiguous_allocator.h"
+#include "memory_map.h"
 #include <iostream>
+#include <iomanip>
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <queue>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
 
 using namespace std;
 
@@ -14,8 +23,12 @@ using namespace std;
  * Job1 <job_size_in_KB>
  * Job2 <job_size_in_KB>
  * ...
+ * a job stream for the churn simulation can be given instead of (or as well as) plain jobs:
+ * Arrive <time> <job_name> <job_size_in_KB> [<duration>]
+ * Exit <time> <job_name>
+ * Generate <count> <mean_interarrival> <min_size_in_KB> <max_size_in_KB> <mean_duration> [<seed>]
  */
-bool loadFromFile(const string &filename, vector<Job> &jobs, Memory &memory) {
+bool loadFromFile(const string &filename, vector<Job> &jobs, Memory &memory, vector<JobEvent> &events) {
     ifstream file(filename);
     if (!file.is_open()) {
         cerr << "Error: Could not open file " << filename << endl;
@@ -36,6 +49,29 @@ bool loadFromFile(const string &filename, vector<Job> &jobs, Memory &memory) {
         if (name == "MemorySize") {
             ss >> memory.totalSize >> memory.pageSize;
             memorySet = true;
+        } else if (name == "Arrive") {
+            JobEvent e = {JobEvent::ARRIVE, 0, "", 0, 0};
+            ss >> e.time >> e.jobName >> e.size >> e.duration;
+            events.push_back(e);
+        } else if (name == "Exit") {
+            JobEvent e = {JobEvent::EXIT, 0, "", 0, 0};
+            ss >> e.time >> e.jobName;
+            events.push_back(e);
+        } else if (name == "Generate") {
+            // synthetic stream: exponential inter-arrival times and durations, uniform sizes
+            long long count = 0;
+            double meanGap = 1, meanDuration = 1;
+            int minSize = 1, maxSize = 1;
+            unsigned long long seed = 1;
+            ss >> count >> meanGap >> minSize >> maxSize >> meanDuration >> seed;
+            mt19937_64 gen(seed);
+            exponential_distribution<double> gap(1.0 / meanGap), run(1.0 / meanDuration);
+            uniform_int_distribution<int> sizeDist(minSize, max(minSize, maxSize));
+            double t = events.empty() ? 0 : events.back().time;
+            for (long long i = 0; i < count; ++i) {
+                t += gap(gen);
+                events.push_back({JobEvent::ARRIVE, t, "G" + to_string(i), sizeDist(gen), run(gen)});
+            }
         } else {
             Job job;
             job.name = name;
@@ -55,15 +91,8 @@ bool loadFromFile(const string &filename, vector<Job> &jobs, Memory &memory) {
     // computing number of frames created in memory
     memory.numFrames = memory.totalSize / memory.pageSize;
 
-    // initializing memory frames
-    for (int i = 0; i < memory.numFrames; ++i) {
-        Frame f;
-        f.frameNumber = i;
-        f.isFree = true;
-        f.jobName = "";
-        f.pageNumber = -1;
-        memory.frames.push_back(f);
-    }
+    // initializing memory frames, all free
+    memory.reset(memory.numFrames);
 
     return true;
 }
@@ -74,12 +103,38 @@ bool loadFromFile(const string &filename, vector<Job> &jobs, Memory &memory) {
  * returns the fragmentation size in KB
  */
 int calculateInternalFragmentation(const Job &job, int pageSize) {
-    int remainder = job.size % pageSize;
+    int remainder = (int)(job.size % pageSize);
     if (remainder == 0)
         return 0;
     return pageSize - remainder;
 }
 
+/*
+ * quietly gives every page of the job a frame, or none at all if memory is short
+ * returns true if the whole job was placed; the job then holds its owner id
+ * (job.id) until releaseJobFrames
+ */
+bool allocateJobFrames(Job &job, Memory &mainMemory) {
+    job.num_pages = ceil((double)job.size / mainMemory.pageSize);
+    int owner = mainMemory.jobNames.acquire(job.name);
+    if (!mainMemory.placeJob(job, owner)) {
+        mainMemory.jobNames.release(owner);
+        return false;
+    }
+    job.id = owner;
+    return true;
+}
+
+/*
+ * hands all of a job's frames back to the free pool (job termination) and
+ * its owner id back to the job table for later jobs
+ * costs one step per page of the job, independent of memory size
+ */
+void releaseJobFrames(Job &job, Memory &mainMemory) {
+    mainMemory.releaseJob(job);
+    mainMemory.jobNames.release(job.id);
+}
+
 /*
  * divides memory into frames based on page size (specified in the input by end user)
  * allocates memory frames to the job based on its size and the main memory's page size
@@ -88,37 +143,15 @@ int calculateInternalFragmentation(const Job &job, int pageSize) {
 
 void divideMemoryToFrames(Job &job, Memory &mainMemory) {
     // calculating number of pages per job using job size and page size
-    job.numPages = ceil((double)job.size / mainMemory.pageSize);
+    job.num_pages = ceil((double)job.size / mainMemory.pageSize);
 
     cout << "\nAllocating job " << job.name << " (" << job.size << " KB)"
-         << " needing " << job.numPages << " pages...\n";
-
-    int allocated = 0;
+         << " needing " << job.num_pages << " pages...\n";
 
-    // looping through frames array to allocate pages to the free frames
-    for (int i = 0; i < mainMemory.numFrames && allocated < job.numPages; ++i) {
-        if (mainMemory.frames[i].isFree) {
-            mainMemory.frames[i].isFree = false;
-            mainMemory.frames[i].jobName = job.name;
-            mainMemory.frames[i].pageNumber = allocated;
-
-            // updating job's Page Map Table; adding allocated page
-            Page page = {allocated, i};
-            job.pages.push_back(page);
-
-            allocated++;
-        }
-    }
-
-    // in an scenario where not all pages could be allocated, deallocate all previously allocated pages
-    if (allocated < job.numPages) {
+    // taking the lowest free frames for the pages from the free-frame manager;
+    // if not all pages fit, none are allocated
+    if (!mainMemory.placeJob(job, mainMemory.jobNames.intern(job.name))) {
         cout << "Not enough memory to allocate all pages for " << job.name << endl;
-
-        for (Page &p : job.pages)
-            mainMemory.frames[p.frameNumber].isFree = true;
-
-        // clearing the job's pages array
-        job.pages.clear();
     } else {
         // on a successful allocation
         cout << "Job " << job.name << " allocated successfully.\n";
@@ -140,35 +173,368 @@ void divideMemoryToFrames(Job &job, Memory &mainMemory) {
 void displayPMT(const Job &job) {
     cout << "\nPage Map Table (PMT) for " << job.name << ":\n";
     cout << "Page\tFrame\n";
-    for (const Page &p : job.pages)
-        cout << p.pageNumber << "\t" << p.frameNumber << endl;
+    job.page_table.for_each_mapped([](long long page, int frame) {
+        cout << page << "\t" << frame << endl;
+    });
 }
 
+/*
+ * the MMT as runs of frames with one status and job (see memory_map.h), then
+ * the frames of each job and a heat map of the memory
+ */
 void displayMMT(const Memory &memory) {
-    cout << "\nMemory Map Table (MMT):\n";
-    cout << "Frame\tStatus\t\tJob(Page)\n";
-    for (const Frame &f : memory.frames) {
-        cout << f.frameNumber << "\t";
-        if (f.isFree)
-            cout << "Free\t\t-\n";
-        else
-            cout << "Used\t\t" << f.jobName << "(" << f.pageNumber << ")\n";
+    FrameMap map;
+    map.build(memory.frames);
+    ReportWriter out;
+    out.printf("\nMemory Map Table (MMT):\n");
+    out.printf("Frames\t\tStatus\t\tJob(Pages)\n");
+    for (const FrameRun &r : map.runs) {
+        string span = frame_span(r.first, r.last);
+        if (r.owner == -1) {
+            out.printf("%s\t%sFree\t\t-\n", span.c_str(), span.size() < 8 ? "\t" : "");
+            continue;
+        }
+        string pages = r.sequential ? frame_span((int)r.first_page, (int)r.last_page()) : to_string(r.frames()) + " pages";
+        out.printf("%s\t%sUsed\t\t%s(%s)\n", span.c_str(), span.size() < 8 ? "\t" : "",
+                   memory.jobNames.name(r.owner).c_str(), pages.c_str());
+    }
+    out.printf("\n");
+    write_occupancy(out, map, [&](int owner) { return memory.jobNames.name(owner); });
+}
+
+/*
+ * how the churn simulation places a job: every page in some free frame
+ * (PagedPlacement) or one contiguous block (ContiguousPlacement)
+ */
+struct PagedPlacement {
+    Memory &memory;
+
+    bool fitsAtAll(const Job &job) const { return job.num_pages <= memory.numFrames; }
+    bool anyFree() const { return memory.freeFrames.freeCount() > 0; }
+    bool place(Job &job) { return allocateJobFrames(job, memory); }
+    void remove(Job &job) { releaseJobFrames(job, memory); }
+    double used() const { return memory.freeFrames.usedCount(); }
+    double capacity() const { return memory.numFrames; }
+    double externalFragmentation() const { return 0; } // any free frame serves any page
+};
+
+struct ContiguousPlacement {
+    ContiguousAllocator &alloc;
+    long long total;               // KB
+    long long calls = 0;           // allocate (including failed) and release calls
+    long long failed = 0;
+    long long minLargestFree;
+
+    ContiguousPlacement(ContiguousAllocator &a, long long totalKB) : alloc(a), total(totalKB), minLargestFree(totalKB) {}
+
+    static long long units(const Job &job) { return max(1LL, job.size); }
+    bool fitsAtAll(const Job &job) const { return alloc.reserved(units(job)) <= total; }
+    bool anyFree() const { return alloc.largest_free() > 0; }
+    bool place(Job &job) {
+        ++calls;
+        job.start = alloc.allocate(units(job));
+        if (job.start < 0) { ++failed; return false; }
+        minLargestFree = min(minLargestFree, alloc.largest_free());
+        return true;
+    }
+    void remove(Job &job) {
+        ++calls;
+        alloc.release(job.start, units(job));
+        job.start = -1;
+    }
+    double used() const { return total - alloc.free_units(); }
+    double capacity() const { return total; }
+    double externalFragmentation() const {
+        long long free = alloc.free_units();
+        return free > 0 ? 1.0 - (double)alloc.largest_free() / free : 0.0;
+    }
+};
+
+// what one churn run reports beyond its own printout, for the comparison table
+struct ChurnResult {
+    long long admitted = 0, completed = 0, rejected = 0, stillWaiting = 0;
+    double averageWait = 0, utilisation = 0, externalFragmentation = 0, seconds = 0;
+};
+
+/*
+ * churn simulation: jobs arrive and exit over (simulated) time
+ * an arriving job that does not fit, or finds others queued, waits in a FIFO
+ * queue; every exit frees the job's memory and admits jobs from the head of
+ * the queue while the head fits, so a job never overtakes an earlier one and
+ * an exit costs one placement attempt plus one per job it admits
+ * with report set, prints simulated jobs per second, queue waits and
+ * utilisation over time; external fragmentation is averaged over time
+ */
+template <class Placement>
+ChurnResult runChurnSimulation(vector<JobEvent> &events, int pageSize, Placement &placement, bool report) {
+    const int BUCKETS = 10;
+
+    stable_sort(events.begin(), events.end(),
+                [](const JobEvent &a, const JobEvent &b) { return a.time < b.time; });
+    double endTime = events.empty() ? 0 : events.back().time;
+
+    struct Running {
+        double exitTime;
+        int job;
+        bool operator>(const Running &o) const { return exitTime > o.exitTime; }
+    };
+    priority_queue<Running, vector<Running>, greater<Running>> exits; // scheduled exits
+    deque<int> waiting;                                              // queued job indexes
+    vector<Job> jobs;
+    vector<double> arrival, duration;
+    vector<char> state;          // 0 waiting, 1 running, 2 done, 3 rejected/cancelled
+    unordered_map<string, int> byName;
+
+    long long admitted = 0, completed = 0, rejected = 0, cancelled = 0, queuedEver = 0;
+    double totalWait = 0, maxWait = 0;
+    double lastTime = 0, usedArea = 0, fragArea = 0;
+    vector<double> bucketArea(BUCKETS, 0);
+    int peakQueue = 0;
+
+    // integrates utilisation and external fragmentation up to time t
+    auto advance = [&](double t) {
+        double used = placement.used();
+        usedArea += used * (t - lastTime);
+        fragArea += placement.externalFragmentation() * (t - lastTime);
+        if (endTime > 0) {
+            double width = endTime / BUCKETS;
+            double a = lastTime;
+            while (a < t) {
+                int b = min(BUCKETS - 1, (int)(a / width));
+                double bEnd = min(t, (b + 1) * width);
+                if (b == BUCKETS - 1) bEnd = t;
+                bucketArea[b] += used * (bEnd - a);
+                a = bEnd;
+            }
+        }
+        lastTime = t;
+    };
+
+    auto admit = [&](int j, double now) {
+        state[j] = 1;
+        ++admitted;
+        double wait = now - arrival[j];
+        totalWait += wait;
+        maxWait = max(maxWait, wait);
+        if (duration[j] > 0) exits.push({now + duration[j], j});
+    };
+
+    // admits queued jobs from the head while the head fits; jobs cancelled
+    // while queued are dropped when they reach the head
+    auto retryQueue = [&](double now) {
+        while (!waiting.empty()) {
+            int j = waiting.front();
+            if (state[j] == 0) {
+                if (!placement.anyFree() || !placement.place(jobs[j])) return;
+                admit(j, now);
+            }
+            waiting.pop_front();
+        }
+    };
+
+    auto finish = [&](int j, double now) {
+        placement.remove(jobs[j]);
+        state[j] = 2;
+        ++completed;
+        retryQueue(now);
+    };
+
+    auto start = chrono::steady_clock::now();
+    size_t next = 0;
+    while (next < events.size() || !exits.empty()) {
+        // exits scheduled before the next input event go first
+        if (!exits.empty() && (next == events.size() || exits.top().exitTime <= events[next].time)) {
+            Running r = exits.top();
+            exits.pop();
+            if (state[r.job] != 1) continue;
+            advance(r.exitTime);
+            finish(r.job, r.exitTime);
+            continue;
+        }
+
+        JobEvent &e = events[next++];
+        advance(e.time);
+        if (e.type == JobEvent::ARRIVE) {
+            int j = (int)jobs.size();
+            Job job;
+            job.name = e.jobName;
+            job.size = e.size;
+            job.num_pages = ceil((double)e.size / pageSize);
+            jobs.push_back(job);
+            arrival.push_back(e.time);
+            duration.push_back(e.duration);
+            state.push_back(0);
+            byName[e.jobName] = j;
+
+            if (!placement.fitsAtAll(jobs[j])) {
+                state[j] = 3;
+                ++rejected;                      // could never fit
+            } else if (waiting.empty() && placement.place(jobs[j])) {
+                admit(j, e.time);
+            } else {
+                waiting.push_back(j);
+                ++queuedEver;
+                peakQueue = max(peakQueue, (int)waiting.size());
+            }
+        } else {
+            auto it = byName.find(e.jobName);
+            if (it == byName.end()) continue;
+            int j = it->second;
+            if (state[j] == 1) finish(j, e.time);
+            else if (state[j] == 0) { state[j] = 3; ++cancelled; }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long long stillWaiting = 0, stillRunning = 0;
+    for (char st : state) {
+        if (st == 0) ++stillWaiting;
+        if (st == 1) ++stillRunning;
+    }
+    double simTime = lastTime;
+    double capacity = placement.capacity();
+
+    ChurnResult result;
+    result.admitted = admitted;
+    result.completed = completed;
+    result.rejected = rejected;
+    result.stillWaiting = stillWaiting;
+    result.averageWait = admitted ? totalWait / admitted : 0.0;
+    result.utilisation = simTime > 0 && capacity ? 100.0 * usedArea / (simTime * capacity) : 0.0;
+    result.externalFragmentation = simTime > 0 ? 100.0 * fragArea / simTime : 0.0;
+    result.seconds = seconds;
+    if (!report) return result;
+
+    cout << "\nChurn simulation: " << jobs.size() << " job arrivals, " << capacity
+         << " frames of " << pageSize << " KB\n";
+    cout << "Admitted: " << admitted << ", completed: " << completed << ", still running: " << stillRunning
+         << ", still queued: " << stillWaiting << ", cancelled while queued: " << cancelled
+         << ", rejected (larger than memory): " << rejected << "\n";
+    cout << "Jobs queued on arrival: " << queuedEver << ", peak queue length: " << peakQueue << "\n";
+    cout << "Queue wait (simulated time): average " << result.averageWait
+         << ", max " << maxWait << "\n";
+    cout << "Average frame utilisation: " << result.utilisation << "%\n";
+    cout << "Simulation time: " << seconds << " s ("
+         << (seconds > 0 ? (jobs.size() + completed) / seconds : 0.0) << " job arrivals+exits per second)\n";
+
+    cout << "\nFrame utilisation over time:\n";
+    cout << "From\t\tTo\t\tUtilisation\n";
+    double width = endTime / BUCKETS;
+    for (int b = 0; b < BUCKETS && endTime > 0; ++b) {
+        double from = b * width, to = (b == BUCKETS - 1) ? simTime : (b + 1) * width;
+        double util = (to > from && capacity) ? 100.0 * bucketArea[b] / ((to - from) * capacity) : 0.0;
+        cout << from << "\t\t" << to << "\t\t" << util << "%\n";
+    }
+    return result;
+}
+
+/*
+ * replays the same job stream with each contiguous allocator and prints them
+ * next to the paging run: admissions, queue wait, utilisation, external
+ * fragmentation (time average, 1 - largest free block / free memory), the
+ * smallest largest-free-block seen after a placement, and allocator calls
+ * per second of simulation
+ */
+void compareContiguousChurn(const vector<JobEvent> &events, const Memory &memory, const ChurnResult &paged) {
+    cout << "\nContiguous allocation of the same job stream (" << memory.totalSize << " KB):\n";
+    cout << left << setw(10) << "Allocator" << right << setw(10) << "Admitted" << setw(11) << "Completed"
+         << setw(10) << "Queued" << setw(12) << "Avg wait" << setw(9) << "Util%" << setw(10) << "ExtFrag%"
+         << setw(14) << "MinLargestKB" << setw(14) << "Calls/s" << "\n";
+    cout << fixed << setprecision(2);
+    cout << left << setw(10) << "paging" << right << setw(10) << paged.admitted << setw(11) << paged.completed
+         << setw(10) << paged.stillWaiting << setw(12) << paged.averageWait << setw(9) << paged.utilisation
+         << setw(10) << 0.0 << setw(14) << "-" << setw(14) << "-" << "\n";
+    for (const string &name : contiguous_allocator_names()) {
+        vector<JobEvent> stream = events;
+        unique_ptr<ContiguousAllocator> alloc = make_contiguous_allocator(name, memory.totalSize);
+        ContiguousPlacement placement(*alloc, memory.totalSize);
+        ChurnResult r = runChurnSimulation(stream, memory.pageSize, placement, false);
+        cout << left << setw(10) << name << right << setw(10) << r.admitted << setw(11) << r.completed
+             << setw(10) << r.stillWaiting << setw(12) << r.averageWait << setw(9) << r.utilisation
+             << setw(10) << r.externalFragmentation << setw(14) << placement.minLargestFree
+             << setw(14) << setprecision(0) << (r.seconds > 0 ? placement.calls / r.seconds : 0.0)
+             << setprecision(2) << "\n";
+    }
+    cout.unsetf(ios::floatfield);
+    cout << left << setprecision(6);
+}
+
+/*
+ * places the jobs in file order with each contiguous allocator and prints
+ * where they went, then a table next to paging: jobs placed, free memory,
+ * the largest free block, external and internal fragmentation
+ */
+void compareContiguous(const vector<Job> &pagedJobs, const Memory &memory) {
+    cout << "\nContiguous allocation of the same jobs (" << memory.totalSize << " KB):\n";
+    struct Row { string name; int placed; long long freeKB, largest, internal; double external; };
+    vector<Row> rows;
+
+    long long pagedInternal = 0;
+    int pagedPlaced = 0;
+    for (const Job &job : pagedJobs) {
+        if (job.page_table.resident() == 0 && job.num_pages > 0) continue;
+        ++pagedPlaced;
+        pagedInternal += calculateInternalFragmentation(job, memory.pageSize);
+    }
+    rows.push_back({"paging", pagedPlaced, (long long)memory.freeFrames.freeCount() * memory.pageSize, -1,
+                    pagedInternal, 0.0});
+
+    for (const string &name : contiguous_allocator_names()) {
+        unique_ptr<ContiguousAllocator> alloc = make_contiguous_allocator(name, memory.totalSize);
+        vector<Job> jobs = pagedJobs;
+        cout << "\n" << name << ":\nJob\tStart KB\tSize KB\tReserved KB\n";
+        int placed = 0;
+        long long internal = 0;
+        for (Job &job : jobs) {
+            long long units = max(1LL, job.size);
+            job.start = alloc->allocate(units);
+            if (job.start < 0) {
+                cout << job.name << "\t-\t\t" << job.size << "\t(no free block large enough)\n";
+                continue;
+            }
+            ++placed;
+            internal += alloc->reserved(units) - job.size;
+            cout << job.name << "\t" << job.start << "\t\t" << job.size << "\t" << alloc->reserved(units) << "\n";
+        }
+        long long freeKB = alloc->free_units();
+        rows.push_back({name, placed, freeKB, alloc->largest_free(), internal,
+                        freeKB > 0 ? 100.0 * (1.0 - (double)alloc->largest_free() / freeKB) : 0.0});
+    }
+
+    cout << "\nAllocator\tPlaced\tFree KB\tLargest free KB\tExternal frag.\tInternal frag. KB\n";
+    for (const Row &r : rows) {
+        cout << r.name << "\t\t" << r.placed << "/" << pagedJobs.size() << "\t" << r.freeKB << "\t";
+        if (r.largest < 0) cout << "-";
+        else cout << r.largest;
+        cout << "\t\t" << r.external << "%\t\t" << r.internal << "\n";
     }
 }
 
 int main() {
     Memory mainMemory;
     vector<Job> jobs;
+    vector<JobEvent> events;
 
     string filename;
     cout << "Enter input filename: ";
     cin >> filename;
 
-    if (!loadFromFile(filename, jobs, mainMemory)) {
+    if (!loadFromFile(filename, jobs, mainMemory, events)) {
         cerr << "Failed to load data.\n";
         return 1;
     }
 
+    // a file with Arrive/Exit/Generate lines describes a job stream
+    if (!events.empty()) {
+        for (auto &job : jobs)
+            events.push_back({JobEvent::ARRIVE, 0, job.name, (int)job.size, 0});
+        vector<JobEvent> stream = events;
+        PagedPlacement paging{mainMemory};
+        ChurnResult paged = runChurnSimulation(stream, mainMemory.pageSize, paging, true);
+        compareContiguousChurn(events, mainMemory, paged);
+        return 0;
+    }
+
     // Allocate memory for each job
     for (auto &job : jobs)
         divideMemoryToFrames(job, mainMemory);
@@ -178,5 +544,7 @@ int main() {
     for (auto &job : jobs)
         displayPMT(job);
 
+    compareContiguous(jobs, mainMemory);
+
     return 0;
 }
@@ -0,0 +1,226 @@
+// benchmark.cpp
+// Compile: g++ -O2 -pthread benchmark.cpp -o vm_bench   (or build the vm_bench target with CMake)
+//
+// Throughput of the simulators' hot paths at memory sizes from 1K to 16M frames
+// (every power of 4):
+//   alloc_first      FreeFrameAllocator::allocateFirst + FrameTable::assign, one
+//                    frame at a time (PMA.cpp divideMemoryToFrames)
+//   alloc_bulk       allocateFirstN, a job's frames in one call (PMA.cpp churn)
+//   alloc_random     uniformly random free frame (demand_paged.cpp placement)
+//   translate_seq    DemandPager::access_page on resident pages, in page order
+//   translate_random the same with uniformly random pages
+//   translate_batch_seq, translate_batch_random
+//                    the same references through DemandPager::translate_batch,
+//                    1024 addresses per call
+//   core_translate_seq, core_translate_random
+//                    the same references through SimCore::access built for
+//                    4 KB pages, clock, no TLB and no counters (sim_core.h)
+//   fault_<policy>   a cyclic scan over twice as many pages as frames, so every
+//                    reference faults and evicts (paged_memory.cpp demand mode)
+//   fault_clock_events
+//                    fault_clock with an event trace (event_log.h) drained to
+//                    /dev/null: two events (eviction and fault) per
+//                    reference, so the difference to fault_clock is their cost
+//
+// Output is CSV on stdout, one row per (benchmark, frames), with a fixed header:
+//   benchmark,frames,operations,seconds,ops_per_sec
+// Progress and errors go to stderr, so the rows can be diffed between builds.
+//
+//   vm_bench [--max-frames N] [--min-ops N] [--filter substring]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "demand_engine.h"
+#include "sim_core.h"
+
+using namespace std;
+
+struct BenchOptions {
+    long long max_frames = 1LL << 24;
+    long long min_ops = 1LL << 22;   // each benchmark repeats until at least this many operations
+    string filter;
+};
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *name, int frames, long long ops, double secs) {
+    printf("%s,%d,%lld,%.6f,%.0f\n", name, frames, ops, secs, secs > 0 ? ops / secs : 0.0);
+    fflush(stdout);
+}
+
+// allocate every frame, then release them all, until min_ops allocations are done
+static void bench_alloc_first(int n, long long min_ops) {
+    FreeFrameAllocator alloc(n, false);
+    FrameTable frames(n);
+    long long ops = 0;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        for (int i = 0; i < n; ++i) {
+            int f = alloc.allocateFirst();
+            if (f < 0) break;
+            frames.assign(f, 0, i);
+        }
+        for (int f = 0; f < n; ++f) { frames.clear(f); alloc.release(f); }
+        ops += n;
+    }
+    report("alloc_first", n, ops, seconds_since(start));
+}
+
+// jobs of 64 frames each, allocated until memory is full, then all released
+static void bench_alloc_bulk(int n, long long min_ops) {
+    const int job_frames = 64;
+    FreeFrameAllocator alloc(n, false);
+    FrameTable frames(n);
+    vector<int> got(job_frames);
+    long long ops = 0;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        int k;
+        while ((k = alloc.allocateFirstN(job_frames, got.data())) > 0)
+            for (int i = 0; i < k; ++i) frames.assign(got[i], 0, i);
+        for (int f = 0; f < n; ++f) { frames.clear(f); alloc.release(f); }
+        ops += n;
+    }
+    report("alloc_bulk", n, ops, seconds_since(start));
+}
+
+static void bench_alloc_random(int n, long long min_ops) {
+    FreeFrameAllocator alloc(n);
+    FrameTable frames(n);
+    mt19937 rng(1);
+    long long ops = 0;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        for (int i = 0; i < n; ++i) frames.assign(alloc.allocateNth((int)(rng() % alloc.freeCount())), 0, i);
+        for (int f = 0; f < n; ++f) { frames.clear(f); alloc.release(f); }
+        ops += n;
+    }
+    report("alloc_random", n, ops, seconds_since(start));
+}
+
+// one job exactly the size of memory, fully resident before timing starts
+static void bench_translate(int n, long long min_ops, bool random_pages, bool batched) {
+    const int page_size = 4096;
+    DemandPager pager(page_size, n, 1, "clock");
+    int idx = pager.add_job(0, (long long)n * page_size);
+    for (long long p = 0; p < n; ++p) pager.access_page(idx, p);
+
+    vector<long long> pages((size_t)min(min_ops, 1LL << 22));
+    mt19937_64 rng(2);
+    for (size_t i = 0; i < pages.size(); ++i)
+        pages[i] = random_pages ? (long long)(rng() % (uint64_t)n) : (long long)(i % (size_t)n);
+
+    const size_t batch = 1024;
+    vector<long long> addr, phys(batch);
+    vector<uint8_t> fault(batch);
+    if (batched)
+        for (long long p : pages) addr.push_back(p * page_size + (p & 63) * 8);
+
+    long long ops = 0, faults = 0;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        if (batched) {
+            for (size_t i = 0; i < addr.size(); i += batch) {
+                size_t m = min(batch, addr.size() - i);
+                faults += (long long)pager.translate_batch(idx, addr.data() + i, m, phys.data(), fault.data());
+            }
+        } else {
+            for (long long p : pages) faults += pager.access_page(idx, p).fault;
+        }
+        ops += (long long)pages.size();
+    }
+    double secs = seconds_since(start);
+    if (faults) cerr << "warning: " << faults << " unexpected faults in translate benchmark\n";
+    const char *name = batched ? (random_pages ? "translate_batch_random" : "translate_batch_seq")
+                               : (random_pages ? "translate_random" : "translate_seq");
+    report(name, n, ops, secs);
+}
+
+// bench_translate's references on the most specialised core
+static void bench_core_translate(int n, long long min_ops, bool random_pages) {
+    SimCore<ClockPolicy, 12, false, false> core(4096, n, 1);
+    int idx = core.add_job(0, (long long)n * core.page_size);
+    for (long long p = 0; p < n; ++p) core.access(idx, p);
+
+    vector<long long> pages((size_t)min(min_ops, 1LL << 22));
+    mt19937_64 rng(2);
+    for (size_t i = 0; i < pages.size(); ++i)
+        pages[i] = random_pages ? (long long)(rng() % (uint64_t)n) : (long long)(i % (size_t)n);
+
+    long long ops = 0, missing = 0;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        for (long long p : pages) missing += core.access(idx, p) < 0;
+        ops += (long long)pages.size();
+    }
+    double secs = seconds_since(start);
+    if (missing) cerr << "warning: " << missing << " unexpected faults in translate benchmark\n";
+    report(random_pages ? "core_translate_random" : "core_translate_seq", n, ops, secs);
+}
+
+// cyclic scan over 2n pages: after the first n references every one faults
+// and evicts, which is the worst case for every policy
+static void bench_fault(int n, long long min_ops, const string &policy, bool events = false) {
+    const int page_size = 4096;
+    DemandPager pager(page_size, n, 1, policy);
+    long long span = 2LL * n;
+    int idx = pager.add_job(0, span * page_size);
+    for (long long p = 0; p < n; ++p) pager.access_page(idx, p);
+    EventLog log;
+    if (events && log.open("/dev/null")) pager.trace_events(log.ring(0));
+
+    long long ops = 0, faults = 0, p = n;
+    auto start = chrono::steady_clock::now();
+    while (ops < min_ops) {
+        faults += pager.access_page(idx, p).fault;
+        if (++p == span) p = 0;
+        ++ops;
+    }
+    double secs = seconds_since(start);
+    string name = "fault_" + policy + (events ? "_events" : "");
+    report(name.c_str(), n, faults, secs);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--max-frames" && i + 1 < argc) opt.max_frames = atoll(argv[++i]);
+        else if (a == "--min-ops" && i + 1 < argc) opt.min_ops = atoll(argv[++i]);
+        else if (a == "--filter" && i + 1 < argc) opt.filter = argv[++i];
+        else {
+            cerr << "Usage: " << argv[0] << " [--max-frames N] [--min-ops N] [--filter substring]\n";
+            return 1;
+        }
+    }
+
+    auto wanted = [&](const string &name) { return opt.filter.empty() || name.find(opt.filter) != string::npos; };
+
+    printf("benchmark,frames,operations,seconds,ops_per_sec\n");
+    fflush(stdout);
+    for (long long n = 1024; n <= opt.max_frames; n *= 4) {
+        int frames = (int)n;
+        cerr << "frames = " << frames << "\n";
+        if (wanted("alloc_first")) bench_alloc_first(frames, opt.min_ops);
+        if (wanted("alloc_bulk")) bench_alloc_bulk(frames, opt.min_ops);
+        if (wanted("alloc_random")) bench_alloc_random(frames, opt.min_ops);
+        if (wanted("translate_seq")) bench_translate(frames, opt.min_ops, false, false);
+        if (wanted("translate_random")) bench_translate(frames, opt.min_ops, true, false);
+        if (wanted("translate_batch_seq")) bench_translate(frames, opt.min_ops, false, true);
+        if (wanted("translate_batch_random")) bench_translate(frames, opt.min_ops, true, true);
+        if (wanted("core_translate_seq")) bench_core_translate(frames, opt.min_ops, false);
+        if (wanted("core_translate_random")) bench_core_translate(frames, opt.min_ops, true);
+        for (const char *policy : {"fifo", "lru", "clock"})
+            if (wanted(string("fault_") + policy)) bench_fault(frames, opt.min_ops, policy);
+        if (wanted("fault_clock_events")) bench_fault(frames, opt.min_ops, "clock", true);
+    }
+    return 0;
+}
@@ -0,0 +1,239 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// checkpoint.h
+// Binary snapshot of a simulation (DemandPager::save_checkpoint and
+// restore_checkpoint in demand_engine.h).
+//
+// Every component lists its state once in a checkpoint(CheckpointArchive &)
+// method; the same code writes the file and reads it back, so the two
+// directions cannot drift apart. Writing appends to a buffered file.
+// Reading maps the whole file and copies each array out of the mapping in
+// one block: frame tables, page-table pools and policy arrays are not
+// rebuilt entry by entry. Only ordered sets and hash maps (LFU, OPT, ARC)
+// are reinserted.
+//
+// Layout: 8-byte magic "VMCKPT02", a uint32 byte-order mark, then the fields
+// in declaration order, then a 64-bit checksum of everything before it.
+// Scalars are stored as they sit in memory, in the host's byte order; the
+// mark makes a file written on a host of the other order fail to load
+// instead of being misread. A vector is a uint64 element count followed by
+// its elements, padded to 8 bytes. Named section markers between components
+// catch a file from another version, and the checksum (verified over the
+// whole mapping before anything is read) a damaged one; the engine range-
+// checks the indices it restores on top of that.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char CHECKPOINT_MAGIC[8] = {'V','M','C','K','P','T','0','2'};
+const uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+// 64-bit checksum of a byte stream fed in pieces of any size: each 8-byte
+// word (by position in the stream) costs one multiply, so it runs at about
+// memory speed, and any split of the stream gives the same value
+class CheckpointChecksum {
+    uint64_t h = 0x6a09e667f3bcc909ULL;
+    uint64_t length = 0;
+    unsigned char pending[8] = {};
+
+    static uint64_t load(const unsigned char *p) { uint64_t w; memcpy(&w, p, 8); return w; }
+    static uint64_t mix(uint64_t h, uint64_t w) {
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        return h ^ (h >> 32);
+    }
+
+public:
+    void add(const void *p, size_t n) {
+        const unsigned char *b = (const unsigned char *)p;
+        size_t have = (size_t)(length % 8);
+        length += n;
+        if (have) {
+            size_t k = min(n, 8 - have);
+            memcpy(pending + have, b, k);
+            b += k;
+            n -= k;
+            if (have + k < 8) return;
+            h = mix(h, load(pending));
+        }
+        for (; n >= 8; b += 8, n -= 8) h = mix(h, load(b));
+        memcpy(pending, b, n);
+    }
+    uint64_t size() const { return length; }
+    uint64_t value() const {
+        uint64_t v = h;
+        if (length % 8) {
+            unsigned char last[8] = {};
+            memcpy(last, pending, (size_t)(length % 8));
+            v = mix(v, load(last));
+        }
+        return mix(v, length);
+    }
+};
+
+class CheckpointArchive {
+    FILE *out = nullptr;
+    vector<char> out_buf; // stdio buffer of this archive's file
+    CheckpointChecksum sum; // of everything written so far
+    const unsigned char *base = nullptr, *cur = nullptr, *end = nullptr;
+    size_t map_size = 0;
+    bool reading = false;
+    bool good = true;
+
+    void put(const void *p, size_t n) {
+        fwrite(p, 1, n, out);
+        sum.add(p, n);
+    }
+
+    void pad() {
+        static const unsigned char zeros[8] = {};
+        size_t at = reading ? (size_t)(cur - base) : (size_t)sum.size();
+        size_t n = (8 - at % 8) % 8;
+        if (reading) { if ((size_t)(end - cur) < n) good = false; else cur += n; }
+        else put(zeros, n);
+    }
+
+public:
+    // opens path for writing (load = false) or maps it for reading
+    CheckpointArchive(const string &path, bool load) : reading(load) {
+        if (!load) {
+            out = fopen(path.c_str(), "wb");
+            if (!out) { good = false; return; }
+            out_buf.resize(1 << 20);
+            setvbuf(out, out_buf.data(), _IOFBF, out_buf.size());
+            put(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+            uint32_t order = CHECKPOINT_BYTE_ORDER;
+            io(order);
+            return;
+        }
+        good = false;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CHECKPOINT_MAGIC) + sizeof(uint64_t)) {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                base = (const unsigned char *)p;
+                map_size = (size_t)st.st_size;
+                madvise(p, map_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (!base) return;
+        cur = base + sizeof(CHECKPOINT_MAGIC);
+        end = base + map_size - sizeof(uint64_t);
+        if (memcmp(base, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) return;
+        CheckpointChecksum check;
+        check.add(base, (size_t)(end - base));
+        uint64_t stored;
+        memcpy(&stored, end, sizeof(stored));
+        good = check.value() == stored;
+        uint32_t order = 0;
+        io(order);
+        if (order != CHECKPOINT_BYTE_ORDER) good = false;
+    }
+    ~CheckpointArchive() { close(); }
+    CheckpointArchive(const CheckpointArchive &) = delete;
+    CheckpointArchive &operator=(const CheckpointArchive &) = delete;
+
+    bool loading() const { return reading; }
+    bool ok() const { return good; }
+    void fail() { good = false; } // the data read so far does not fit together
+
+    // false if anything failed; the file is complete (checksum appended)
+    // once this returns true
+    bool close() {
+        if (out) {
+            uint64_t check = sum.value();
+            fwrite(&check, 1, sizeof(check), out);
+            good = fflush(out) == 0 && !ferror(out) && good;
+            fclose(out);
+            out = nullptr;
+        }
+        if (base) { munmap((void *)base, map_size); base = nullptr; }
+        return good;
+    }
+
+    void bytes(void *p, size_t n) {
+        if (!good) return;
+        if (!reading) { put(p, n); return; }
+        if ((size_t)(end - cur) < n) { good = false; return; }
+        memcpy(p, cur, n);
+        cur += n;
+    }
+
+    template <class T>
+    void io(T &v) {
+        static_assert(is_trivially_copyable<T>::value, "checkpoint fields are plain data");
+        bytes(&v, sizeof(T));
+    }
+
+    template <class T>
+    void io(vector<T> &v) {
+        static_assert(is_trivially_copyable<T>::value, "checkpoint arrays hold plain data");
+        uint64_t n = v.size();
+        io(n);
+        pad();
+        if (!good) return;
+        if (!reading) {
+            if (n) put(v.data(), sizeof(T) * n);
+        } else {
+            if ((uint64_t)(end - cur) / sizeof(T) < n) { good = false; return; }
+            const T *first = (const T *)(const void *)cur; // 8-aligned in the mapping
+            v.assign(first, first + n);
+            cur += n * sizeof(T);
+        }
+        pad();
+    }
+
+    template <class T>
+    void io(vector<vector<T>> &v) {
+        uint64_t n = v.size();
+        io(n);
+        if (reading) {
+            if (!good || n > (uint64_t)(end - cur)) { good = false; return; }
+            v.assign(n, vector<T>());
+        }
+        for (auto &inner : v) io(inner);
+    }
+
+    void io(string &s) {
+        vector<char> chars(s.begin(), s.end());
+        io(chars);
+        if (reading) s.assign(chars.begin(), chars.end());
+    }
+
+    // the engine's generators, in their standard text form
+    void io(mt19937 &rng) {
+        string state;
+        if (!reading) { stringstream ss; ss << rng; state = ss.str(); }
+        io(state);
+        if (reading && good) { stringstream ss(state); ss >> rng; good = !ss.fail(); }
+    }
+
+    // a named marker between components; reading fails on a mismatch
+    void section(const char *name) {
+        char tag[8] = {};
+        memcpy(tag, name, min(strlen(name), sizeof(tag)));
+        char found[8];
+        memcpy(found, tag, sizeof(tag));
+        bytes(found, sizeof(found));
+        if (reading && good && memcmp(found, tag, sizeof(tag)) != 0) good = false;
+    }
+};
+
+#endif
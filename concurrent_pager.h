@@ -0,0 +1,209 @@
+#ifndef CONCURRENT_PAGER_H
+#define CONCURRENT_PAGER_H
+
+// concurrent_pager.h
+// Demand paging with several threads faulting against one shared frame table
+// (paged_memory --concurrent). Every job is served by exactly one thread, so a
+// job's page table is only written by its own thread on a fault and by
+// whichever thread evicts one of its pages; nothing is protected by a global
+// lock:
+//   free frames   a ShardedFramePool, one mutex-protected stack per shard;
+//                 a thread pops from its home shard and moves on to the
+//                 others when that one is empty. Once every shard is drained
+//                 the pool is skipped altogether
+//   page tables   one dense array of atomic frame numbers per job (-1 = not
+//                 resident)
+//   frames        an atomic mapping word per frame (owner and page, FREE or
+//                 CLAIMED) and an atomic referenced byte
+//   eviction      CLOCK with a shared hand. A thread takes HAND_CHUNK hand
+//                 positions with one fetch_add and sweeps them on its own,
+//                 clearing referenced bytes; it claims a victim by a CAS of
+//                 the mapping word to CLAIMED, which at most one thread can
+//                 win, and then unmaps the page in the owner's table
+// A hit re-reads the frame's mapping after setting its referenced byte: if
+// another thread claimed the frame in between, the reference is a fault.
+//
+// Each worker counts where it waited (ConcurrentWorker): pool lock
+// contention, hand refills, frames swept per eviction, lost claim races and
+// hits on frames stolen under them. A worker with an EventRing (event_log.h)
+// logs its faults, allocations and evictions there, timed by the job's own
+// reference count.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "metrics.h"
+#include "event_log.h"
+
+using namespace std;
+
+class ShardedFramePool {
+    struct alignas(64) Shard {
+        mutex m;
+        vector<int> frames;           // popped from the back
+        atomic<long long> contended{0}; // lock attempts that found it held
+    };
+    vector<unique_ptr<Shard>> shards;
+    atomic<bool> drained{false};
+
+public:
+    // frames [0, n) are split into contiguous runs, one per shard, and each
+    // shard hands out its lowest frame first
+    ShardedFramePool(int n, int num_shards) {
+        num_shards = max(1, min(num_shards, max(1, n)));
+        for (int s = 0; s < num_shards; ++s) {
+            shards.emplace_back(new Shard());
+            int lo = (int)((long long)n * s / num_shards), hi = (int)((long long)n * (s + 1) / num_shards);
+            for (int f = hi; f-- > lo;) shards.back()->frames.push_back(f);
+        }
+    }
+
+    int size() const { return (int)shards.size(); }
+
+    // a free frame, preferring the home shard, or -1 once all are empty
+    int pop(int home) {
+        if (drained.load(memory_order_relaxed)) return -1;
+        int n = (int)shards.size();
+        for (int k = 0; k < n; ++k) {
+            Shard &s = *shards[(home + k) % n];
+            unique_lock<mutex> lock(s.m, try_to_lock);
+            if (!lock.owns_lock()) {
+                s.contended.fetch_add(1, memory_order_relaxed);
+                lock.lock();
+            }
+            if (s.frames.empty()) continue;
+            int f = s.frames.back();
+            s.frames.pop_back();
+            return f;
+        }
+        drained.store(true, memory_order_relaxed);
+        return -1;
+    }
+
+    long long contended(int s) const { return shards[s]->contended.load(); }
+};
+
+// one thread's position of the CLOCK hand and its contention counters
+struct alignas(64) ConcurrentWorker {
+    int home_shard = 0;
+    uint64_t hand_pos = 0, hand_end = 0;
+    long long hand_refills = 0;   // fetch_adds on the shared hand
+    long long scanned = 0;        // frames the hand passed over
+    long long claim_failures = 0; // victims another thread claimed first
+    long long stale_hits = 0;     // hits whose frame was being evicted
+    EventRing *events = nullptr;  // this thread's event ring, if tracing
+};
+
+class ConcurrentPager {
+    static const int PAGE_BITS = 40;
+    static const uint64_t PAGE_MASK = (1ULL << PAGE_BITS) - 1;
+    static const uint64_t FREE = ~0ULL;
+    static const uint64_t CLAIMED = ~0ULL - 1;
+    static const uint64_t HAND_CHUNK = 64;
+
+    int num_frames;
+    unique_ptr<atomic<uint64_t>[]> frame_map;
+    unique_ptr<atomic<uint8_t>[]> referenced;
+    vector<unique_ptr<atomic<int32_t>[]>> tables;
+    vector<long long> table_pages;
+    unique_ptr<atomic<long long>[]> evicted; // pages each job lost, by any thread
+    alignas(64) atomic<uint64_t> hand{0};
+
+    static uint64_t key(int job, long long page) { return ((uint64_t)job << PAGE_BITS) | ((uint64_t)page & PAGE_MASK); }
+
+    int evict(ConcurrentWorker &w, JobStats &st) {
+        uint64_t chunk = min<uint64_t>(HAND_CHUNK, (uint64_t)num_frames);
+        for (;;) {
+            if (w.hand_pos == w.hand_end) {
+                w.hand_pos = hand.fetch_add(chunk, memory_order_relaxed);
+                w.hand_end = w.hand_pos + chunk;
+                ++w.hand_refills;
+            }
+            int f = (int)(w.hand_pos++ % (uint64_t)num_frames);
+            ++w.scanned;
+            if (referenced[f].load(memory_order_relaxed)) {
+                referenced[f].store(0, memory_order_relaxed);
+                continue;
+            }
+            uint64_t m = frame_map[f].load(memory_order_acquire);
+            if (m == FREE || m == CLAIMED) continue;
+            if (!frame_map[f].compare_exchange_strong(m, CLAIMED, memory_order_acq_rel)) {
+                ++w.claim_failures;
+                continue;
+            }
+            int owner = (int)(m >> PAGE_BITS);
+            int32_t expect = f;
+            tables[owner][m & PAGE_MASK].compare_exchange_strong(expect, -1, memory_order_acq_rel);
+            evicted[owner].fetch_add(1, memory_order_relaxed);
+            ++st.evictions;
+            if (w.events) w.events->emit(EV_EVICT, owner, (long long)(m & PAGE_MASK), f, st.references);
+            return f;
+        }
+    }
+
+public:
+    int page_size;
+    ShardedFramePool pool;
+    vector<JobStats> stats; // written only by the job's thread
+
+    ConcurrentPager(int page_size_, int frames, int shards, int jobs)
+        : num_frames(frames), frame_map(new atomic<uint64_t>[frames]), referenced(new atomic<uint8_t>[frames]),
+          evicted(new atomic<long long>[jobs]), page_size(page_size_), pool(frames, shards) {
+        for (int f = 0; f < frames; ++f) { frame_map[f].store(FREE); referenced[f].store(0); }
+        for (int j = 0; j < jobs; ++j) evicted[j].store(0);
+        tables.reserve(jobs);
+        stats.reserve(jobs);
+    }
+
+    // jobs are numbered in the order they are added, up to the count given
+    // to the constructor
+    int add_job(long long size) {
+        long long pages = (size + page_size - 1) / page_size;
+        tables.emplace_back(new atomic<int32_t>[pages]);
+        for (long long p = 0; p < pages; ++p) tables.back()[p].store(-1);
+        table_pages.push_back(pages);
+        stats.emplace_back();
+        return (int)tables.size() - 1;
+    }
+
+    // one reference by the job's thread; true on a fault
+    bool access(ConcurrentWorker &w, int job, long long page) {
+        JobStats &st = stats[job];
+        ++st.references;
+        atomic<int32_t> &e = tables[job][page];
+        int32_t f = e.load(memory_order_acquire);
+        uint64_t k = key(job, page);
+        if (f >= 0) {
+            if (!referenced[f].load(memory_order_relaxed)) referenced[f].store(1, memory_order_relaxed);
+            if (frame_map[f].load(memory_order_acquire) == k) { ++st.hits; return false; }
+            ++w.stale_hits;
+        }
+        ++st.faults;
+        int nf = pool.pop(w.home_shard);
+        if (nf < 0) nf = evict(w, st);
+        else if (w.events) w.events->emit(EV_ALLOC, job, page, nf, st.references);
+        if (w.events) w.events->emit(EV_FAULT, job, page, nf, st.references);
+        referenced[nf].store(1, memory_order_relaxed);
+        frame_map[nf].store(k, memory_order_release);
+        e.store(nf, memory_order_release);
+        return true;
+    }
+
+    int frames() const { return num_frames; }
+    int job_count() const { return (int)tables.size(); }
+    long long pages(int job) const { return table_pages[job]; }
+    long long evicted_pages(int job) const { return evicted[job].load(); }
+
+    // frames holding a page once every thread has stopped
+    int resident_count() const {
+        int n = 0;
+        for (int f = 0; f < num_frames; ++f) n += frame_map[f].load() < CLAIMED;
+        return n;
+    }
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef CONTIGUOUS_ALLOCATOR_H
+#define CONTIGUOUS_ALLOCATOR_H
+
+// contiguous_allocator.h
+// Contiguous (variable-partition) allocators for PMA.cpp, to compare against
+// paging on the same job mix. Memory is a range of units (KB in PMA.cpp); a
+// job gets one block of consecutive units or nothing.
+//
+//   first   lowest-addressed free block that fits. Free blocks are indexed
+//           by start address in a max segment tree over the units, so the
+//           leftmost fitting block is one O(log n) descent
+//   best    smallest free block that fits (lowest address among equals),
+//           from a (size, start) ordered set
+//   buddy   blocks of 2^k units on 2^k boundaries; one FreeFrameAllocator
+//           bitmap per order, split on allocation and merged with the free
+//           buddy on release. Requests round up to a power of two, so buddy
+//           also has internal fragmentation (reserved())
+//   seg     segregated fit with power-of-two size classes, one (size, start)
+//           set each and a bitmap of non-empty classes: a request takes the
+//           smallest block of the first non-empty class whose blocks all fit
+//           (one count-trailing-zeros), and only searches its own class when
+//           every larger class is empty
+// first, best and seg merge a released block with free neighbours at once.
+//
+// largest_free() is the largest request that would succeed now, so
+// 1 - largest_free() / free_units() is the external fragmentation.
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_allocator.h"
+
+using namespace std;
+
+class ContiguousAllocator {
+public:
+    virtual ~ContiguousAllocator() {}
+    virtual const char *name() const = 0;
+    // start of a block of size units (size >= 1), or -1 if no free block fits
+    virtual long long allocate(long long size) = 0;
+    // gives back a block from allocate with the same size
+    virtual void release(long long start, long long size) = 0;
+    virtual long long free_units() const = 0;
+    virtual long long largest_free() const = 0;
+    // units a request of size actually takes
+    virtual long long reserved(long long size) const { return size; }
+};
+
+inline int floor_log2(long long n) { return 63 - __builtin_clzll((unsigned long long)n); }
+inline int ceil_log2(long long n) { return n <= 1 ? 0 : floor_log2(n - 1) + 1; }
+
+// free blocks by address, coalesced on release; subclasses keep a second
+// index of the same blocks to choose from
+class CoalescingAllocator : public ContiguousAllocator {
+protected:
+    map<long long, long long> blocks; // start -> size
+    long long total, free_total;
+
+    virtual void index_add(long long start, long long size) = 0;
+    virtual void index_remove(long long start, long long size) = 0;
+    // start of the free block to carve a request from, or -1
+    virtual long long choose(long long size) const = 0;
+
+    void add(long long start, long long size) {
+        blocks[start] = size;
+        index_add(start, size);
+    }
+    void remove(map<long long, long long>::iterator it) {
+        index_remove(it->first, it->second);
+        blocks.erase(it);
+    }
+
+    // the whole memory as one free block; called by the subclass constructor
+    void init() { if (total > 0) add(0, total); }
+
+public:
+    explicit CoalescingAllocator(long long units) : total(units), free_total(units > 0 ? units : 0) {}
+
+    long long allocate(long long size) override {
+        long long start = choose(size);
+        if (start < 0) return -1;
+        auto it = blocks.find(start);
+        long long rest = it->second - size;
+        remove(it);
+        if (rest > 0) add(start + size, rest);
+        free_total -= size;
+        return start;
+    }
+
+    void release(long long start, long long size) override {
+        free_total += size;
+        auto next = blocks.lower_bound(start);
+        if (next != blocks.end() && next->first == start + size) {
+            size += next->second;
+            auto after = next;
+            ++after;
+            remove(next);
+            next = after;
+        }
+        if (next != blocks.begin()) {
+            auto prev = next;
+            --prev;
+            if (prev->first + prev->second == start) {
+                start = prev->first;
+                size += prev->second;
+                remove(prev);
+            }
+        }
+        add(start, size);
+    }
+
+    long long free_units() const override { return free_total; }
+};
+
+class FirstFitAllocator : public CoalescingAllocator {
+    // tree[leaves + a] = size of the free block starting at unit a (0 if
+    // none), inner nodes the maximum of their children
+    size_t leaves = 1;
+    vector<long long> tree;
+
+    void update(long long start, long long size) {
+        size_t i = leaves + (size_t)start;
+        tree[i] = size;
+        for (i >>= 1; i; i >>= 1) tree[i] = max(tree[2 * i], tree[2 * i + 1]);
+    }
+
+protected:
+    void index_add(long long start, long long size) override { update(start, size); }
+    void index_remove(long long start, long long) override { update(start, 0); }
+
+    long long choose(long long size) const override {
+        if (tree[1] < size) return -1;
+        size_t i = 1;
+        while (i < leaves) i = tree[2 * i] >= size ? 2 * i : 2 * i + 1;
+        return (long long)(i - leaves);
+    }
+
+public:
+    explicit FirstFitAllocator(long long units) : CoalescingAllocator(units) {
+        while ((long long)leaves < units) leaves <<= 1;
+        tree.assign(2 * leaves, 0);
+        init();
+    }
+    const char *name() const override { return "first"; }
+    long long largest_free() const override { return tree[1]; }
+};
+
+class BestFitAllocator : public CoalescingAllocator {
+    set<pair<long long, long long>> by_size; // (size, start)
+
+protected:
+    void index_add(long long start, long long size) override { by_size.insert({size, start}); }
+    void index_remove(long long start, long long size) override { by_size.erase({size, start}); }
+
+    long long choose(long long size) const override {
+        auto it = by_size.lower_bound({size, -1});
+        return it == by_size.end() ? -1 : it->second;
+    }
+
+public:
+    explicit BestFitAllocator(long long units) : CoalescingAllocator(units) { init(); }
+    const char *name() const override { return "best"; }
+    long long largest_free() const override { return by_size.empty() ? 0 : by_size.rbegin()->first; }
+};
+
+class SegregatedFitAllocator : public CoalescingAllocator {
+    static const int CLASSES = 64;
+    vector<set<pair<long long, long long>>> classes; // class k: sizes in [2^k, 2^(k+1))
+    uint64_t non_empty = 0;
+
+protected:
+    void index_add(long long start, long long size) override {
+        int k = floor_log2(size);
+        classes[k].insert({size, start});
+        non_empty |= 1ULL << k;
+    }
+    void index_remove(long long start, long long size) override {
+        int k = floor_log2(size);
+        classes[k].erase({size, start});
+        if (classes[k].empty()) non_empty &= ~(1ULL << k);
+    }
+
+    long long choose(long long size) const override {
+        int fit = ceil_log2(size); // every block from this class up is large enough
+        uint64_t above = fit < CLASSES ? non_empty & (~0ULL << fit) : 0;
+        if (above) return classes[__builtin_ctzll(above)].begin()->second;
+        int own = floor_log2(size);
+        if (own == fit) return -1;
+        auto it = classes[own].lower_bound({size, -1});
+        return it == classes[own].end() ? -1 : it->second;
+    }
+
+public:
+    explicit SegregatedFitAllocator(long long units) : CoalescingAllocator(units), classes(CLASSES) { init(); }
+    const char *name() const override { return "seg"; }
+    long long largest_free() const override {
+        return non_empty ? classes[floor_log2((long long)non_empty)].rbegin()->first : 0;
+    }
+};
+
+class BuddyAllocator : public ContiguousAllocator {
+    long long total, free_total = 0;
+    int top = 0;                           // largest order that fits in memory
+    vector<FreeFrameAllocator> orders;     // orders[k]: free blocks of 2^k units, by index
+    uint64_t non_empty = 0;
+
+    void put(int k, long long index) {
+        orders[k].release((int)index);
+        non_empty |= 1ULL << k;
+    }
+    void took(int k) {
+        if (orders[k].freeCount() == 0) non_empty &= ~(1ULL << k);
+    }
+
+public:
+    explicit BuddyAllocator(long long units) : total(units > 0 ? units : 0) {
+        top = total > 0 ? floor_log2(total) : 0;
+        for (int k = 0; k <= top; ++k) {
+            orders.emplace_back(0, false);
+            orders.back().reset((int)(total >> k), false);
+        }
+        // memory that is not a power of two starts as the largest aligned blocks that fit
+        for (long long a = 0; a < total;) {
+            int k = a ? min(top, __builtin_ctzll((unsigned long long)a)) : top;
+            while (a + (1LL << k) > total) --k;
+            put(k, a >> k);
+            a += 1LL << k;
+        }
+        free_total = total;
+    }
+
+    const char *name() const override { return "buddy"; }
+    long long reserved(long long size) const override { return 1LL << ceil_log2(size); }
+
+    long long allocate(long long size) override {
+        int k = ceil_log2(size);
+        if (k > top) return -1;
+        uint64_t avail = non_empty & (~0ULL << k);
+        if (!avail) return -1;
+        int j = __builtin_ctzll(avail);
+        long long index = orders[j].allocateFirst();
+        took(j);
+        while (j > k) { // split, keeping the lower half
+            --j;
+            index <<= 1;
+            put(j, index + 1);
+        }
+        free_total -= 1LL << k;
+        return index << k;
+    }
+
+    void release(long long start, long long size) override {
+        int k = ceil_log2(size);
+        long long index = start >> k;
+        free_total += 1LL << k;
+        while (k < top && orders[k].allocate((int)(index ^ 1))) { // buddy free: merge
+            took(k);
+            index >>= 1;
+            ++k;
+        }
+        put(k, index);
+    }
+
+    long long free_units() const override { return free_total; }
+    long long largest_free() const override { return non_empty ? 1LL << floor_log2((long long)non_empty) : 0; }
+};
+
+inline const vector<string> &contiguous_allocator_names() {
+    static const vector<string> names = {"first", "best", "buddy", "seg"};
+    return names;
+}
+
+// builds an allocator over units units by name (see contiguous_allocator_names);
+// returns nullptr for an unknown name
+inline unique_ptr<ContiguousAllocator> make_contiguous_allocator(const string &name, long long units) {
+    if (name == "first") return unique_ptr<ContiguousAllocator>(new FirstFitAllocator(units));
+    if (name == "best") return unique_ptr<ContiguousAllocator>(new BestFitAllocator(units));
+    if (name == "buddy") return unique_ptr<ContiguousAllocator>(new BuddyAllocator(units));
+    if (name == "seg") return unique_ptr<ContiguousAllocator>(new SegregatedFitAllocator(units));
+    return nullptr;
+}
+
+#endif
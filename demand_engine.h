@@ -0,0 +1,1092 @@
+#ifndef DEMAND_ENGINE_H
+#define DEMAND_ENGINE_H
+
+// demand_engine.h
+// Page-table and frame logic of the demand-paged simulation, shared by the
+// interactive menu and the batch trace replay in paged_memory.cpp.
+// Nothing in here prints; callers decide what to report. Jobs and frames are
+// those of sim_core.h; where SimCore fixes its features at compile time,
+// DemandPager chooses them at run time.
+//
+// save_checkpoint writes the complete state (frames, free map, page tables,
+// policy metadata, TLB, counters, generator state, resident-set, read-ahead
+// and swap state) to a binary file that restore_checkpoint maps back in
+// (checkpoint.h), so a warmed-up memory can seed any number of runs.
+//
+// Writes set FRAME_DIRTY on their frame. With enable_swap the pages move
+// through a simulated swap device (swap_device.h): a fault reads its page,
+// evicting a dirty page queues a write-back, and a cleaner writes aged dirty
+// pages in the background so that replacement finds more of them clean.
+//
+// With trace_events every allocation, fault, eviction, read-ahead load, job
+// start/end and suspension is also appended to an EventRing (event_log.h);
+// without one each of those places costs a single test of a null pointer.
+//
+// fork_job and share_region let several (job, page) pairs map one frame
+// (shared_pages.h). Evicting such a frame unmaps it from every mapper through
+// the reverse map; a write to a shared page copies it first (a COW fault).
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <random>
+#include <memory>
+#include <string>
+#include <cstring>
+
+#include "frame_allocator.h"
+#include "replacement.h"
+#include "tlb.h"
+#include "page_table.h"
+#include "frame_table.h"
+#include "metrics.h"
+#include "resident_set.h"
+#include "readahead.h"
+#include "translate.h"
+#include "swap_device.h"
+#include "sim_core.h"
+#include "checkpoint.h"
+#include "event_log.h"
+#include "shared_pages.h"
+
+using namespace std;
+
+struct PageRef {
+    int job_id;
+    long long page_no;
+    PageRef(): job_id(-1), page_no(-1) {}
+    PageRef(int j, long long p): job_id(j), page_no(p) {}
+};
+
+// outcome of one page reference
+struct AccessResult {
+    int frame = -1;      // frame holding the page afterwards
+    bool fault = false;
+    bool tlb_hit = false;
+    int victim = -1;     // frame that had to be evicted, -1 if a free frame was used
+    PageRef evicted;     // previous owner of the victim frame
+    bool deferred = false; // the job is suspended by load control; the reference is queued
+    int prefetched = 0;    // pages read ahead because of this reference
+    bool written_back = false; // the evicted page was dirty
+};
+
+class DemandPager {
+public:
+    int page_size;
+    int num_frames;
+    vector<Job> jobs;
+    vector<JobStats> stats;          // parallel to jobs
+    long long references = 0;        // over all jobs
+    long long last_fault = -1;       // value of references at the previous fault
+    Log2Histogram fault_gap;         // references (any job) between consecutive faults
+    FrameTable frames;               // frame -> (job index, page_no) + status bits
+    FreeFrameAllocator free_frames;
+    unordered_map<int,int> job_index; // job_id -> index into jobs
+    mt19937 rng;
+    unique_ptr<ReplacementPolicy> policy;
+    unique_ptr<Tlb> tlb;             // optional, consulted before the page table
+    int pt_levels = 0;               // page-table depth for new jobs, 0 = automatic
+    ResidentSetConfig rs;            // resident-set scope, GLOBAL unless enable_resident_sets
+    vector<JobResidentState> rs_state; // parallel to jobs
+    vector<vector<DeferredRef>> deferred_refs; // parallel to jobs: held back by load control
+    JobFrameLists job_lru;           // per-job LRU order of frames (non-global scopes)
+    vector<long long> last_use;      // ws: job reference count at each frame's last use
+    long long quota_assigned = 0;    // local, pff: sum of the quotas of running jobs
+    ResidentTimeline timeline;       // resident set sizes over time (non-global scopes)
+    ReadAheadConfig ra;              // read-ahead, off unless enable_readahead
+    vector<ReadAheadState> ra_state; // parallel to jobs
+    deque<pair<int,uint64_t>> ra_queue; // read-ahead frames (with their page key), oldest first
+    PageDivider divider;             // page_size as shift/mask or reciprocal
+    SwapDevice swap;                 // backing store, off unless enable_swap
+    vector<long long> last_write;    // references at each frame's last write (swap only)
+    int clean_hand = 0;              // next frame the cleaner looks at
+    vector<uint64_t> batch_pages;    // translate_batch scratch
+    vector<int32_t> batch_frames;
+    EventRing *events = nullptr;     // optional event trace, not owned
+    ReverseMap rmap;                 // extra mappers of shared frames
+    vector<ForkPoint> forks;         // scheduled by trace position, applied by run_forks
+    size_t next_fork = 0;
+    vector<SharedRegion> regions;
+    vector<int> region_of;           // parallel to jobs: index into regions, -1 if none
+
+    // policy_name is one of policy_names(); an unknown name falls back to random
+    DemandPager(int page_size_, int num_frames_, unsigned seed, const string &policy_name = "random")
+        : page_size(page_size_), num_frames(num_frames_), frames(num_frames_), free_frames(num_frames_), rng(seed),
+          divider((uint64_t)page_size_) {
+        policy = make_policy(policy_name, rng());
+        if (!policy) policy = make_policy("random", rng());
+        policy->reset(num_frames);
+        job_lru.reset(num_frames);
+    }
+
+    // puts a TLB in front of the page-table lookups
+    void enable_tlb(const TlbConfig &config) {
+        tlb.reset(new Tlb(config, rng()));
+    }
+
+    // switches from one global frame pool to per-job resident sets; call it
+    // before any page is loaded
+    void enable_resident_sets(const ResidentSetConfig &config) {
+        rs = config;
+        if (rs.scope == ResidentScope::WORKING_SET) last_use.assign(num_frames, 0);
+        rebalance_quotas();
+    }
+
+    // loads pages ahead of sequential and strided faults (readahead.h); only
+    // used with the global resident-set scope
+    void enable_readahead(const ReadAheadConfig &config) {
+        ra = config;
+        if (rs.scope != ResidentScope::GLOBAL) ra.enabled = false;
+    }
+
+    // times page transfers on a swap device and starts the cleaner; the
+    // policy passes over dirty victims if cfg.prefer_clean is set
+    void enable_swap(const SwapConfig &config) {
+        swap.init(config, page_size);
+        last_write.assign(num_frames, 0);
+        policy->prefer_clean(&frames, swap.cfg.prefer_clean);
+    }
+
+    // sends events to ring from now on (nullptr stops them); the jobs already
+    // registered are logged as starting now
+    void trace_events(EventRing *ring) {
+        events = ring;
+        for (int i = 0; i < (int)jobs.size(); ++i)
+            if (running(i)) trace(EV_JOB_START, i, jobs[i].id, -1);
+    }
+
+    // writes the whole simulation to path; trace_pos is stored with it for the
+    // caller (e.g. how many trace records have been consumed). False if the
+    // file could not be written
+    bool save_checkpoint(const string &path, long long trace_pos = 0, long long invalid = 0) {
+        CheckpointArchive ar(path, false);
+        string name = policy->name();
+        ar.io(trace_pos);
+        ar.io(invalid);
+        ar.io(page_size);
+        ar.io(num_frames);
+        ar.io(name);
+        checkpoint(ar);
+        return ar.close();
+    }
+
+    // replaces this simulation with the one saved in path and returns its
+    // trace_pos and invalid count; on any error (missing, truncated, damaged
+    // or foreign file, or indices that do not fit together) false, and
+    // nothing changes
+    bool restore_checkpoint(const string &path, long long *trace_pos = nullptr, long long *invalid = nullptr) {
+        CheckpointArchive ar(path, true);
+        long long pos = 0, bad = 0;
+        int ps = 0, nf = 0;
+        string name;
+        ar.io(pos);
+        ar.io(bad);
+        ar.io(ps);
+        ar.io(nf);
+        ar.io(name);
+        if (!ar.ok() || ps <= 0 || nf <= 0 || !make_policy(name, 0)) return false;
+        DemandPager loaded(ps, nf, 0, name);
+        loaded.checkpoint(ar);
+        if (!ar.close()) return false;
+        EventRing *ring = events;
+        *this = move(loaded);
+        events = ring;
+        policy->prefer_clean(&frames, swap.cfg.prefer_clean);
+        if (trace_pos) *trace_pos = pos;
+        if (invalid) *invalid = bad;
+        return true;
+    }
+
+    // hands the resident pages to a new replacement policy, in frame order,
+    // as if each had just been loaded; false for an unknown name. Used to
+    // branch runs with different policies from one checkpoint
+    bool switch_policy(const string &name) {
+        unique_ptr<ReplacementPolicy> next = make_policy(name, rng());
+        if (!next) return false;
+        next->reset(num_frames);
+        for (int f = 0; f < num_frames; ++f)
+            if (frames.used(f)) next->on_load(f, page_key(jobs[frames.owner(f)].id, frames.page(f)), NEVER_USED);
+        next->prefer_clean(&frames, swap.cfg.prefer_clean);
+        policy = move(next);
+        return true;
+    }
+
+    // id of the job owning a frame, or -1 if the frame is free
+    int frame_job_id(int frame) const {
+        int owner = frames.owner(frame);
+        return owner == -1 ? -1 : jobs[owner].id;
+    }
+
+    // registers a job and returns its index; the job starts with nothing resident.
+    // -1 once the index would not fit a frame's owner field
+    int add_job(int id, long long size) {
+        if ((long long)jobs.size() > FrameTable::MAX_OWNER) return -1;
+        jobs.push_back(make_job(id, size, page_size, pt_levels));
+        stats.emplace_back();
+        stats.back().internal_frag = jobs.back().internal_frag;
+        rs_state.emplace_back();
+        deferred_refs.emplace_back();
+        ra_state.emplace_back();
+        job_lru.add_job();
+        region_of.push_back(-1);
+        job_index[id] = (int)jobs.size() - 1;
+        trace(EV_JOB_START, (int)jobs.size() - 1, id, -1);
+        rebalance_quotas();
+        return (int)jobs.size() - 1;
+    }
+
+    // job ids parallel to jobs and stats, for reports
+    vector<int> job_ids() const {
+        vector<int> ids;
+        for (const Job &job : jobs) ids.push_back(job.id);
+        return ids;
+    }
+
+    // counters summed over every job
+    JobStats total() const {
+        JobStats sum;
+        for (const JobStats &st : stats) sum += st;
+        return sum;
+    }
+
+    // index of the job with this id, or -1
+    int find_job(int id) const {
+        auto it = job_index.find(id);
+        return it == job_index.end() ? -1 : it->second;
+    }
+
+    // true while the job has not been terminated
+    bool running(int idx) const { return find_job(jobs[idx].id) == idx; }
+
+    // returns every frame of a job to the free pool and empties its page
+    // table; with swap_out its dirty pages are written back first. Frames
+    // other jobs still map stay with them. Returns the frames freed
+    int release_job_frames(int idx, bool swap_out = false) {
+        Job &job = jobs[idx];
+        vector<pair<long long,int>> resident;
+        job.page_table.for_each_mapped([&](long long p, int f) { resident.push_back({p, f}); });
+        int freed = 0;
+        for (auto &pf : resident) {
+            if (rmap.shared(pf.second)) {
+                unshare(pf.second, idx, pf.first);
+                continue;
+            }
+            ++freed;
+            if (frames.test(pf.second, FRAME_PREFETCHED)) ++stats[idx].prefetch_wasted;
+            if (swap_out) page_out(pf.second);
+            policy->on_evict(pf.second);
+            frames.clear(pf.second);
+            free_frames.release(pf.second);
+            if (tlb) tlb->invalidate(job.id, (uint64_t)pf.first);
+        }
+        job.page_table.init(job.num_pages, job.page_table.depth());
+        stats[idx].resident = 0;
+        ra_state[idx] = ReadAheadState();
+        job_lru.clear(idx);
+        return freed;
+    }
+
+    // ends a job: its frames go back to the free pool, its TLB entries and page
+    // table are dropped and its id stops resolving; returns the frames freed.
+    // The slot in jobs stays so the indices held by other frames remain valid
+    int terminate_job(int idx) {
+        int freed = release_job_frames(idx);
+        trace(EV_JOB_END, idx, freed, -1);
+        quota_assigned -= rs_state[idx].quota;
+        rs_state[idx] = JobResidentState();
+        deferred_refs[idx].clear();
+        job_index.erase(jobs[idx].id);
+        if (rs.scope == ResidentScope::LOCAL) rebalance_quotas();
+        return freed;
+    }
+
+    // starts job child_id as a copy of the job at parent: same size, same
+    // shared region, and every resident page of the parent mapped into the
+    // child copy-on-write. Returns the child's index, or -1 when the id is
+    // taken, add_job refuses the child, or resident sets are per job (a frame
+    // then has a single owner)
+    int fork_job(int parent, int child_id) {
+        if (rs.scope != ResidentScope::GLOBAL || find_job(child_id) != -1) return -1;
+        if (!rmap.active()) rmap.reset(num_frames);
+        int child = add_job(child_id, jobs[parent].size);
+        if (child == -1) return -1;
+        region_of[child] = region_of[parent];
+        if (region_of[child] != -1) regions[region_of[child]].members.push_back(child);
+        jobs[parent].page_table.for_each_mapped([&](long long p, int f) {
+            map_shared(f, child, p);
+            trace(EV_SHARE, child, p, f);
+        });
+        return child;
+    }
+
+    // the first `pages` pages of the jobs at idxs are one memory: a read
+    // fault maps the frame another of them already holds. Global scope only,
+    // like fork_job; false otherwise
+    bool share_region(const vector<int> &idxs, long long pages) {
+        if (rs.scope != ResidentScope::GLOBAL) return false;
+        if (!rmap.active()) rmap.reset(num_frames);
+        SharedRegion region;
+        region.pages = pages;
+        for (int idx : idxs) {
+            if (region_of[idx] != -1) continue;
+            region_of[idx] = (int)regions.size();
+            region.members.push_back(idx);
+        }
+        regions.push_back(region);
+        return true;
+    }
+
+    // trace position of the next scheduled fork, or -1 if none remain
+    long long next_fork_at() const { return next_fork < forks.size() ? forks[next_fork].at : -1; }
+
+    // applies the forks scheduled at or before trace position `consumed`
+    // whose parent is running; returns how many took place
+    int run_forks(long long consumed) {
+        int done = 0;
+        for (; next_fork < forks.size() && forks[next_fork].at <= consumed; ++next_fork) {
+            int parent = find_job(forks[next_fork].parent_id);
+            if (parent != -1 && fork_job(parent, forks[next_fork].child_id) != -1) ++done;
+        }
+        return done;
+    }
+
+    // loads the job's non-resident pages in random order until memory is full
+    // or the job is done; returns the number of pages loaded
+    int preload(int idx) {
+        Job &job = jobs[idx];
+        int loaded = 0;
+        auto load = [&](long long p) {
+            if (job.page_table[p] != -1) return true;
+            int free_idx = free_frames.allocateFirst();
+            if (free_idx == -1) return false;
+            frames.assign(free_idx, idx, p);
+            trace(EV_ALLOC, idx, p, free_idx);
+            job.page_table.set(p, free_idx);
+            policy->on_load(free_idx, page_key(job.id, p), NEVER_USED);
+            ++stats[idx].resident;
+            if (rs.scope != ResidentScope::GLOBAL) job_lru.push_back(idx, free_idx);
+            ++loaded;
+            return true;
+        };
+        if (job.num_pages <= 4LL * num_frames) {
+            vector<long long> pages(job.num_pages);
+            iota(pages.begin(), pages.end(), 0LL);
+            shuffle(pages.begin(), pages.end(), rng);
+            for (long long p : pages) if (!load(p)) break;
+        } else {
+            // job much larger than memory: sample random pages until memory is full
+            uniform_int_distribution<long long> dist(0, job.num_pages - 1);
+            while (free_frames.freeCount() > 0) load(dist(rng));
+        }
+        return loaded;
+    }
+
+    // references one page of a job, faulting it in if needed; when no frame is
+    // free the replacement policy picks the victim. next_use is the trace
+    // position of this page's next reference (only OPT needs it); write
+    // marks the page dirty. Under load control a reference of a suspended
+    // job is queued (r.deferred) and served once the job is readmitted,
+    // ahead of its next reference
+    AccessResult access_page(int idx, long long page_no, long long next_use = NEVER_USED, bool write = false) {
+        if (rs.load_control) {
+            vector<DeferredRef> &q = deferred_refs[idx];
+            size_t served = 0;
+            bool admitted;
+            while ((admitted = admit(idx)) && served < q.size()) {
+                serve_page(idx, q[served].page_no, q[served].next_use, q[served].write);
+                ++served;
+            }
+            if (served) q.erase(q.begin(), q.begin() + served);
+            if (!admitted) {
+                DeferredRef d;
+                d.page_no = page_no;
+                d.next_use = next_use;
+                d.write = write;
+                q.push_back(d);
+                ++stats[idx].deferred;
+                AccessResult r;
+                r.deferred = true;
+                return r;
+            }
+        }
+        return serve_page(idx, page_no, next_use, write);
+    }
+
+    // serves every reference load control still holds back, as at the end
+    // of a trace: with nothing left to wait for, each job with a queue is
+    // readmitted (its quantum counts as over) and the queue replayed
+    void serve_deferred() {
+        for (int i = 0; i < (int)jobs.size(); ++i) {
+            vector<DeferredRef> &q = deferred_refs[i];
+            for (size_t k = 0; k < q.size();) {
+                rs_state[i].resume_at = min(rs_state[i].resume_at, references);
+                if (!admit(i)) continue;
+                serve_page(i, q[k].page_no, q[k].next_use, q[k].write);
+                ++k;
+            }
+            q.clear();
+        }
+    }
+
+    // translates n byte addresses of job idx (each 0 <= addr < job size) in
+    // order, with the same effect as calling access_page on each. phys[i] gets
+    // the physical address and fault[i] 1 if reference i faulted; writes[i]
+    // (optional) is 1 for a store.
+    // The page numbers and frames of the whole batch are looked up first
+    // (vectorised for flat page tables); only misses, and hits whose frame an
+    // earlier fault of the batch took, go through access_page. With a TLB or
+    // a per-job resident-set scope (or a swap device timing each reference)
+    // every reference needs its own bookkeeping, so the batch is simply
+    // replayed through access_page; a reference load control defers gets
+    // phys -1 and is served when its job is readmitted. Returns the number
+    // of faults
+    size_t translate_batch(int idx, const long long *addr, size_t n, long long *phys, uint8_t *fault,
+                           const uint8_t *writes = nullptr) {
+        size_t faults = 0;
+        if (tlb || rs.scope != ResidentScope::GLOBAL || rs.load_control || ra.enabled || swap.cfg.enabled) {
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t p, off;
+                divider.split((uint64_t)addr[i], p, off);
+                AccessResult r = access_page(idx, (long long)p, NEVER_USED, writes && writes[i]);
+                fault[i] = r.fault;
+                phys[i] = r.frame < 0 ? -1 : (long long)r.frame * page_size + (long long)off;
+                faults += r.fault;
+            }
+            return faults;
+        }
+        if (batch_pages.size() < n) { batch_pages.resize(n); batch_frames.resize(n); }
+        uint64_t *pages = batch_pages.data();
+        int32_t *fr = batch_frames.data();
+        const PageTable &pt = jobs[idx].page_table;
+        if (const int32_t *table = pt.flat()) {
+            gather_pages(table, divider, addr, n, pages, fr);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                pages[i] = divider.page((uint64_t)addr[i]);
+                fr[i] = pt.lookup((long long)pages[i]);
+            }
+        }
+
+        JobStats &st = stats[idx];
+        bool on_hit = policy->tracks_hits();
+        bool evicted = false;  // a fault of this batch took a frame: revalidate hits
+        long long hits = 0;    // not yet added to the counters
+        for (size_t i = 0; i < n; ++i) {
+            if (!evicted && (!writes || !writes[i]) && fr[i] != -1) {
+                // a run of plain read hits: one policy call and a loop the
+                // compiler vectorises, no per-reference checks
+                size_t j = i + 1;
+                while (j < n && fr[j] != -1 && (!writes || !writes[j])) ++j;
+                if (on_hit) policy->on_hits(fr + i, j - i);
+                memset(fault + i, 0, j - i);
+                if (divider.power_of_two()) {
+                    int s = divider.shift();
+                    long long mask = page_size - 1;
+                    for (size_t k = i; k < j; ++k) phys[k] = ((long long)fr[k] << s) | (addr[k] & mask);
+                } else {
+                    for (size_t k = i; k < j; ++k)
+                        phys[k] = (long long)fr[k] * page_size + (addr[k] - (long long)pages[k] * page_size);
+                }
+                hits += (long long)(j - i);
+                i = j - 1;
+                continue;
+            }
+            int f = fr[i];
+            long long p = (long long)pages[i];
+            if (f != -1 && (!evicted || (frames.owner(f) == idx && frames.page(f) == p)) &&
+                !(writes && writes[i] && frames.test(f, FRAME_COW))) {
+                if (on_hit) policy->on_hit(f, NEVER_USED);
+                if (writes && writes[i]) frames.mark(f, FRAME_DIRTY);
+                ++hits;
+                fault[i] = 0;
+                phys[i] = (long long)f * page_size + (addr[i] - p * page_size);
+                continue;
+            }
+            st.references += hits; st.hits += hits; references += hits;
+            hits = 0;
+            AccessResult r = access_page(idx, p, NEVER_USED, writes && writes[i]);
+            evicted |= r.victim != -1 || (r.fault && rmap.active()); // a COW copy moves the page too
+            fault[i] = r.fault;
+            phys[i] = (long long)r.frame * page_size + (addr[i] - p * page_size);
+            faults += r.fault;
+        }
+        st.references += hits; st.hits += hits; references += hits;
+        return faults;
+    }
+
+    // every job, frame, page and region index the engine will follow stays
+    // inside the arrays it indexes, and the frame table, free map and page
+    // tables agree about which frames are in use (checked after a restore)
+    bool indices_valid() const {
+        int n = (int)jobs.size();
+        auto page_ok = [&](int j, long long p) { return j >= 0 && j < n && p >= 0 && p < jobs[j].num_pages; };
+        for (const Job &job : jobs) {
+            if (job.num_pages < 0) return false;
+            bool ok = true;
+            job.page_table.for_each_mapped([&](long long p, int f) { ok = ok && p < job.num_pages && f >= 0 && f < num_frames; });
+            if (!ok) return false;
+        }
+        for (int f = 0; f < num_frames; ++f) {
+            if (frames.used(f) == free_frames.isFree(f)) return false;
+            if (!frames.used(f)) continue;
+            int j = frames.owner(f);
+            if (!page_ok(j, frames.page(f)) || jobs[j].page_table[frames.page(f)] != f) return false;
+        }
+        for (auto &e : job_index)
+            if (e.second < 0 || e.second >= n || jobs[e.second].id != e.first) return false;
+        for (int r : region_of)
+            if (r < -1 || r >= (int)regions.size()) return false;
+        for (const SharedRegion &region : regions)
+            for (int j : region.members) if (j < 0 || j >= n) return false;
+        if (rmap.active() && !rmap.mappers_valid(page_ok)) return false;
+        if (job_lru.jobs() != n || (tlb && !tlb->frames_valid(num_frames))) return false;
+        for (int j = 0; j < n; ++j)
+            for (const DeferredRef &d : deferred_refs[j]) if (!page_ok(j, d.page_no)) return false;
+        for (auto &e : ra_queue)
+            if (e.first < 0 || e.first >= num_frames) return false;
+        if (rs.scope == ResidentScope::WORKING_SET && (int)last_use.size() != num_frames) return false;
+        if (!last_write.empty() && (int)last_write.size() != num_frames) return false;
+        return next_fork <= forks.size() && clean_hand >= 0 && clean_hand < num_frames;
+    }
+
+private:
+    // every field except the policy's name and the sizes, which
+    // save_checkpoint writes first so restore_checkpoint can build the engine
+    void checkpoint(CheckpointArchive &ar) {
+        ar.section("engine");
+        uint64_t n = jobs.size();
+        ar.io(n);
+        if (ar.loading()) {
+            if (!ar.ok() || n > (uint64_t)FrameTable::MAX_OWNER) return;
+            jobs.assign(n, Job());
+        }
+        for (Job &job : jobs) {
+            ar.io(job.id);
+            ar.io(job.size);
+            ar.io(job.num_pages);
+            ar.io(job.internal_frag);
+            job.page_table.checkpoint(ar);
+        }
+        ar.io(stats);
+        ar.io(references);
+        ar.io(last_fault);
+        ar.io(fault_gap);
+        frames.checkpoint(ar);
+        free_frames.checkpoint(ar);
+        // by id, so equal engines save equal files whatever the hash order
+        vector<pair<int,int>> index(job_index.begin(), job_index.end());
+        sort(index.begin(), index.end());
+        vector<int> ids, idxs;
+        for (auto &e : index) { ids.push_back(e.first); idxs.push_back(e.second); }
+        ar.io(ids);
+        ar.io(idxs);
+        if (ar.loading()) {
+            job_index.clear();
+            for (size_t i = 0; i < ids.size() && i < idxs.size(); ++i) job_index[ids[i]] = idxs[i];
+        }
+        ar.io(rng);
+        ar.section("policy");
+        policy->checkpoint(ar);
+        bool has_tlb = tlb != nullptr;
+        TlbConfig tlb_cfg = tlb ? tlb->config() : TlbConfig();
+        ar.io(has_tlb);
+        ar.io(tlb_cfg);
+        if (ar.loading() && has_tlb) tlb.reset(new Tlb(tlb_cfg));
+        if (has_tlb) tlb->checkpoint(ar);
+        ar.section("rs");
+        ar.io(pt_levels);
+        ar.io(rs);
+        ar.io(rs_state);
+        ar.io(deferred_refs);
+        job_lru.checkpoint(ar);
+        ar.io(last_use);
+        ar.io(quota_assigned);
+        timeline.checkpoint(ar);
+        ar.section("ra");
+        ar.io(ra);
+        ar.io(ra_state);
+        vector<int> ra_frames;
+        vector<uint64_t> ra_keys;
+        for (auto &e : ra_queue) { ra_frames.push_back(e.first); ra_keys.push_back(e.second); }
+        ar.io(ra_frames);
+        ar.io(ra_keys);
+        if (ar.loading()) {
+            ra_queue.clear();
+            for (size_t i = 0; i < ra_frames.size() && i < ra_keys.size(); ++i) ra_queue.push_back({ra_frames[i], ra_keys[i]});
+        }
+        ar.io(swap.cfg);
+        swap.checkpoint(ar);
+        ar.io(last_write);
+        ar.io(clean_hand);
+        ar.section("shared");
+        rmap.checkpoint(ar);
+        ar.io(forks);
+        ar.io(next_fork);
+        vector<long long> region_pages;
+        vector<vector<int>> region_members;
+        for (SharedRegion &r : regions) { region_pages.push_back(r.pages); region_members.push_back(r.members); }
+        ar.io(region_pages);
+        ar.io(region_members);
+        if (ar.loading()) {
+            regions.assign(min(region_pages.size(), region_members.size()), SharedRegion());
+            for (size_t i = 0; i < regions.size(); ++i) { regions[i].pages = region_pages[i]; regions[i].members = region_members[i]; }
+        }
+        ar.io(region_of);
+        ar.section("end");
+        if (ar.loading() && (frames.size() != num_frames || free_frames.capacity() != num_frames ||
+                             stats.size() != jobs.size() || rs_state.size() != jobs.size() ||
+                             deferred_refs.size() != jobs.size() || ra_state.size() != jobs.size() ||
+                             region_of.size() != jobs.size() || (rmap.active() && rmap.size() != num_frames)))
+            ar.fail();
+        if (ar.loading() && ar.ok() && !indices_valid()) ar.fail();
+    }
+
+    // access_page for an admitted reference
+    AccessResult serve_page(int idx, long long page_no, long long next_use, bool write) {
+        Job &job = jobs[idx];
+        JobStats &st = stats[idx];
+        AccessResult r;
+        ++st.references;
+        ++references;
+        if (swap.cfg.enabled) {
+            swap.tick();
+            if (swap.cfg.clean_every > 0 && references % swap.cfg.clean_every == 0) run_cleaner();
+        }
+        if (tlb) {
+            tlb->switch_to(job.id);
+            if (tlb->lookup(job.id, (uint64_t)page_no, r.frame)) {
+                if (write && frames.test(r.frame, FRAME_COW) && copy_on_write(idx, page_no, next_use, r)) return r;
+                r.tlb_hit = true;
+                ++st.hits;
+                if (write) mark_dirty(r.frame);
+                policy->on_hit(r.frame, next_use);
+                if (rs.scope != ResidentScope::GLOBAL) rs_reference(idx, r.frame);
+                return r;
+            }
+        }
+        r.frame = job.page_table[page_no];
+        if (r.frame != -1) {
+            if (write && frames.test(r.frame, FRAME_COW) && copy_on_write(idx, page_no, next_use, r)) return r;
+            if (tlb) tlb->insert(job.id, (uint64_t)page_no, r.frame);
+            ++st.hits;
+            if (write) mark_dirty(r.frame);
+            policy->on_hit(r.frame, next_use);
+            if (rs.scope != ResidentScope::GLOBAL) rs_reference(idx, r.frame);
+            if (frames.test(r.frame, FRAME_PREFETCHED)) {
+                frames.unmark(r.frame, FRAME_PREFETCHED);
+                ++st.prefetch_hits;
+                long long n = ra_state[idx].on_first_use(page_no, ra);
+                if (n) r.prefetched = read_ahead(idx, n, r.frame);
+            }
+            return r;
+        }
+
+        r.fault = true;
+        count_fault(idx);
+        // a read of a shared-region page maps the frame of another member that holds it
+        bool in_region = !regions.empty() && region_of[idx] != -1 && page_no < regions[region_of[idx]].pages;
+        if (in_region && !write && (r.frame = region_frame(idx, page_no)) != -1) {
+            map_shared(r.frame, idx, page_no);
+            ++st.shared_maps;
+            trace(EV_SHARE, idx, page_no, r.frame);
+            if (tlb) tlb->insert(job.id, (uint64_t)page_no, r.frame);
+            policy->on_hit(r.frame, next_use);
+            return r;
+        }
+        load_page(idx, page_no, next_use, write, r, true);
+        if (in_region && !write) frames.mark(r.frame, FRAME_COW);
+        return r;
+    }
+
+    void count_fault(int idx) {
+        JobStats &st = stats[idx];
+        ++st.faults;
+        if (st.last_fault >= 0) st.fault_gap.add(st.references - st.last_fault);
+        st.last_fault = st.references;
+        if (last_fault >= 0) fault_gap.add(references - last_fault);
+        last_fault = references;
+    }
+
+    // puts page_no of job idx into a free frame or a victim's (r gets the
+    // frame and the victim); read_in is false for a copy made in memory,
+    // which takes no read from swap
+    void load_page(int idx, long long page_no, long long next_use, bool write, AccessResult &r, bool read_in) {
+        Job &job = jobs[idx];
+        JobStats &st = stats[idx];
+        uint64_t key = page_key(job.id, page_no);
+        r.frame = rs.scope == ResidentScope::GLOBAL ? free_frames.allocateFirst() : rs_fault_frame(idx, r);
+        if (r.frame == -1 && ra.enabled && (r.frame = ra_victim()) != -1) {
+            r.victim = r.frame;
+            r.evicted = PageRef(jobs[frames.owner(r.frame)].id, frames.page(r.frame));
+            ++st.evictions;
+            r.written_back = unmap_frame(r.victim);
+        }
+        if (r.frame == -1) {
+            r.victim = r.frame = policy->choose_victim(key);
+            if (frames.test(r.victim, FRAME_PREFETCHED)) ra_wasted(r.victim);
+            int vidx = frames.owner(r.victim);
+            r.evicted = PageRef(jobs[vidx].id, frames.page(r.victim));
+            ++st.evictions;
+            ++stats[vidx].evicted;
+            r.written_back = unmap_frame(r.victim);
+        }
+        if (swap.cfg.enabled && read_in) swap.read();
+        if (events) {
+            if (r.victim == -1) events->emit(EV_ALLOC, idx, page_no, r.frame, references);
+            events->emit(EV_FAULT, idx, page_no, r.frame, references);
+        }
+        frames.assign(r.frame, idx, page_no);
+        if (write) mark_dirty(r.frame);
+        job.page_table.set(page_no, r.frame);
+        ++st.resident;
+        if (tlb) tlb->insert(job.id, (uint64_t)page_no, r.frame);
+        policy->on_load(r.frame, key, next_use);
+        if (rs.scope != ResidentScope::GLOBAL) {
+            job_lru.push_back(idx, r.frame);
+            ++rs_state[idx].window_faults;
+            rs_reference(idx, r.frame);
+        }
+        if (ra.enabled) {
+            long long n = ra_state[idx].on_fault(page_no, ra);
+            if (n) r.prefetched = read_ahead(idx, n, r.frame);
+        }
+    }
+
+    // a write by job idx to page_no in the FRAME_COW frame r.frame. The only
+    // mapper just clears the bit and writes in place (false); otherwise the
+    // job leaves the shared frame and faults in a copy of its own (true)
+    bool copy_on_write(int idx, long long page_no, long long next_use, AccessResult &r) {
+        if (!rmap.shared(r.frame)) {
+            frames.unmark(r.frame, FRAME_COW);
+            return false;
+        }
+        r.fault = true;
+        count_fault(idx);
+        ++stats[idx].cow_faults;
+        unshare(r.frame, idx, page_no);
+        load_page(idx, page_no, next_use, true, r, false);
+        trace(EV_COW, idx, page_no, r.frame);
+        return true;
+    }
+
+    // a frame holding page p for another job of idx's shared region and not
+    // written since it was loaded, or -1
+    int region_frame(int idx, long long p) const {
+        for (int m : regions[region_of[idx]].members) {
+            if (m == idx || p >= jobs[m].num_pages) continue;
+            int f = jobs[m].page_table.lookup(p);
+            if (f != -1 && frames.test(f, FRAME_COW)) return f;
+        }
+        return -1;
+    }
+
+    // job idx maps page p to frame f, which other pages already map
+    void map_shared(int f, int idx, long long p) {
+        rmap.add(f, idx, p);
+        frames.mark(f, FRAME_COW);
+        jobs[idx].page_table.set(p, f);
+        ++stats[idx].resident;
+    }
+
+    // job idx stops mapping page p in the shared frame f, which stays with
+    // its other mappers; if idx was the primary, another mapper takes over
+    void unshare(int f, int idx, long long p) {
+        if (frames.owner(f) == idx && frames.page(f) == p) {
+            int j = -1;
+            long long q = -1;
+            if (rmap.pop(f, j, q)) frames.remap(f, j, q);
+        } else {
+            rmap.remove(f, idx, p);
+        }
+        jobs[idx].page_table.set(p, -1);
+        --stats[idx].resident;
+        if (tlb) tlb->invalidate(jobs[idx].id, (uint64_t)p);
+    }
+
+    // takes a resident frame away from its page, and from every other page
+    // mapping it (the policy has already forgotten it); the frame itself
+    // stays allocated. True if the page was dirty and had to be written back
+    bool unmap_frame(int f) {
+        int vidx = frames.owner(f);
+        long long p = frames.page(f);
+        bool dirty = page_out(f);
+        trace(EV_EVICT | (dirty ? EV_DIRTY : 0), vidx, p, f);
+        --stats[vidx].resident;
+        jobs[vidx].page_table.set(p, -1);
+        if (tlb) tlb->invalidate(jobs[vidx].id, (uint64_t)p);
+        if (rs.scope != ResidentScope::GLOBAL) job_lru.remove(vidx, f);
+        if (rmap.shared(f)) {
+            rmap.for_each(f, [&](int j, long long q) {
+                trace(EV_EVICT, j, q, f);
+                --stats[j].resident;
+                ++stats[j].evicted;
+                jobs[j].page_table.set(q, -1);
+                if (tlb) tlb->invalidate(jobs[j].id, (uint64_t)q);
+            });
+            rmap.clear(f);
+        }
+        return dirty;
+    }
+
+    void trace(int type, int idx, long long page, int frame) {
+        if (events) events->emit(type, idx, page, frame, references);
+    }
+
+    void mark_dirty(int f) {
+        frames.mark(f, FRAME_DIRTY);
+        if (!last_write.empty()) last_write[f] = references;
+    }
+
+    // the page in f leaves memory: a dirty one goes to the swap device.
+    // Returns whether it was dirty
+    bool page_out(int f) {
+        bool dirty = frames.test(f, FRAME_DIRTY);
+        if (!swap.cfg.enabled) return dirty;
+        if (dirty) swap.write_back();
+        else ++swap.stats.clean_evictions;
+        return dirty;
+    }
+
+    // background write-back: continues around the frames from where it
+    // stopped and writes up to clean_batch pages that have not been written
+    // for clean_every references, while write buffers are free
+    void run_cleaner() {
+        int written = 0;
+        int scan = (int)min<long long>(num_frames, 64LL * max(1, swap.cfg.clean_batch));
+        for (int k = 0; k < scan && written < swap.cfg.clean_batch; ++k) {
+            int f = clean_hand;
+            clean_hand = clean_hand + 1 == num_frames ? 0 : clean_hand + 1;
+            if (!frames.test(f, FRAME_DIRTY) || references - last_write[f] < swap.cfg.clean_every) continue;
+            if (!swap.clean()) break;
+            frames.unmark(f, FRAME_DIRTY);
+            ++written;
+        }
+    }
+
+    // true while a queued read-ahead frame still holds its page unreferenced
+    bool ra_pending(const pair<int,uint64_t> &e) const {
+        int f = e.first;
+        return frames.test(f, FRAME_PREFETCHED) && page_key(jobs[frames.owner(f)].id, frames.page(f)) == e.second;
+    }
+
+    // a read-ahead frame is evicted before its first use; if its job had yet
+    // to reach it, that job's read-ahead window shrinks
+    void ra_wasted(int f) {
+        int owner = frames.owner(f);
+        ++stats[owner].prefetch_wasted;
+        if (ra_state[owner].ahead(frames.page(f))) ra_state[owner].on_thrash(ra);
+    }
+
+    // oldest read-ahead frame, among the first few queued, whose job has
+    // already passed it without a reference; it is taken from its page and
+    // the policy, or -1 if there is none
+    int ra_victim() {
+        const int LOOK = 16;
+        for (int k = 0; k < (int)ra_queue.size() && k < LOOK;) {
+            int f = ra_queue[k].first;
+            int owner = frames.owner(f);
+            if (!ra_pending(ra_queue[k])) {
+                ra_queue.erase(ra_queue.begin() + k); // used or evicted since
+                continue;
+            }
+            if (ra_state[owner].ahead(frames.page(f))) { ++k; continue; }
+            ra_queue.erase(ra_queue.begin() + k);
+            policy->on_evict(f);
+            ++stats[owner].evicted;
+            ra_wasted(f);
+            return f;
+        }
+        return -1;
+    }
+
+    // loads up to n pages of job idx along its stream without referencing
+    // them; keep is the frame of the reference that triggered it and must
+    // stay resident. Stops early at the end of the job or when the only
+    // victim would be keep. Returns the pages loaded
+    int read_ahead(int idx, long long n, int keep) {
+        Job &job = jobs[idx];
+        JobStats &st = stats[idx];
+        ReadAheadState &s = ra_state[idx];
+        int loaded = 0;
+        bool marked = false;
+        for (; n > 0 && s.next >= 0 && s.next < job.num_pages; --n, s.next += s.stride) {
+            long long p = s.next;
+            if (job.page_table[p] != -1) continue;
+            int f = free_frames.allocateFirst();
+            if (f == -1) f = ra_victim();
+            if (f == -1) {
+                f = policy->choose_victim(page_key(job.id, p));
+                if (f == -1) break;
+                if (f == keep) { policy->on_load(f, page_key(jobs[frames.owner(f)].id, frames.page(f)), NEVER_USED); break; }
+                if (frames.test(f, FRAME_PREFETCHED)) ra_wasted(f);
+                ++stats[frames.owner(f)].evicted;
+            }
+            if (frames.used(f)) { ++st.evictions; unmap_frame(f); }
+            else trace(EV_ALLOC, idx, p, f);
+            if (swap.cfg.enabled) swap.read(false);
+            trace(EV_PREFETCH, idx, p, f);
+            frames.assign(f, idx, p);
+            frames.mark(f, FRAME_PREFETCHED);
+            job.page_table.set(p, f);
+            ++st.resident;
+            uint64_t key = page_key(job.id, p);
+            policy->on_load(f, key, NEVER_USED);
+            ra_queue.push_back({f, key});
+            if ((long long)ra_queue.size() > 2LL * num_frames) {
+                // at most num_frames entries are pending: drop the rest
+                deque<pair<int,uint64_t>> pending;
+                for (auto &e : ra_queue) if (ra_pending(e)) pending.push_back(e);
+                ra_queue.swap(pending);
+            }
+            if (!marked) { s.marker = p; marked = true; }
+            ++st.prefetched;
+            ++loaded;
+        }
+        return loaded;
+    }
+
+    // returns a resident frame to the free pool outside of a fault
+    void release_frame(int f) {
+        policy->on_evict(f);
+        ++stats[frames.owner(f)].evicted;
+        unmap_frame(f);
+        frames.clear(f);
+        free_frames.release(f);
+    }
+
+    // evicts the job's own least recently used page for its fault
+    int evict_own(int idx, AccessResult &r) {
+        int f = job_lru.front(idx);
+        r.victim = f;
+        r.evicted = PageRef(jobs[idx].id, frames.page(f));
+        policy->on_evict(f);
+        ++stats[idx].evictions;
+        ++stats[idx].evicted;
+        r.written_back = unmap_frame(f);
+        return f;
+    }
+
+    // frame for a fault of job idx under a non-global scope, or -1 to let the
+    // global policy pick a victim (only when the job holds nothing to replace)
+    int rs_fault_frame(int idx, AccessResult &r) {
+        bool quota_scope = rs.scope == ResidentScope::LOCAL || rs.scope == ResidentScope::PFF;
+        if (quota_scope && stats[idx].resident >= rs_state[idx].quota && job_lru.front(idx) != -1)
+            return evict_own(idx, r);
+        int f = free_frames.allocateFirst();
+        if (f != -1) return f;
+        // working sets exceed memory: swap out the largest job; when that is
+        // this one it replaces its own page now and goes at its next reference
+        if (rs.load_control && rs.scope == ResidentScope::WORKING_SET) {
+            int v = suspend_candidate();
+            if (v != -1 && v != idx) {
+                suspend(v);
+                return free_frames.allocateFirst();
+            }
+            if (v == idx) rs_state[idx].suspend_next = true;
+        }
+        return job_lru.front(idx) != -1 ? evict_own(idx, r) : -1;
+    }
+
+    // bookkeeping after every reference of job idx that ended in frame f
+    void rs_reference(int idx, int f) {
+        JobStats &st = stats[idx];
+        JobResidentState &s = rs_state[idx];
+        job_lru.touch(idx, f);
+        if (rs.scope == ResidentScope::WORKING_SET) {
+            last_use[f] = st.references;
+            int old;
+            while ((old = job_lru.front(idx)) != -1 && last_use[old] <= st.references - rs.tau) release_frame(old);
+        } else if (rs.scope == ResidentScope::PFF && st.references - s.window_start >= rs.window) {
+            double rate = (double)s.window_faults / (double)(st.references - s.window_start);
+            if (rate > rs.high) grow_quota(idx, max(1LL, s.quota / 4));
+            else if (rate < rs.low && s.quota > 1) set_quota(idx, max(1LL, s.quota - max(1LL, s.quota / 8)));
+            s.window_start = st.references;
+            s.window_faults = 0;
+        }
+        if (timeline.due(references)) timeline.record(references, stats);
+    }
+
+    // sets a job's quota and drops its least recently used pages above it
+    void set_quota(int idx, long long quota) {
+        quota_assigned += quota - rs_state[idx].quota;
+        rs_state[idx].quota = quota;
+        while (stats[idx].resident > quota) release_frame(job_lru.front(idx));
+    }
+
+    // pff: up to `want` more frames from the unassigned pool; under load
+    // control larger jobs are suspended for them, or this one if it is the largest
+    void grow_quota(int idx, long long want) {
+        while (rs.load_control && num_frames - quota_assigned < want) {
+            int v = suspend_candidate();
+            if (v == -1) break;
+            if (v == idx) { rs_state[idx].suspend_next = true; return; }
+            suspend(v);
+        }
+        long long spare = max(0LL, num_frames - quota_assigned);
+        if (spare > 0) set_quota(idx, rs_state[idx].quota + min(want, spare));
+    }
+
+    // equal shares for the running jobs
+    void rebalance_quotas() {
+        if (rs.scope != ResidentScope::LOCAL && rs.scope != ResidentScope::PFF) return;
+        long long active = 0;
+        for (int i = 0; i < (int)jobs.size(); ++i) active += running(i) && !rs_state[i].suspended;
+        if (active == 0) return;
+        long long share = max(1LL, num_frames / active);
+        for (int i = 0; i < (int)jobs.size(); ++i)
+            if (running(i) && !rs_state[i].suspended) set_quota(i, share);
+    }
+
+    // running job holding the most frames (ws) or quota (pff), skipping `except`
+    int suspend_candidate(int except = -1) const {
+        int best = -1;
+        long long best_size = 0;
+        for (int i = 0; i < (int)jobs.size(); ++i) {
+            if (i == except || rs_state[i].suspended || !running(i)) continue;
+            long long size = rs.scope == ResidentScope::PFF ? rs_state[i].quota : stats[i].resident;
+            if (size > best_size) { best = i; best_size = size; }
+        }
+        return best;
+    }
+
+    // swaps a job out; it remembers how many frames it needs to come back,
+    // `extra` more than it held when it was itself short of frames
+    void suspend(int idx, long long extra = 0) {
+        JobResidentState &s = rs_state[idx];
+        s.demand = max(1LL, (rs.scope == ResidentScope::PFF ? s.quota : stats[idx].resident) + extra);
+        int released = release_job_frames(idx, true);
+        stats[idx].evicted += released;
+        trace(EV_SUSPEND, idx, released, -1);
+        quota_assigned -= s.quota;
+        s.quota = 0;
+        s.suspended = true;
+        s.suspend_next = false;
+        s.resume_at = references + rs.quantum;
+        ++stats[idx].suspensions;
+    }
+
+    // load control before a reference: false while the job stays swapped out.
+    // A suspended job comes back once its demand fits, when its quantum is up
+    // or when nothing else runs
+    bool admit(int idx) {
+        JobResidentState &s = rs_state[idx];
+        if (s.suspend_next && suspend_candidate(idx) != -1) {
+            suspend(idx, 1);
+            return false;
+        }
+        s.suspend_next = false;
+        if (!s.suspended) return true;
+        long long room = rs.scope == ResidentScope::PFF ? num_frames - quota_assigned : free_frames.freeCount();
+        if (room < s.demand && references < s.resume_at && suspend_candidate(idx) != -1) return false;
+        s.suspended = false;
+        trace(EV_RESUME, idx, 0, -1);
+        s.window_start = stats[idx].references;
+        s.window_faults = 0;
+        if (rs.scope == ResidentScope::PFF) set_quota(idx, max(1LL, min(s.demand, room)));
+        return true;
+    }
+};
+
+#endif
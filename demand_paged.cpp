@@ -2,134 +2,161 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
-#include <map>
+#include <memory>
+#include "sim_core.h"
+#include "memory_map.h"
 using namespace std;
 
-struct Page {
-    int pageNumber;
-    int frameNumber;
-};
-
-struct Job {
-    string name;
-    int size;
-    int pageSize;
-    int numPages;
-    vector<Page> pages;
-};
+// pages stay in the frame they were loaded into, a missing page is reported;
+// the TLB is compiled in and switched on from the menu, no counters
+typedef SimCore<NoReplacement, 0, true, false> Core;
 
 class Memory {
-    int totalFrames;
-    int pageSize;
-    vector<int> frames;
-    map<int, string> frameToJob;
+    Core core;
 
 public:
-    Memory(int totalFrames, int pageSize) : totalFrames(totalFrames), pageSize(pageSize) {
-        frames.assign(totalFrames, -1);
+    Memory(int totalFrames, int pageSize, unsigned seed) : core(pageSize, totalFrames, seed, true) {}
+
+    // Create a job and load its pages into memory frames randomly
+    int loadJob(const string &name, long long size) {
+        int idx = core.add_job((int)core.jobs.size(), size, name);
+        Job &job = core.jobs[idx];
+        cout << "Job divided into " << job.num_pages << " pages.\n";
+        for (long long p = 0; p < job.num_pages; p++) {
+            if (core.place_random(idx, p) == -1)
+                cout << "Memory full! Page " << p << " of " << name << " not loaded.\n";
+        }
+        return idx;
     }
 
-    // Load job pages into memory frames randomly
-    void loadJob(Job &job) {
-        srand(time(0));
-        for (auto &page : job.pages) {
-            int frame = rand() % totalFrames;
-            while (frames[frame] != -1) frame = rand() % totalFrames; // find free frame
-            frames[frame] = page.pageNumber;
-            page.frameNumber = frame;
-            frameToJob[frame] = job.name;
-        }
+    // index of the first job with this name, or -1
+    int findJob(const string &name) const {
+        for (size_t i = 0; i < core.jobs.size(); i++)
+            if (core.jobs[i].name == name) return (int)i;
+        return -1;
     }
 
-    // Display memory status
+    // Display memory status, one line per run of frames with one job (see memory_map.h)
     void showMemory() {
-        cout << "\n=== MEMORY FRAMES ===\n";
-        for (int i = 0; i < totalFrames; i++) {
-            if (frames[i] == -1)
-                cout << "Frame " << i << ": [Empty]\n";
+        FrameMap map;
+        map.build(core.mem.frames);
+        ReportWriter out;
+        out.printf("\n=== MEMORY FRAMES ===\n");
+        write_range(out, map, core.mem.frames, 0, core.num_frames - 1, 256, [&](ReportWriter &o, const FrameRun &r) {
+            const char *plural = r.frames() == 1 ? "" : "s";
+            if (r.owner == -1)
+                o.printf("Frame%s %s: [Empty]\n", plural, frame_span(r.first, r.last).c_str());
             else
-                cout << "Frame " << i << ": Page " << frames[i] << " (" << frameToJob[i] << ")\n";
-        }
+                o.printf("Frame%s %s: %s (%s)\n", plural, frame_span(r.first, r.last).c_str(),
+                         run_pages(r).c_str(), core.jobs[r.owner].name.c_str());
+        });
+        write_occupancy(out, map, [&](int owner) { return core.jobs[owner].name; });
     }
 
-    // Perform Address Resolution
-    void addressResolution(Job &job, int logicalAddress) {
-        int pageNumber = logicalAddress / job.pageSize;
-        int offset = logicalAddress % job.pageSize;
+    // Put a TLB in front of the page map lookups
+    void enableTlb(int entries, int ways) {
+        TlbConfig cfg;
+        cfg.entries = entries;
+        cfg.ways = ways;
+        core.enable_tlb(cfg);
+    }
+
+    void showTlbStats() {
+        if (!core.tlb) return;
+        const Tlb &tlb = *core.tlb;
+        const TlbStats &st = tlb.stats;
+        cout << "\n=== TLB ===\n";
+        cout << "Entries: " << tlb.config().entries << " (" << tlb.config().ways << "-way)\n";
+        cout << "Hits: " << st.hits << ", Misses: " << st.misses << ", Hit rate: " << 100.0 * st.hit_rate() << "%\n";
+        cout << "Reach: " << tlb.reach(core.page_size) << " bytes\n";
+        cout << "Effective access time: " << tlb.effective_access_time() << " ns\n";
+    }
 
-        if (pageNumber >= job.numPages) {
+    // Perform Address Resolution
+    void addressResolution(int idx, long long logicalAddress) {
+        const Job &job = core.jobs[idx];
+        if (logicalAddress < 0 || (long long)core.page_of(logicalAddress) >= job.num_pages) {
             cout << "Invalid logical address! (Exceeds job size)\n";
             return;
         }
 
-        int frameNumber = job.pages[pageNumber].frameNumber;
-        int physicalAddress = frameNumber * job.pageSize + offset;
+        CoreAccess a = core.translate(idx, logicalAddress);
+        if (a.frame == -1) {
+            cout << "Page " << a.page << " of " << job.name << " is not loaded in memory.\n";
+            return;
+        }
+        long long physicalAddress = (long long)a.frame * core.page_size + a.offset;
 
         cout << "\nAddress Resolution for Job: " << job.name << endl;
         cout << "Logical Address: " << logicalAddress << endl;
-        cout << "→ Page Number: " << pageNumber << ", Offset: " << offset << endl;
-        cout << "→ Frame Number: " << frameNumber << endl;
+        cout << "→ Page Number: " << a.page << ", Offset: " << a.offset << endl;
+        if (core.tlb) cout << "→ TLB " << (a.tlb_hit ? "hit" : "miss") << endl;
+        cout << "→ Frame Number: " << a.frame << endl;
         cout << "→ Physical Address: " << physicalAddress << endl;
     }
 };
 
-int main() {
+// demand_paged [seed]: a seed makes the random placement repeatable
+int main(int argc, char **argv) {
+    unsigned seed = argc > 1 ? (unsigned)strtoul(argv[1], nullptr, 10) : (unsigned)time(0);
+
     int totalFrames, pageSize, numJobs;
     cout << "Enter total number of memory frames: ";
     cin >> totalFrames;
     cout << "Enter page size (in bytes): ";
     cin >> pageSize;
 
-    Memory memory(totalFrames, pageSize);
+    Memory memory(totalFrames, pageSize, seed);
 
     cout << "Enter number of jobs: ";
     cin >> numJobs;
 
-    vector<Job> jobs(numJobs);
-
     // Accept multiple jobs
     for (int i = 0; i < numJobs; i++) {
+        string name;
+        long long size;
         cout << "\nEnter name of Job " << i + 1 << ": ";
-        cin >> jobs[i].name;
-        cout << "Enter size of Job " << jobs[i].name << " (in bytes): ";
-        cin >> jobs[i].size;
-        jobs[i].pageSize = pageSize;
-        jobs[i].numPages = (jobs[i].size + pageSize - 1) / pageSize;
-
-        cout << "Job divided into " << jobs[i].numPages << " pages.\n";
-
-        for (int p = 0; p < jobs[i].numPages; p++) {
-            Page page;
-            page.pageNumber = p;
-            page.frameNumber = -1;
-            jobs[i].pages.push_back(page);
-        }
+        cin >> name;
+        cout << "Enter size of Job " << name << " (in bytes): ";
+        cin >> size;
 
         // Load pages into memory randomly
-        memory.loadJob(jobs[i]);
+        memory.loadJob(name, size);
     }
 
     memory.showMemory();
 
+    int tlbEntries, tlbWays;
+    cout << "\nEnter TLB entries (0 for no TLB): ";
+    cin >> tlbEntries;
+    if (tlbEntries > 0) {
+        cout << "Enter TLB associativity (ways): ";
+        cin >> tlbWays;
+        memory.enableTlb(tlbEntries, tlbWays);
+    }
+
     // Perform Address Resolution
-    string jobName;
-    cout << "\nEnter job name for address resolution: ";
-    cin >> jobName;
-
-    bool found = false;
-    for (auto &job : jobs) {
-        if (job.name == jobName) {
-            int logicalAddress;
+    char again = 'y';
+    while (again == 'y' || again == 'Y') {
+        string jobName;
+        cout << "\nEnter job name for address resolution: ";
+        cin >> jobName;
+
+        int idx = memory.findJob(jobName);
+        if (idx != -1) {
+            long long logicalAddress;
             cout << "Enter logical address: ";
             cin >> logicalAddress;
-            memory.addressResolution(job, logicalAddress);
-            found = true;
-            break;
+            memory.addressResolution(idx, logicalAddress);
+        } else {
+            cout << "Job not found!\n";
         }
+
+        cout << "\nResolve another address? (y/n): ";
+        if (!(cin >> again)) break;
     }
 
-    if (!found)
-        cout << "Job not found!\n";
+    memory.showTlbStats();
 
     return 0;
 }
@@ -0,0 +1,198 @@
+// event_export.cpp
+// Compile: g++ -O2 -pthread event_export.cpp -o event_export
+//
+// Turns an event file written by paged_memory --events (event_log.h) into
+// Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open as a
+// timeline:
+//   - every run (a policy of --replay, a thread count of --concurrent) is a
+//     process, every job a thread track inside it
+//   - a job's lifetime is a slice on its track, from its start to its end or
+//     to the end of the run
+//   - faults, evictions (on the track of the job that lost the page),
+//     allocations, read-ahead loads, suspensions, copy-on-write copies and
+//     shared mappings are instant events, up to --limit of them (default
+//     1000000); the rest only go into the counters
+//   - "faults", "evictions" and "prefetches" counters per run, summed over
+//     --buckets equal windows of the run (default 1000), show bursts and
+//     thrashing however many instant events were kept
+//
+//   event_export <in.vme> <out.json> [--clock wall|refs] [--limit N] [--buckets N]
+//
+// --clock wall (default) places events at their measured time, which the
+// event file resolves to EventRing::CLOCK_REFS references; --clock refs at
+// their simulated time, one reference per microsecond (in concurrent runs
+// each job counts its own references).
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "event_log.h"
+
+using namespace std;
+
+struct RunInfo {
+    string label;
+    double first = -1, last = 0;  // timestamps (us)
+    vector<int> job_ids;          // by job index, from EV_JOB_START
+    vector<char> open;            // job slice begun and not yet ended
+    vector<long long> faults, evictions, prefetches; // per bucket
+    double bucket_us = 1;
+
+    int job_id(int idx) const { return idx < (int)job_ids.size() && job_ids[idx] != -1 ? job_ids[idx] : idx; }
+};
+
+static string json_escape(const string &s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out;
+}
+
+int main(int argc, char **argv) {
+    bool ok = argc >= 3;
+    bool wall = true;
+    long long limit = 1000000, buckets = 1000;
+    for (int i = 3; ok && i + 1 < argc; i += 2) {
+        string opt = argv[i], val = argv[i+1];
+        if (opt == "--clock" && (val == "wall" || val == "refs")) wall = val == "wall";
+        else if (opt == "--limit") limit = atoll(val.c_str());
+        else if (opt == "--buckets") buckets = atoll(val.c_str());
+        else ok = false;
+    }
+    if (!ok || argc % 2 == 0 || buckets <= 0 || limit < 0) {
+        cerr << "Usage: " << argv[0] << " <in.vme> <out.json> [--clock wall|refs] [--limit N] [--buckets N]\n";
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    EventLogReader reader(argv[1]);
+    if (!reader.is_open()) { cerr << "Error: " << argv[1] << " is not an event file" << endl; return 1; }
+    const EventHeader &h = reader.info();
+    auto ts = [&](const Event &r) {
+        return wall ? (double)(r.tick - h.start_tick) * h.ns_per_tick / 1000.0 : (double)r.ref;
+    };
+
+    // first pass: the runs, their spans and their jobs
+    vector<RunInfo> runs(reader.labels().size());
+    for (size_t k = 0; k < runs.size(); ++k) runs[k].label = reader.labels()[k];
+    vector<int> run_of(h.threads, -1); // current run of each thread
+    auto run_at = [&](int thread, const Event &r) -> RunInfo * {
+        if (thread >= (int)run_of.size()) run_of.resize(thread + 1, -1);
+        if (r.type() == EV_RUN) {
+            run_of[thread] = (int)r.page;
+            if (r.page >= (long long)runs.size()) runs.resize(r.page + 1);
+        }
+        return run_of[thread] < 0 ? nullptr : &runs[run_of[thread]];
+    };
+    bool complete = reader.for_each([&](int thread, const Event &r) {
+        RunInfo *run = run_at(thread, r);
+        if (!run) return;
+        double t = ts(r);
+        if (run->first < 0 || t < run->first) run->first = t;
+        if (t > run->last) run->last = t;
+        if (r.type() == EV_JOB_START) {
+            if (r.job() >= (int)run->job_ids.size()) run->job_ids.resize(r.job() + 1, -1);
+            run->job_ids[r.job()] = (int)r.page;
+        }
+    });
+    if (!complete) cerr << "Warning: " << argv[1] << " is truncated; exporting the complete chunks.\n";
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) { cerr << "Error: Could not create file " << argv[2] << endl; return 1; }
+    static char buf[1 << 20];
+    setvbuf(out, buf, _IOFBF, sizeof(buf));
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"clock\":\"%s\",\"records\":%llu,\"drain_waits\":%llu},\n"
+                 "\"traceEvents\":[\n", wall ? "wall" : "refs", (unsigned long long)h.record_count,
+            (unsigned long long)h.stalls);
+    bool first_event = true;
+    auto sep = [&]() { if (!first_event) fputs(",\n", out); first_event = false; };
+
+    for (size_t k = 0; k < runs.size(); ++k) {
+        RunInfo &run = runs[k];
+        if (run.first < 0) continue;
+        string label = run.label.empty() ? "run " + to_string(k + 1) : run.label;
+        sep();
+        fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%zu,\"args\":{\"name\":\"%s\"}}", k + 1,
+                json_escape(label).c_str());
+        for (size_t j = 0; j < run.job_ids.size(); ++j) {
+            sep();
+            fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%zu,\"tid\":%d,\"args\":{\"name\":\"job %d\"}}",
+                    k + 1, run.job_id((int)j), run.job_id((int)j));
+        }
+        run.bucket_us = max(1e-3, (run.last - run.first) / (double)buckets);
+        run.faults.assign(buckets, 0);
+        run.evictions.assign(buckets, 0);
+        run.prefetches.assign(buckets, 0);
+        run.open.assign(run.job_ids.size(), 0);
+    }
+
+    // second pass: slices, instants and the counter buckets
+    long long instants = 0, dropped = 0;
+    run_of.assign(run_of.size(), -1);
+    reader.for_each([&](int thread, const Event &r) {
+        RunInfo *run = run_at(thread, r);
+        if (!run || r.type() == EV_RUN) return;
+        size_t pid = run - runs.data() + 1;
+        double t = ts(r);
+        int job = r.job(), tid = run->job_id(job);
+        long long b = min(buckets - 1, (long long)((t - run->first) / run->bucket_us));
+        switch (r.type()) {
+        case EV_JOB_START:
+            if (job < (int)run->open.size()) run->open[job] = 1;
+            sep();
+            fprintf(out, "{\"ph\":\"B\",\"name\":\"job %d\",\"pid\":%zu,\"tid\":%d,\"ts\":%.3f}", tid, pid, tid, t);
+            return;
+        case EV_JOB_END:
+            if (job >= (int)run->open.size() || !run->open[job]) return;
+            run->open[job] = 0;
+            sep();
+            fprintf(out, "{\"ph\":\"E\",\"pid\":%zu,\"tid\":%d,\"ts\":%.3f}", pid, tid, t);
+            return;
+        case EV_FAULT: ++run->faults[b]; break;
+        case EV_EVICT: ++run->evictions[b]; break;
+        case EV_PREFETCH: ++run->prefetches[b]; break;
+        }
+        if (instants >= limit) { ++dropped; return; }
+        ++instants;
+        sep();
+        fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s%s\",\"pid\":%zu,\"tid\":%d,\"ts\":%.3f,"
+                     "\"args\":{\"page\":%lld,\"frame\":%d,\"ref\":%llu}}",
+                event_type_name(r.type()), r.dirty() ? " dirty" : "", pid, tid, t, (long long)r.page, r.frame,
+                (unsigned long long)r.ref);
+    });
+
+    long long samples = 0;
+    for (size_t k = 0; k < runs.size(); ++k) {
+        RunInfo &run = runs[k];
+        if (run.first < 0) continue;
+        for (size_t j = 0; j < run.open.size(); ++j) {
+            if (!run.open[j]) continue;
+            sep();
+            fprintf(out, "{\"ph\":\"E\",\"pid\":%zu,\"tid\":%d,\"ts\":%.3f}", k + 1, run.job_id((int)j), run.last);
+        }
+        for (long long b = 0; b < buckets; ++b) {
+            double t = run.first + b * run.bucket_us;
+            sep();
+            fprintf(out, "{\"ph\":\"C\",\"name\":\"faults\",\"pid\":%zu,\"ts\":%.3f,\"args\":{\"faults\":%lld}},\n", k + 1, t,
+                    run.faults[b]);
+            fprintf(out, "{\"ph\":\"C\",\"name\":\"evictions\",\"pid\":%zu,\"ts\":%.3f,\"args\":{\"evictions\":%lld}},\n", k + 1,
+                    t, run.evictions[b]);
+            fprintf(out, "{\"ph\":\"C\",\"name\":\"prefetches\",\"pid\":%zu,\"ts\":%.3f,\"args\":{\"prefetches\":%lld}}", k + 1,
+                    t, run.prefetches[b]);
+            samples += 3;
+        }
+    }
+    fputs("\n]}\n", out);
+    fclose(out);
+
+    cout << "Wrote " << instants << " events and " << samples << " counter samples for " << runs.size() << " run(s) to "
+         << argv[2];
+    if (dropped) cout << " (" << dropped << " more events only in the counters; raise --limit to keep them)";
+    cout << ".\nTook " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s.\n";
+    return 0;
+}
@@ -0,0 +1,407 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+// event_log.h
+// Timestamped event trace of a simulation run (paged_memory --events), for
+// seeing when faults and evictions cluster rather than only how many there
+// were.
+//
+// Each simulating thread appends to its own EventRing, a preallocated
+// single-producer/single-consumer ring of 16-byte records. emit() fills one
+// slot and publishes it with a release store of the head: no lock, no
+// allocation, no clock reading. Time is sampled instead: the first event
+// after CLOCK_REFS simulated references (or after new_batch(), which the
+// concurrent workers call when they switch jobs) writes an EV_CLOCK record
+// with the cycle counter and the reference count, and the records that
+// follow store only their reference count relative to it. An event's
+// timestamp is that of the clock record before it, so the wall-time
+// resolution is CLOCK_REFS references; the reference count is exact.
+// A background thread of the EventLog drains every ring into the file in
+// large writes. A thread whose ring is full waits for the drain (counted as a
+// stall) instead of dropping events.
+//
+// File (".vme"), little-endian: a 64-byte header
+//   char     magic[8]      "VMEVENT2"
+//   uint32   record_size   sizeof(EventRecord)
+//   uint32   threads       rings that were used
+//   uint64   record_count  clock records included
+//   double   ns_per_tick   timestamp unit, calibrated against steady_clock
+//   uint64   start_tick    timestamp when the log was opened
+//   uint64   stalls        emits that had to wait for the drain
+//   uint64   labels_offset file offset of the run labels, 0 if none
+//   uint64   reserved
+// then chunks of { uint32 thread, uint32 count, count records } in drain
+// order (the records of one thread stay in order, so a record's clock record
+// is the last one of its thread before it), and at labels_offset the run
+// labels, one per line. event_export turns the file into Chrome trace
+// (Perfetto) JSON.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define VM_HAVE_RDTSC 1
+#endif
+
+using namespace std;
+
+enum EventType : uint8_t {
+    EV_RUN = 0,       // page = run number (a label in the file); later events of the thread belong to it
+    EV_JOB_START = 1, // page = job id; job is the index the other events use
+    EV_JOB_END = 2,
+    EV_ALLOC = 3,     // a free frame was given to (job, page)
+    EV_FAULT = 4,     // (job, page) faulted; frame holds it afterwards
+    EV_EVICT = 5,     // (job, page) lost frame; EV_DIRTY if it was written back
+    EV_PREFETCH = 6,  // (job, page) read ahead into frame
+    EV_SUSPEND = 7,   // load control swapped the job out; page = frames released
+    EV_RESUME = 8,
+    EV_COW = 9,       // (job, page) wrote a shared page and got its own copy in frame
+    EV_SHARE = 10,    // (job, page) mapped frame, which another job of its shared region holds
+    EV_TYPES = 11,
+    EV_CLOCK = 12,    // not an event: the timestamp of the records after it (see EventRecord)
+};
+const uint8_t EV_DIRTY = 0x80;
+
+inline const char *event_type_name(int type) {
+    static const char *names[EV_TYPES] = {"run", "job", "job end", "alloc", "fault", "evict", "prefetch", "suspend", "resume", "cow", "share"};
+    return type >= 0 && type < EV_TYPES ? names[type] : "?";
+}
+
+// cycle counter on x86-64, steady_clock nanoseconds elsewhere
+inline uint64_t event_clock() {
+#ifdef VM_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// one record as stored. An event packs (job, page) into job_page and its
+// reference count, less that of the thread's last clock record, into the top
+// 24 bits of delta_type. An EV_CLOCK record holds the tick in job_page and
+// the reference count in frame (low 32 bits) and delta_type (high 24 bits).
+struct EventRecord {
+    uint64_t job_page;    // job index << 40 | page
+    int32_t frame;        // -1 if none
+    uint32_t delta_type;  // ref delta << 8 | type (| EV_DIRTY)
+
+    int type() const { return delta_type & 0x7f; }
+    bool clock() const { return type() == EV_CLOCK; }
+};
+
+// an event as the reader hands it out, with its clock reading and reference
+// count restored
+struct Event {
+    uint64_t tick;      // event_clock() of the clock record before it
+    uint64_t ref;       // simulated time: references of the engine (of the job in concurrent mode)
+    int64_t page;
+    int32_t frame;      // -1 if none
+    uint32_t job_type;  // job index << 8 | type (| EV_DIRTY)
+
+    int type() const { return job_type & 0x7f; }
+    bool dirty() const { return (job_type & EV_DIRTY) != 0; }
+    int job() const { return (int)(job_type >> 8); }
+};
+
+const char EVENT_MAGIC[8] = {'V', 'M', 'E', 'V', 'E', 'N', 'T', '2'};
+
+struct EventHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t threads;
+    uint64_t record_count;
+    double ns_per_tick;
+    uint64_t start_tick;
+    uint64_t stalls;
+    uint64_t labels_offset;
+    uint64_t reserved;
+};
+
+struct EventChunk {
+    uint32_t thread;
+    uint32_t count;
+};
+
+class EventRing {
+    friend class EventLog;
+
+    vector<EventRecord> slots;      // capacity is a power of two
+    uint64_t mask;
+    alignas(64) atomic<uint64_t> head{0}; // next slot the producer fills
+    uint64_t cached_tail = 0;             // producer's last view of tail
+    uint64_t clock_ref = 0;               // reference count of the last clock record
+    bool clock_due = true;                // the next event writes a clock record
+    long long stalls = 0;
+    alignas(64) atomic<uint64_t> tail{0}; // next slot the drain reads
+
+    // the slot at head, once the drain has freed it
+    EventRecord &claim(uint64_t h) {
+        if (h - cached_tail > mask) {
+            cached_tail = tail.load(memory_order_acquire);
+            if (h - cached_tail > mask) {
+                ++stalls;
+                do {
+                    this_thread::yield();
+                    cached_tail = tail.load(memory_order_acquire);
+                } while (h - cached_tail > mask);
+            }
+        }
+        return slots[h & mask];
+    }
+
+public:
+    static const uint64_t CLOCK_REFS = 1024; // references per clock reading, below 2^24
+
+    explicit EventRing(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    // the next event reads the clock again, e.g. because the caller moves on
+    // to a job whose references are counted separately
+    void new_batch() { clock_due = true; }
+
+    // job is an index below 2^24 (FrameTable::MAX_OWNER), page below 2^40
+    // (FrameTable::MAX_PAGE)
+    void emit(int type, int job, long long page, int frame, long long ref) {
+        uint64_t h = head.load(memory_order_relaxed);
+        uint64_t delta = (uint64_t)ref - clock_ref; // huge if ref went back
+        if (clock_due || delta >= CLOCK_REFS) {
+            EventRecord &c = claim(h);
+            c.job_page = event_clock();
+            c.frame = (int32_t)(uint32_t)ref;
+            c.delta_type = (uint32_t)((uint64_t)ref >> 32) << 8 | EV_CLOCK;
+            head.store(++h, memory_order_release);
+            clock_ref = (uint64_t)ref;
+            clock_due = false;
+            delta = 0;
+        }
+        EventRecord &e = claim(h);
+        e.job_page = (uint64_t)job << 40 | ((uint64_t)page & ((1ULL << 40) - 1));
+        e.frame = frame;
+        e.delta_type = (uint32_t)delta << 8 | (uint32_t)type;
+        head.store(h + 1, memory_order_release);
+    }
+};
+
+class EventLog {
+    FILE *file = nullptr;
+    vector<unique_ptr<EventRing>> rings;
+    mutex rings_m;               // rings grows while the drain runs
+    vector<string> labels;
+    size_t capacity;
+    uint64_t count = 0;
+    uint64_t start_tick = 0;
+    chrono::steady_clock::time_point start_time;
+    thread drainer;
+    atomic<bool> stop{false};
+
+    // moves everything published so far to the file; returns the records moved
+    uint64_t drain_once() {
+        lock_guard<mutex> lock(rings_m);
+        uint64_t moved = 0;
+        for (size_t t = 0; t < rings.size(); ++t) {
+            EventRing &r = *rings[t];
+            uint64_t tail = r.tail.load(memory_order_relaxed);
+            uint64_t head = r.head.load(memory_order_acquire);
+            while (tail != head) {
+                uint64_t at = tail & r.mask;
+                uint64_t n = min(head - tail, r.mask + 1 - at);
+                n = min<uint64_t>(n, UINT32_MAX);
+                EventChunk c = {(uint32_t)t, (uint32_t)n};
+                fwrite(&c, sizeof(c), 1, file);
+                fwrite(&r.slots[at], sizeof(EventRecord), n, file);
+                tail += n;
+                moved += n;
+                r.tail.store(tail, memory_order_release);
+            }
+        }
+        count += moved;
+        return moved;
+    }
+
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 18; // records per ring (4 MB)
+
+    explicit EventLog(size_t capacity_ = DEFAULT_CAPACITY) : capacity(1) {
+        while (capacity < capacity_) capacity <<= 1;
+    }
+    ~EventLog() { close(); }
+    EventLog(const EventLog &) = delete;
+    EventLog &operator=(const EventLog &) = delete;
+
+    // creates the file and starts the drain; false if it cannot be written
+    bool open(const string &filename) {
+        file = fopen(filename.c_str(), "wb");
+        if (!file) return false;
+        setvbuf(file, nullptr, _IOFBF, 1 << 22);
+        EventHeader h = {};
+        fwrite(&h, sizeof(h), 1, file); // placeholder until close()
+        start_time = chrono::steady_clock::now();
+        start_tick = event_clock();
+        stop = false;
+        drainer = thread([this]() {
+            while (!stop.load(memory_order_acquire))
+                if (drain_once() == 0) this_thread::sleep_for(chrono::microseconds(200));
+        });
+        return true;
+    }
+
+    bool is_open() const { return file != nullptr; }
+
+    // the ring of simulating thread t, created on first use; each ring has
+    // exactly one thread emitting into it at a time
+    EventRing *ring(int t) {
+        lock_guard<mutex> lock(rings_m);
+        while ((int)rings.size() <= t) rings.emplace_back(new EventRing(capacity));
+        return rings[t].get();
+    }
+
+    // number of a new labelled run; an EV_RUN event with it on a ring makes
+    // the events that follow there part of the run
+    int new_run(const string &label) {
+        labels.push_back(label);
+        return (int)labels.size() - 1;
+    }
+
+    // starts a run that has only this ring
+    void begin_run(EventRing *r, const string &label, long long ref = 0) {
+        r->emit(EV_RUN, 0, new_run(label), -1, ref);
+    }
+
+    uint64_t records() const { return count; }
+
+    long long stalls() {
+        lock_guard<mutex> lock(rings_m);
+        long long n = 0;
+        for (auto &r : rings) n += r->stalls;
+        return n;
+    }
+
+    // drains what is left, writes the labels and the header; every emitting
+    // thread must have stopped
+    void close() {
+        if (!file) return;
+        stop = true;
+        drainer.join();
+        drain_once();
+        uint64_t end_tick = event_clock();
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start_time).count();
+
+        EventHeader h = {};
+        memcpy(h.magic, EVENT_MAGIC, sizeof(h.magic));
+        h.record_size = sizeof(EventRecord);
+        h.threads = (uint32_t)rings.size();
+        h.record_count = count;
+        h.ns_per_tick = end_tick > start_tick ? ns / (double)(end_tick - start_tick) : 1.0;
+        h.start_tick = start_tick;
+        h.stalls = (uint64_t)stalls();
+        if (!labels.empty()) {
+            fflush(file);
+            h.labels_offset = (uint64_t)ftell(file);
+            for (const string &l : labels) fprintf(file, "%s\n", l.c_str());
+        }
+        fseek(file, 0, SEEK_SET);
+        fwrite(&h, sizeof(h), 1, file);
+        fclose(file);
+        file = nullptr;
+    }
+};
+
+// memory-maps an event file and walks its chunks in place
+class EventLogReader {
+    const unsigned char *base = nullptr;
+    size_t size = 0;
+    EventHeader header = {};
+    vector<string> run_labels;
+
+public:
+    explicit EventLogReader(const string &filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(EventHeader)) {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                base = (const unsigned char *)p;
+                size = (size_t)st.st_size;
+                madvise(p, size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (!base) return;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, EVENT_MAGIC, sizeof(header.magic)) != 0 || header.record_size != sizeof(EventRecord) ||
+            header.labels_offset > size) {
+            munmap((void *)base, size);
+            base = nullptr;
+            return;
+        }
+        if (header.labels_offset) {
+            string text((const char *)base + header.labels_offset, size - header.labels_offset);
+            size_t at = 0, nl;
+            while ((nl = text.find('\n', at)) != string::npos) {
+                run_labels.push_back(text.substr(at, nl - at));
+                at = nl + 1;
+            }
+        }
+    }
+    ~EventLogReader() { if (base) munmap((void *)base, size); }
+    EventLogReader(const EventLogReader &) = delete;
+    EventLogReader &operator=(const EventLogReader &) = delete;
+
+    bool is_open() const { return base != nullptr; }
+    const EventHeader &info() const { return header; }
+    const vector<string> &labels() const { return run_labels; }
+
+    // f(thread, event) for every event, in file order; false if the file
+    // ends inside a chunk or an event comes before its thread's first clock
+    // record
+    template <class F>
+    bool for_each(F f) const {
+        struct Clock { uint64_t tick = 0, ref = 0; bool seen = false; };
+        vector<Clock> clocks(header.threads);
+        size_t end = header.labels_offset ? (size_t)header.labels_offset : size;
+        size_t at = sizeof(EventHeader);
+        while (at + sizeof(EventChunk) <= end) {
+            EventChunk c;
+            memcpy(&c, base + at, sizeof(c));
+            at += sizeof(c);
+            if (at + (size_t)c.count * sizeof(EventRecord) > end) return false;
+            if (c.thread >= clocks.size()) clocks.resize(c.thread + 1);
+            Clock &clk = clocks[c.thread];
+            const EventRecord *r = (const EventRecord *)(base + at);
+            for (uint32_t i = 0; i < c.count; ++i) {
+                if (r[i].clock()) {
+                    clk.tick = r[i].job_page;
+                    clk.ref = (uint64_t)(r[i].delta_type >> 8) << 32 | (uint32_t)r[i].frame;
+                    clk.seen = true;
+                    continue;
+                }
+                if (!clk.seen) return false;
+                Event e;
+                e.tick = clk.tick;
+                e.ref = clk.ref + (r[i].delta_type >> 8);
+                e.page = (int64_t)(r[i].job_page & ((1ULL << 40) - 1));
+                e.frame = r[i].frame;
+                e.job_type = (uint32_t)(r[i].job_page >> 40) << 8 | (r[i].delta_type & 0xff);
+                f((int)c.thread, e);
+            }
+            at += (size_t)c.count * sizeof(EventRecord);
+        }
+        return at == end;
+    }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef FRAME_ALLOCATOR_H
+#define FRAME_ALLOCATOR_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+/*
+ * free-frame manager shared by the simulators
+ * keeps two views of the free frames, both updated in O(1) per allocate/release:
+ *  - a hierarchical bitmap (bit set = frame free, upper levels mark words that
+ *    still have a free bit) searched with count-trailing-zeros for "first free"
+ *  - a dense array of the free frame numbers plus each frame's position in it,
+ *    so a uniformly random free frame is one index away
+ * callers that never place randomly can drop the second view
+ * (randomPlacement = false); allocateFirstN then hands out a whole bitmap word
+ * of frames per step
+ */
+class FreeFrameAllocator {
+    int numFrames = 0;
+    int numFree = 0;
+    bool randomPlacement = true;
+    vector<vector<uint64_t>> levels; // levels[0] = one bit per frame, back() = single root word
+    vector<int> freeList;            // free frame numbers, unordered (random placement only)
+    vector<int> freePos;             // frame -> index in freeList, -1 if allocated
+
+    static int lowestBit(uint64_t w) { return __builtin_ctzll(w); }
+
+    // clears bits in a parent level after level[depth] word idx became empty
+    void propagateEmpty(size_t depth, size_t idx) {
+        for (size_t l = depth + 1; l < levels.size(); ++l) {
+            uint64_t &word = levels[l][idx >> 6];
+            word &= ~(1ULL << (idx & 63));
+            if (word != 0) return;
+            idx >>= 6;
+        }
+    }
+
+    void clearBit(int frame) {
+        size_t idx = (size_t)frame;
+        uint64_t &word = levels[0][idx >> 6];
+        word &= ~(1ULL << (idx & 63));
+        if (word == 0) propagateEmpty(0, idx >> 6); // parents unchanged while the word has free bits
+    }
+
+    void setBit(int frame) {
+        size_t idx = (size_t)frame;
+        for (auto &level : levels) {
+            uint64_t &word = level[idx >> 6];
+            bool wasEmpty = (word == 0);
+            word |= 1ULL << (idx & 63);
+            if (!wasEmpty) return;    // parents already mark this word as non-empty
+            idx >>= 6;
+        }
+    }
+
+    void unlist(int frame) {
+        int i = freePos[frame];
+        int last = freeList.back();
+        freeList[i] = last;
+        freePos[last] = i;
+        freeList.pop_back();
+        freePos[frame] = -1;
+    }
+
+    void take(int frame) {
+        if (randomPlacement) unlist(frame);
+        clearBit(frame);
+        --numFree;
+    }
+
+    // index of the first level-0 word with a free frame (numFree must be > 0)
+    size_t firstFreeWord() const {
+        size_t idx = 0;
+        for (size_t l = levels.size(); l-- > 1;)
+            idx = (idx << 6) | (size_t)lowestBit(levels[l][idx]);
+        return idx;
+    }
+
+public:
+    explicit FreeFrameAllocator(int frames = 0, bool randomPlacement_ = true) : randomPlacement(randomPlacement_) {
+        reset(frames);
+    }
+
+    // marks every frame in [0, frames) as free, or as in use with allFree = false
+    void reset(int frames, bool allFree = true) {
+        numFrames = frames < 0 ? 0 : frames;
+        numFree = allFree ? numFrames : 0;
+        levels.clear();
+        size_t bits = (size_t)numFrames;
+        do {
+            size_t words = (bits + 63) / 64;
+            if (words == 0) words = 1;
+            vector<uint64_t> level(words, allFree ? ~0ULL : 0);
+            if (allFree && bits % 64) level.back() = (1ULL << (bits % 64)) - 1;
+            if (bits == 0) level.back() = 0;
+            levels.push_back(move(level));
+            bits = words;
+        } while (levels.back().size() > 1);
+
+        freeList.clear();
+        freePos.clear();
+        if (!randomPlacement) return;
+        freePos.assign(numFrames, -1);
+        if (!allFree) return;
+        freeList.resize(numFrames);
+        for (int i = 0; i < numFrames; ++i) {
+            freeList[i] = i;
+            freePos[i] = i;
+        }
+    }
+
+    int capacity() const { return numFrames; }
+    int freeCount() const { return numFree; }
+    int usedCount() const { return numFrames - numFree; }
+    bool isFree(int frame) const { return (levels[0][(size_t)frame >> 6] >> (frame & 63)) & 1; }
+
+    // lowest-numbered free frame, or -1 if memory is full
+    int allocateFirst() {
+        if (numFree == 0) return -1;
+        size_t w = firstFreeWord();
+        int frame = (int)((w << 6) | (size_t)lowestBit(levels[0][w]));
+        take(frame);
+        return frame;
+    }
+
+    // the n lowest-numbered free frames (fewer if memory runs out), written to
+    // out in ascending order; returns how many were allocated
+    int allocateFirstN(int n, int *out) {
+        int got = 0;
+        while (got < n && numFree > 0) {
+            size_t w = firstFreeWord();
+            uint64_t &word = levels[0][w];
+            while (word && got < n) {
+                int frame = (int)((w << 6) | (size_t)lowestBit(word));
+                word &= word - 1;
+                if (randomPlacement) unlist(frame);
+                out[got++] = frame;
+                --numFree;
+            }
+            if (word == 0) propagateEmpty(0, w);
+        }
+        return got;
+    }
+
+    // the n-th entry of the free array (0 <= n < freeCount()); with a uniform n
+    // this is a uniformly random free frame (random placement only)
+    int allocateNth(int n) {
+        if (!randomPlacement || n < 0 || n >= (int)freeList.size()) return -1;
+        int frame = freeList[n];
+        take(frame);
+        return frame;
+    }
+
+    // uniformly random free frame, or -1 if memory is full
+    template <class Rng>
+    int allocateRandom(Rng &rng) {
+        if (!randomPlacement || freeList.empty()) return -1;
+        uniform_int_distribution<int> dist(0, (int)freeList.size() - 1);
+        return allocateNth(dist(rng));
+    }
+
+    // claims a specific frame; returns false if it was already in use
+    bool allocate(int frame) {
+        if (frame < 0 || frame >= numFrames || !isFree(frame)) return false;
+        take(frame);
+        return true;
+    }
+
+    void checkpoint(CheckpointArchive &ar) {
+        ar.section("freemap");
+        ar.io(numFrames);
+        ar.io(numFree);
+        ar.io(randomPlacement);
+        ar.io(levels);
+        ar.io(freeList);
+        ar.io(freePos);
+        if (ar.loading() && !consistent()) ar.fail();
+    }
+
+    // the bitmap levels, the free count and the free array agree (a restored
+    // map is checked before any frame number is taken from it)
+    bool consistent() const {
+        if (numFrames < 0 || numFree < 0 || numFree > numFrames) return false;
+        FreeFrameAllocator shape(numFrames, false);
+        if (levels.size() != shape.levels.size()) return false;
+        for (size_t l = 0; l < levels.size(); ++l) if (levels[l].size() != shape.levels[l].size()) return false;
+        long long free_bits = 0;
+        for (size_t w = 0; w < levels[0].size(); ++w) {
+            uint64_t word = levels[0][w];
+            if (w + 1 == levels[0].size() && numFrames % 64) word &= (1ULL << (numFrames % 64)) - 1;
+            if (word != levels[0][w]) return false; // a bit past the last frame
+            free_bits += __builtin_popcountll(word);
+        }
+        if (free_bits != numFree) return false;
+        for (size_t l = 1; l < levels.size(); ++l)
+            for (size_t i = 0; i < levels[l-1].size(); ++i)
+                if (((levels[l][i >> 6] >> (i & 63)) & 1) != (levels[l-1][i] != 0)) return false;
+        if (!randomPlacement) return freeList.empty() && freePos.empty();
+        if ((int)freePos.size() != numFrames || (int)freeList.size() != numFree) return false;
+        for (size_t i = 0; i < freeList.size(); ++i) {
+            int f = freeList[i];
+            if (f < 0 || f >= numFrames || freePos[f] != (int)i || !isFree(f)) return false;
+        }
+        return true;
+    }
+
+    // returns a frame to the free pool (no-op if it is already free)
+    void release(int frame) {
+        if (frame < 0 || frame >= numFrames || isFree(frame)) return;
+        if (randomPlacement) {
+            freePos[frame] = (int)freeList.size();
+            freeList.push_back(frame);
+        }
+        setBit(frame);
+        ++numFree;
+    }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef FRAME_TABLE_H
+#define FRAME_TABLE_H
+
+// frame_table.h
+// Compact frame table shared by the simulators. Job names are interned once
+// in a JobTable (jobs that come and go give their id back); a frame then only
+// records the owner's small integer id.
+// The table is kept as two parallel arrays (structure of arrays):
+//   mapping[f]  64 bits: owner id in the top 24 bits, page number in the low 40
+//   flags[f]     8 bits: FRAME_USED, FRAME_REFERENCED, FRAME_DIRTY, FRAME_PREFETCHED,
+//                FRAME_COW
+// so a million frames take 9 MB and a scan over the status bits touches one
+// byte per frame.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+const uint8_t FRAME_USED = 1;
+const uint8_t FRAME_REFERENCED = 2;
+const uint8_t FRAME_DIRTY = 4;
+const uint8_t FRAME_PREFETCHED = 8; // read ahead and not referenced yet
+const uint8_t FRAME_COW = 16;       // may be shared; copied before a write (shared_pages.h)
+
+// largest owner id the 24-bit owner field of a frame can hold
+const int MAX_FRAME_OWNER = (1 << 24) - 1;
+
+// interns job names to dense ids 0, 1, 2, ...
+class JobTable {
+    vector<string> names;
+    vector<int> holders;   // acquire() calls not yet released, per id
+    vector<int> free_ids;  // released ids, handed out again first
+    unordered_map<string, int> ids;
+public:
+    // -1 once every id a frame can record is taken
+    int intern(const string &name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        int id;
+        if (!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+            names[id] = name;
+        } else {
+            if ((int)names.size() > MAX_FRAME_OWNER) return -1;
+            id = (int)names.size();
+            names.push_back(name);
+            holders.push_back(0);
+        }
+        ids.emplace(name, id);
+        return id;
+    }
+    // intern for a job that will give the id back with release(), so a
+    // stream of short-lived jobs only needs as many ids as are alive at once
+    int acquire(const string &name) {
+        int id = intern(name);
+        if (id != -1) ++holders[id];
+        return id;
+    }
+    // drops one acquire(); the last one forgets the name and frees the id,
+    // so no frame may record it any more
+    void release(int id) {
+        if (id < 0 || id >= (int)names.size() || holders[id] == 0 || --holders[id] > 0) return;
+        ids.erase(names[id]);
+        names[id].clear();
+        free_ids.push_back(id);
+    }
+    int find(const string &name) const {
+        auto it = ids.find(name);
+        return it == ids.end() ? -1 : it->second;
+    }
+    const string &name(int id) const { return names[id]; }
+    int size() const { return (int)names.size(); }
+};
+
+class FrameTable {
+    static const int PAGE_BITS = 40;
+    static const uint64_t PAGE_MASK = (1ULL << PAGE_BITS) - 1;
+    vector<uint64_t> mapping;
+    vector<uint8_t> flag_bits;
+
+public:
+    static const int MAX_OWNER = MAX_FRAME_OWNER;
+    static const long long MAX_PAGE = (long long)PAGE_MASK;
+
+    // fits the packed mapping word; anything else would alias another owner's frames
+    static bool valid_owner(int owner_id) { return owner_id >= 0 && owner_id <= MAX_OWNER; }
+    static bool valid_entry(int owner_id, long long page_no) {
+        return valid_owner(owner_id) && page_no >= 0 && page_no <= MAX_PAGE;
+    }
+
+    explicit FrameTable(int frames = 0) { reset(frames); }
+
+    // every frame free
+    void reset(int frames) {
+        mapping.assign(frames < 0 ? 0 : frames, ~0ULL);
+        flag_bits.assign(frames < 0 ? 0 : frames, 0);
+    }
+
+    int size() const { return (int)mapping.size(); }
+    bool used(int f) const { return (flag_bits[f] & FRAME_USED) != 0; }
+    int owner(int f) const { return used(f) ? (int)(mapping[f] >> PAGE_BITS) : -1; }
+    long long page(int f) const { return used(f) ? (long long)(mapping[f] & PAGE_MASK) : -1; }
+
+    // hands a free (or just-evicted) frame to (owner, page); status bits restart clean
+    // false (frame untouched) if the owner or page does not fit the mapping word
+    bool assign(int f, int owner_id, long long page_no) {
+        if (!valid_entry(owner_id, page_no)) return false;
+        mapping[f] = ((uint64_t)owner_id << PAGE_BITS) | ((uint64_t)page_no & PAGE_MASK);
+        flag_bits[f] = FRAME_USED;
+        return true;
+    }
+
+    // hands a used frame to another (owner, page) that already maps it;
+    // status bits stay; false (frame untouched) as for assign
+    bool remap(int f, int owner_id, long long page_no) {
+        if (!valid_entry(owner_id, page_no)) return false;
+        mapping[f] = ((uint64_t)owner_id << PAGE_BITS) | ((uint64_t)page_no & PAGE_MASK);
+        return true;
+    }
+
+    void clear(int f) {
+        mapping[f] = ~0ULL;
+        flag_bits[f] = 0;
+    }
+
+    uint8_t flags(int f) const { return flag_bits[f]; }
+    bool test(int f, uint8_t bits) const { return (flag_bits[f] & bits) != 0; }
+    void mark(int f, uint8_t bits) { flag_bits[f] |= bits; }
+    void unmark(int f, uint8_t bits) { flag_bits[f] &= (uint8_t)~bits; }
+
+    // frames currently holding a page
+    int used_count() const {
+        int n = 0;
+        for (uint8_t b : flag_bits) n += b & FRAME_USED;
+        return n;
+    }
+
+    long long memory_bytes() const {
+        return (long long)mapping.size() * (sizeof(uint64_t) + sizeof(uint8_t));
+    }
+
+    void checkpoint(CheckpointArchive &ar) {
+        ar.section("frames");
+        ar.io(mapping);
+        ar.io(flag_bits);
+        if (ar.loading() && mapping.size() != flag_bits.size()) reset(0);
+    }
+};
+
+#endif
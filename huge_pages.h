@@ -0,0 +1,391 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+// huge_pages.h
+// Demand paging with several page sizes at once, e.g. 4 KB, 2 MB and 1 GB
+// (paged_memory --replay with a PageSizes line). Physical memory is a range
+// of base frames (the smallest size) handed out by a buddy allocator
+// (contiguous_allocator.h), so a page of any size sits in an aligned run of
+// frames. Each job has one page table per size; a mapping is identified by
+// its first frame, which is also what the replacement policy sees.
+//
+// HugePageMode decides the size of a new mapping:
+//   never     base pages only, the baseline
+//   always    the largest size whose aligned region lies inside the job and
+//             holds no smaller mapping yet, if a free aligned block exists;
+//             otherwise the next smaller size (like Linux THP "always")
+//   promote   base pages first; once pct% of a larger region is resident
+//             the region is promoted to one huge page
+// With always and promote, a region whose smaller pages fill it (always) or
+// pct% of it (promote) is coalesced into one page of the larger size when a
+// free aligned block exists: its pages are copied over and their frames freed.
+//
+// Under memory pressure only base pages evict to make room; larger sizes are
+// only taken from free memory. When the policy picks a huge page as the
+// victim and part of it was never referenced, the page is split into pages
+// of the next smaller size instead: the pieces that were referenced stay
+// resident and the rest is freed. A fully referenced huge page is evicted.
+//
+// Every size has its own TLB; a miss walks the page table, one level less
+// for each step up in size as on x86-64 (4 KB: 4 accesses, 2 MB: 3, 1 GB: 2).
+// The report per size gives page-table memory, TLB reach and hits, and the
+// internal fragmentation of the resident pages (frames never referenced).
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "contiguous_allocator.h"
+#include "frame_table.h"
+#include "page_table.h"
+#include "replacement.h"
+#include "tlb.h"
+
+using namespace std;
+
+enum class HugePageMode { NEVER, ALWAYS, PROMOTE };
+
+inline const char *huge_page_mode_name(HugePageMode m) {
+    return m == HugePageMode::NEVER ? "never" : m == HugePageMode::ALWAYS ? "always" : "promote";
+}
+
+struct HugePageConfig {
+    vector<long long> sizes;        // bytes, ascending; sizes[0] is the base page
+    HugePageMode mode = HugePageMode::ALWAYS;
+    int promote_percent = 50;       // promote: resident share of a region that promotes it
+    vector<TlbConfig> tlbs;         // one per size
+    int base_walk = 4;              // page-table accesses of a base-page walk
+    int pt_levels = 0;              // depth of every page table, 0 = picked from its size
+};
+
+// "never", "always" or "promote [pct]"; false on anything else
+inline bool parse_huge_page_mode(const string &spec, HugePageConfig &cfg) {
+    stringstream ss(spec);
+    string word;
+    ss >> word;
+    if (word == "never") cfg.mode = HugePageMode::NEVER;
+    else if (word == "always") cfg.mode = HugePageMode::ALWAYS;
+    else if (word == "promote") {
+        cfg.mode = HugePageMode::PROMOTE;
+        int pct;
+        if (ss >> pct) cfg.promote_percent = max(1, min(100, pct));
+    } else return false;
+    return true;
+}
+
+// sizes ascending, without duplicates, every one a power of two times the
+// smallest; false otherwise
+inline bool valid_page_sizes(vector<long long> &sizes) {
+    sort(sizes.begin(), sizes.end());
+    sizes.erase(unique(sizes.begin(), sizes.end()), sizes.end());
+    if (sizes.empty() || sizes[0] <= 0) return false;
+    for (long long s : sizes) {
+        long long ratio = s / sizes[0];
+        if (s % sizes[0] || (ratio & (ratio - 1))) return false;
+    }
+    return true;
+}
+
+// per page size counters
+struct HugePageStats {
+    long long faults = 0;        // mappings created by a fault at this size
+    long long fallbacks = 0;     // faults that wanted this size but found no free block
+    long long evictions = 0;
+    long long splits = 0;        // pages of this size split under pressure
+    long long freed_by_split = 0; // base frames a split gave back
+    long long promotions = 0;    // regions coalesced into a page of this size
+    long long promotion_failures = 0; // eligible regions without a free block
+    long long copied = 0;        // base pages copied by promotions
+    long long resident = 0;      // mappings now
+};
+
+class HugePagePager {
+    struct PagedJob {
+        int id;
+        long long size;
+        vector<PageTable> tables; // per size: page number -> first frame, or -1
+    };
+
+    int num_frames;
+    vector<int> order;            // log2(frames per page) per size
+    BuddyAllocator memory;
+    FrameTable heads;             // first frame of a mapping -> (job index, base page number)
+    vector<int8_t> level_of;      // size index of the mapping starting at a frame, -1 if none
+    vector<uint64_t> touched;     // one bit per frame: the base page in it was referenced
+    vector<unordered_map<uint64_t, long long>> region_base; // per size >= 1: base pages resident in smaller pages of a region
+
+    int levels() const { return (int)order.size(); }
+    long long frames_per(int l) const { return 1LL << order[l]; }
+    int walk_length(int l) const { return max(1, cfg.base_walk - l); }
+    uint64_t region_key(int idx, int l, long long base_page) const { return page_key(idx, base_page >> order[l]); }
+
+    void set_touched(long long f) { touched[(size_t)f >> 6] |= 1ULL << (f & 63); }
+    bool is_touched(long long f) const { return (touched[(size_t)f >> 6] >> (f & 63)) & 1; }
+    void clear_touched(long long f, long long n) { for (long long i = 0; i < n; ++i) touched[(size_t)(f + i) >> 6] &= ~(1ULL << ((f + i) & 63)); }
+    long long count_touched(long long f, long long n) const {
+        long long c = 0;
+        for (long long i = f; i < f + n;) {
+            if ((i & 63) == 0 && i + 64 <= f + n) { c += __builtin_popcountll(touched[(size_t)i >> 6]); i += 64; }
+            else { c += is_touched(i); ++i; }
+        }
+        return c;
+    }
+
+    void count_region(int idx, int l, long long base_page, long long delta) {
+        for (int j = l + 1; j < levels(); ++j) {
+            auto &m = region_base[j];
+            uint64_t key = region_key(idx, j, base_page);
+            if ((m[key] += delta) == 0) m.erase(key);
+        }
+    }
+
+    long long region_resident(int idx, int l, long long base_page) const {
+        auto it = region_base[l].find(region_key(idx, l, base_page));
+        return it == region_base[l].end() ? 0 : it->second;
+    }
+
+    // the aligned page of size l holding base_page lies inside the job
+    bool fits_in_job(int idx, int l, long long base_page) const {
+        long long first = (base_page >> order[l]) << order[l];
+        return (first + frames_per(l)) * cfg.sizes[0] <= jobs[idx].size;
+    }
+
+    void map(int idx, int l, long long base_page, int f) {
+        base_page = (base_page >> order[l]) << order[l];
+        heads.assign(f, idx, base_page);
+        level_of[f] = (int8_t)l;
+        jobs[idx].tables[l].set(base_page >> order[l], f);
+        count_region(idx, l, base_page, frames_per(l));
+        ++stats[l].resident;
+    }
+
+    // drops the mapping starting at frame f; its frames stay allocated
+    void unmap(int f) {
+        int idx = heads.owner(f), l = level_of[f];
+        long long base_page = heads.page(f);
+        jobs[idx].tables[l].set(base_page >> order[l], -1);
+        tlbs[l]->invalidate(jobs[idx].id, (uint64_t)(base_page >> order[l]));
+        count_region(idx, l, base_page, -frames_per(l));
+        heads.clear(f);
+        level_of[f] = -1;
+        --stats[l].resident;
+    }
+
+    // frees the victim the policy chose: a partly referenced huge page is
+    // split and only its unreferenced pieces are freed
+    void reclaim(int f) {
+        int l = level_of[f];
+        if (l > 0 && count_touched(f, frames_per(l)) < frames_per(l)) {
+            int idx = heads.owner(f);
+            long long base_page = heads.page(f), piece = frames_per(l - 1);
+            unmap(f);
+            ++stats[l].splits;
+            for (long long p = 0; p < frames_per(l); p += piece) {
+                int g = (int)(f + p);
+                if (count_touched(g, piece) == 0) {
+                    memory.release(g, piece);
+                    stats[l].freed_by_split += piece;
+                    continue;
+                }
+                map(idx, l - 1, base_page + p, g);
+                policy->on_load(g, page_key(jobs[idx].id, base_page + p), NEVER_USED);
+            }
+            return;
+        }
+        ++stats[l].evictions;
+        unmap(f);
+        clear_touched(f, frames_per(l));
+        memory.release(f, frames_per(l));
+    }
+
+    // size of a new mapping for base_page, before looking for free memory
+    int wanted_level(int idx, long long base_page) const {
+        if (cfg.mode != HugePageMode::ALWAYS) return 0;
+        for (int l = levels() - 1; l > 0; --l)
+            if (fits_in_job(idx, l, base_page) && region_resident(idx, l, base_page) == 0) return l;
+        return 0;
+    }
+
+    // coalesces the region of size l around base_page if it qualifies and a
+    // free aligned block exists; true if it did
+    bool try_promote(int idx, int l, long long base_page) {
+        if (!fits_in_job(idx, l, base_page)) return false;
+        long long need = cfg.mode == HugePageMode::PROMOTE ? (frames_per(l) * cfg.promote_percent + 99) / 100 : frames_per(l);
+        if (region_resident(idx, l, base_page) < need) return false;
+        long long f = memory.allocate(frames_per(l));
+        if (f < 0) { ++stats[l].promotion_failures; return false; }
+        long long first = (base_page >> order[l]) << order[l];
+        clear_touched(f, frames_per(l));
+        PagedJob &job = jobs[idx];
+        for (int s = l - 1; s >= 0; --s) {
+            long long step = frames_per(s);
+            for (long long b = first; b < first + frames_per(l); b += step) {
+                int g = job.tables[s].lookup(b >> order[s]);
+                if (g < 0) continue;
+                for (long long i = 0; i < step; ++i)
+                    if (is_touched(g + i)) set_touched(f + (b - first) + i);
+                policy->on_evict(g);
+                unmap(g);
+                clear_touched(g, step);
+                memory.release(g, step);
+                stats[l].copied += step;
+            }
+        }
+        map(idx, l, first, (int)f);
+        policy->on_load((int)f, page_key(job.id, first), NEVER_USED);
+        ++stats[l].promotions;
+        return true;
+    }
+
+    // maps the page holding address addr of job idx; returns its first frame
+    int fault(int idx, long long addr) {
+        long long base_page = addr / cfg.sizes[0];
+        uint64_t key = page_key(jobs[idx].id, base_page);
+        int l = wanted_level(idx, base_page);
+        long long f = -1;
+        for (; l > 0; --l) {
+            if ((f = memory.allocate(frames_per(l))) >= 0) break;
+            ++stats[l].fallbacks;
+        }
+        if (l == 0)
+            while ((f = memory.allocate(1)) < 0) {
+                int victim = policy->choose_victim(key);
+                if (victim < 0) return -1;
+                reclaim(victim);
+            }
+        map(idx, l, base_page, (int)f);
+        clear_touched(f, frames_per(l));
+        set_touched(f + (base_page & (frames_per(l) - 1)));
+        policy->on_load((int)f, page_key(jobs[idx].id, (base_page >> order[l]) << order[l]), NEVER_USED);
+        ++stats[l].faults;
+        if (cfg.mode == HugePageMode::NEVER) return (int)f;
+        for (int j = l + 1; j < levels(); ++j) {
+            if (!try_promote(idx, j, base_page)) break;
+            f = jobs[idx].tables[j].lookup(base_page >> order[j]);
+        }
+        return (int)f;
+    }
+
+public:
+    HugePageConfig cfg;
+    vector<PagedJob> jobs;
+    unordered_map<int, int> job_index; // job id -> index into jobs
+    vector<HugePageStats> stats;       // per size
+    vector<unique_ptr<Tlb>> tlbs;      // per size
+    unique_ptr<ReplacementPolicy> policy;
+    long long references = 0, faults = 0, tlb_misses = 0, walk_accesses = 0;
+
+    // num_frames base frames; cfg.sizes must have passed valid_page_sizes and
+    // cfg.tlbs must hold one configuration per size
+    HugePagePager(const HugePageConfig &config, int num_frames_, const string &policy_name, unsigned seed)
+        : num_frames(num_frames_), memory(num_frames_), heads(num_frames_), level_of(num_frames_, -1),
+          touched(((size_t)num_frames_ + 63) / 64, 0), cfg(config) {
+        for (long long s : cfg.sizes) order.push_back(floor_log2(s / cfg.sizes[0]));
+        region_base.resize(order.size());
+        stats.resize(order.size());
+        for (size_t l = 0; l < order.size(); ++l) tlbs.emplace_back(new Tlb(cfg.tlbs[l], seed + (unsigned)l));
+        policy = make_policy(policy_name, seed);
+        if (!policy) policy = make_policy("random", seed);
+        policy->reset(num_frames);
+    }
+
+    // -1 once the index would not fit a frame's owner field
+    int add_job(int id, long long size) {
+        if ((long long)jobs.size() > FrameTable::MAX_OWNER) return -1;
+        PagedJob job;
+        job.id = id;
+        job.size = size;
+        for (long long s : cfg.sizes) {
+            job.tables.emplace_back();
+            job.tables.back().init((size + s - 1) / s, cfg.pt_levels);
+        }
+        jobs.push_back(move(job));
+        job_index[id] = (int)jobs.size() - 1;
+        return (int)jobs.size() - 1;
+    }
+
+    int find_job(int id) const {
+        auto it = job_index.find(id);
+        return it == job_index.end() ? -1 : it->second;
+    }
+
+    // one reference to byte addr (0 <= addr < size) of job idx; true on a fault
+    bool access(int idx, long long addr) {
+        PagedJob &job = jobs[idx];
+        ++references;
+        int f;
+        for (int l = 0; l < levels(); ++l) {
+            uint64_t vpn = (uint64_t)(addr / cfg.sizes[l]);
+            tlbs[l]->switch_to(job.id);
+            if (tlbs[l]->lookup(job.id, vpn, f)) {
+                set_touched(f + (addr / cfg.sizes[0] - (long long)vpn * frames_per(l)));
+                policy->on_hit(f, NEVER_USED);
+                return false;
+            }
+        }
+        ++tlb_misses;
+        for (int l = levels() - 1; l >= 0; --l) {
+            long long page = addr / cfg.sizes[l];
+            if ((f = job.tables[l].lookup(page)) < 0) continue;
+            walk_accesses += walk_length(l);
+            tlbs[l]->insert(job.id, (uint64_t)page, f);
+            set_touched(f + (addr / cfg.sizes[0] - page * frames_per(l)));
+            policy->on_hit(f, NEVER_USED);
+            return false;
+        }
+        ++faults;
+        if ((f = fault(idx, addr)) < 0) return true; // no memory at all
+        int l = level_of[f];
+        walk_accesses += walk_length(l);
+        tlbs[l]->insert(job.id, (uint64_t)(addr / cfg.sizes[l]), f);
+        return true;
+    }
+
+    // TLB hits over all sizes
+    long long tlb_hits() const { return references - tlb_misses; }
+
+    // average ns per reference: TLB probe and memory access, plus the walk
+    // accesses of the misses
+    double effective_access_time() const {
+        const TlbConfig &t = cfg.tlbs[0];
+        double walks = references ? (double)walk_accesses / references : 0.0;
+        return t.tlb_latency + t.memory_latency + walks * t.memory_latency;
+    }
+
+    // bytes held by the page tables of size l over all jobs
+    long long table_bytes(int l) const {
+        long long b = 0;
+        for (const PagedJob &job : jobs) b += job.tables[l].memory_bytes();
+        return b;
+    }
+
+    // base frames in resident pages of size l, and how many of them were
+    // never referenced (internal fragmentation; base pages count the unused
+    // tail of each job's last page instead)
+    void residency(int l, long long &frames, long long &unreferenced) const {
+        frames = unreferenced = 0;
+        for (int f = 0; f < num_frames; ++f) {
+            if (level_of[f] != l) continue;
+            frames += frames_per(l);
+            if (l > 0) unreferenced += frames_per(l) - count_touched(f, frames_per(l));
+        }
+    }
+
+    // bytes of the last base page of each job beyond its end, where resident
+    long long tail_waste() const {
+        long long b = 0, base = cfg.sizes[0];
+        for (const PagedJob &job : jobs) {
+            long long last = (job.size + base - 1) / base - 1;
+            if (job.size % base && last >= 0 && job.tables[0].lookup(last) >= 0) b += base - job.size % base;
+        }
+        return b;
+    }
+
+    int free_frames() const { return (int)memory.free_units(); }
+};
+
+#endif
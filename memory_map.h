@@ -0,0 +1,243 @@
+#ifndef MEMORY_MAP_H
+#define MEMORY_MAP_H
+
+// memory_map.h
+// Memory-map reports whose formatting cost follows the size of the report,
+// not of memory.
+//
+// FrameMap::build makes one pass over a FrameTable (no formatting) and
+// collapses it into runs of consecutive frames with the same owner, e.g.
+//   frames 1000-1999: job 3, pages 0-999
+// A run remembers whether its pages follow each other, so a job placed in
+// order prints as one page range. The same pass counts the frames of every
+// owner and the used frames of each heat-map cell. Queries then work on runs:
+//   runs_in(lo, hi)  the runs overlapping a frame range (binary search)
+//   runs_of(owner)   the runs of one owner
+// and clip() cuts a run down to the queried range.
+//
+// The build is linear in the frames, about 5 ns a frame, and runs once per
+// report. Reports come from menus and the end of a run, whereas the frame
+// table changes on every fault. Splitting and merging runs in FrameTable::assign
+// and clear would charge each fault for a report that may never be made.
+//
+// Reports are written through a ReportWriter, which gathers text in a 64 KB
+// buffer and hands it to stdio in one fwrite, instead of a cout/endl flush
+// per line. A program that unties cout from stdio (sync_with_stdio(false))
+// flushes cout before it starts a report.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_table.h"
+
+using namespace std;
+
+class ReportWriter {
+    FILE *out;
+    string buf;
+    size_t capacity;
+
+public:
+    explicit ReportWriter(FILE *out_ = stdout, size_t capacity_ = 1 << 16) : out(out_), capacity(capacity_) {
+        buf.reserve(capacity + 256);
+    }
+    ~ReportWriter() { flush(); }
+
+    void printf(const char *fmt, ...) {
+        char line[256];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(line, sizeof line, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < sizeof line) {
+            buf.append(line, n);
+        } else {
+            // longer than the line buffer: format again straight into buf
+            size_t at = buf.size();
+            buf.resize(at + n + 1);
+            va_start(ap, fmt);
+            vsnprintf(&buf[at], n + 1, fmt, ap);
+            va_end(ap);
+            buf.resize(at + n);
+        }
+        if (buf.size() >= capacity) flush();
+    }
+
+    void write(const string &s) {
+        buf += s;
+        if (buf.size() >= capacity) flush();
+    }
+
+    void flush() {
+        if (buf.empty()) return;
+        fwrite(buf.data(), 1, buf.size(), out);
+        fflush(out);
+        buf.clear();
+    }
+};
+
+// consecutive frames with one owner (or all free)
+struct FrameRun {
+    int first = 0, last = 0;    // frames, inclusive
+    int owner = -1;             // -1: free frames
+    long long first_page = -1;  // page in frame first
+    bool sequential = true;     // frame first + i holds page first_page + i
+    int dirty = 0;              // frames marked FRAME_DIRTY
+
+    int frames() const { return last - first + 1; }
+    long long last_page() const { return first_page + (last - first); }
+};
+
+class FrameMap {
+public:
+    static const int HEAT_CELLS = 64;
+
+    vector<FrameRun> runs;            // in frame order, covering every frame
+    vector<long long> owner_frames;   // frames held, by owner id
+    vector<vector<int>> owner_runs;   // indexes into runs, by owner id
+    vector<int> heat;                 // used frames per cell
+    int cell_frames = 1;              // frames per heat-map cell (the last one may have fewer)
+    int total = 0, used = 0;
+
+    void build(const FrameTable &frames) {
+        runs.clear();
+        owner_frames.clear();
+        owner_runs.clear();
+        total = frames.size();
+        used = 0;
+        cell_frames = max(1, (total + HEAT_CELLS - 1) / HEAT_CELLS);
+        heat.assign((total + cell_frames - 1) / cell_frames, 0);
+        for (int f = 0; f < total; ++f) {
+            int owner = frames.owner(f);
+            long long page = frames.page(f);
+            if (runs.empty() || runs.back().owner != owner) {
+                FrameRun r;
+                r.first = r.last = f;
+                r.owner = owner;
+                r.first_page = page;
+                runs.push_back(r);
+            } else {
+                FrameRun &r = runs.back();
+                if (page != r.first_page + (f - r.first)) r.sequential = false;
+                r.last = f;
+            }
+            if (owner == -1) continue;
+            ++used;
+            ++heat[f / cell_frames];
+            if (frames.test(f, FRAME_DIRTY)) ++runs.back().dirty;
+            if (owner >= (int)owner_frames.size()) {
+                owner_frames.resize(owner + 1, 0);
+                owner_runs.resize(owner + 1);
+            }
+            ++owner_frames[owner];
+        }
+        for (int i = 0; i < (int)runs.size(); ++i)
+            if (runs[i].owner != -1) owner_runs[runs[i].owner].push_back(i);
+    }
+
+    // [begin, end) indexes of the runs overlapping frames lo..hi
+    pair<size_t,size_t> runs_in(int lo, int hi) const {
+        auto after = [](const FrameRun &r, int f) { return r.last < f; };
+        size_t b = lower_bound(runs.begin(), runs.end(), lo, after) - runs.begin();
+        size_t e = lower_bound(runs.begin() + b, runs.end(), hi + 1, after) - runs.begin();
+        if (e < runs.size() && runs[e].first <= hi) ++e;
+        return {b, e};
+    }
+
+    const vector<int> &runs_of(int owner) const {
+        static const vector<int> none;
+        return owner >= 0 && owner < (int)owner_runs.size() ? owner_runs[owner] : none;
+    }
+
+    long long frames_of(int owner) const {
+        return owner >= 0 && owner < (int)owner_frames.size() ? owner_frames[owner] : 0;
+    }
+
+    // the part of run i inside frames lo..hi; a cut run recounts its dirty
+    // frames over the part kept
+    FrameRun clip(const FrameTable &frames, size_t i, int lo, int hi) const {
+        FrameRun r = runs[i];
+        if (r.first >= lo && r.last <= hi) return r;
+        int first = max(r.first, lo), last = min(r.last, hi);
+        r.first_page = frames.page(first);
+        r.first = first;
+        r.last = last;
+        r.dirty = 0;
+        r.sequential = true;
+        for (int f = first; f <= last; ++f) {
+            if (frames.test(f, FRAME_DIRTY)) ++r.dirty;
+            if (r.owner != -1 && frames.page(f) != r.first_page + (f - first)) r.sequential = false;
+        }
+        return r;
+    }
+
+    // one character per cell, ' ' empty to '@' full
+    string heat_map() const {
+        static const char levels[] = " .:-=+*#%@";
+        string s;
+        for (size_t c = 0; c < heat.size(); ++c) {
+            int width = min(cell_frames, total - (int)c * cell_frames);
+            int level = heat[c] == 0 ? 0 : heat[c] == width ? 9 : 1 + (int)((long long)(heat[c] - 1) * 8 / width);
+            s += levels[level];
+        }
+        return s;
+    }
+};
+
+// "7" or "3-9"
+inline string frame_span(int first, int last) {
+    return first == last ? to_string(first) : to_string(first) + "-" + to_string(last);
+}
+
+// "page 4", "pages 0-9" or "6 pages" when they are not in order
+inline string run_pages(const FrameRun &r) {
+    if (r.frames() == 1) return "page " + to_string(r.first_page);
+    if (r.sequential) return "pages " + to_string(r.first_page) + "-" + to_string(r.last_page());
+    return to_string(r.frames()) + " pages";
+}
+
+// line(out, run) for the runs in frames lo..hi, cut to the range; at most
+// limit lines, then a count of the runs left out
+template <class Line>
+void write_range(ReportWriter &out, const FrameMap &map, const FrameTable &frames, int lo, int hi,
+                 size_t limit, Line line) {
+    pair<size_t,size_t> in = map.runs_in(lo, hi);
+    size_t shown = min(in.second - in.first, limit);
+    for (size_t i = in.first; i < in.first + shown; ++i) line(out, map.clip(frames, i, lo, hi));
+    if (shown < in.second - in.first)
+        out.printf(" ... %zu more runs not shown\n", in.second - in.first - shown);
+}
+
+// line(out, run) for the runs of one owner, as write_range
+template <class Line>
+void write_owner(ReportWriter &out, const FrameMap &map, int owner, size_t limit, Line line) {
+    const vector<int> &runs = map.runs_of(owner);
+    size_t shown = min(runs.size(), limit);
+    for (size_t k = 0; k < shown; ++k) line(out, map.runs[runs[k]]);
+    if (shown < runs.size())
+        out.printf(" ... %zu more runs not shown\n", runs.size() - shown);
+}
+
+// frames per owner and the heat map; label(owner) names an owner id
+template <class Label>
+void write_occupancy(ReportWriter &out, const FrameMap &map, Label label) {
+    out.printf("Occupancy: %d / %d frames used (%.1f%%), %zu runs\n", map.used, map.total,
+               map.total ? 100.0 * map.used / map.total : 0.0, map.runs.size());
+    for (int owner = 0; owner < (int)map.owner_frames.size(); ++owner) {
+        long long n = map.owner_frames[owner];
+        if (n == 0) continue;
+        out.printf(" %-16s %10lld frames %6.1f%%  %zu run(s)\n", label(owner).c_str(), n,
+                   100.0 * n / map.total, map.owner_runs[owner].size());
+    }
+    out.printf(" %-16s %10d frames %6.1f%%\n", "free", map.total - map.used,
+               map.total ? 100.0 * (map.total - map.used) / map.total : 0.0);
+    out.printf("Heat map (%zu cells of %d frame%s, ' ' free to '@' full):\n |%s|\n", map.heat.size(),
+               map.cell_frames, map.cell_frames == 1 ? "" : "s", map.heat_map().c_str());
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// metrics.h
+// Counters kept by the demand-paging engine and their JSON/CSV export.
+//
+// Every update is a plain increment on the job's own JobStats (plus one
+// count-leading-zeros for the histograms), so the counters stay on during
+// trace replay. JobStats is aligned to a cache line: a vector of them never
+// puts two jobs' counters on the same line, so threads that each own some
+// jobs do not false-share.
+//
+// Histograms use power-of-two buckets: bucket 0 counts zeros and bucket b
+// counts values in [2^(b-1), 2^b - 1].
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Log2Histogram {
+public:
+    static const int BUCKETS = 65;
+
+private:
+    long long counts[BUCKETS] = {};
+    long long n = 0;
+    double total = 0;
+    long long largest = 0;
+
+public:
+    static long long bucket_low(int b) { return b == 0 ? 0 : 1LL << (b - 1); }
+    static long long bucket_high(int b) { return b == 0 ? 0 : (b == 64 ? LLONG_MAX : (1LL << b) - 1); }
+
+    void add(long long v) {
+        if (v < 0) v = 0;
+        int b = v == 0 ? 0 : 64 - __builtin_clzll((uint64_t)v);
+        ++counts[b];
+        ++n;
+        total += (double)v;
+        if (v > largest) largest = v;
+    }
+
+    long long count() const { return n; }
+    long long bucket(int b) const { return counts[b]; }
+    long long max() const { return largest; }
+    double mean() const { return n ? total / n : 0.0; }
+
+    // upper bound of the bucket holding the q-quantile (0 < q <= 1)
+    long long percentile(double q) const {
+        if (n == 0) return 0;
+        long long want = (long long)(q * n + 0.5);
+        if (want < 1) want = 1;
+        long long seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= want) return bucket_high(b) < largest ? bucket_high(b) : largest;
+        }
+        return largest;
+    }
+
+    Log2Histogram &operator+=(const Log2Histogram &o) {
+        for (int b = 0; b < BUCKETS; ++b) counts[b] += o.counts[b];
+        n += o.n;
+        total += o.total;
+        if (o.largest > largest) largest = o.largest;
+        return *this;
+    }
+};
+
+// per-job counters; a sum over jobs gives the totals
+struct alignas(64) JobStats {
+    long long references = 0;
+    long long hits = 0;          // references that found the page resident (TLB or page table)
+    long long faults = 0;
+    long long evictions = 0;     // evictions this job's faults caused
+    long long evicted = 0;       // this job's pages evicted (anyone's faults, trimming, suspension)
+    long long resident = 0;      // pages currently in frames
+    long long internal_frag = 0; // bytes unused in the last page
+    long long suspensions = 0;   // times load control swapped the job out
+    long long deferred = 0;      // references that arrived while it was suspended
+    long long prefetched = 0;    // pages loaded by read-ahead
+    long long prefetch_hits = 0; // read-ahead pages referenced before eviction
+    long long prefetch_wasted = 0; // read-ahead pages evicted without a reference
+    long long cow_faults = 0;    // writes to a shared page that copied it (counted in faults)
+    long long shared_maps = 0;   // faults served by mapping a frame another job holds (counted in faults)
+    long long last_fault = -1;   // value of references at the previous fault
+    Log2Histogram fault_gap;     // references of this job between two of its faults
+
+    JobStats &operator+=(const JobStats &o) {
+        references += o.references; hits += o.hits; faults += o.faults;
+        evictions += o.evictions; evicted += o.evicted; resident += o.resident;
+        internal_frag += o.internal_frag; suspensions += o.suspensions; deferred += o.deferred;
+        prefetched += o.prefetched; prefetch_hits += o.prefetch_hits; prefetch_wasted += o.prefetch_wasted;
+        cow_faults += o.cow_faults; shared_maps += o.shared_maps;
+        fault_gap += o.fault_gap;
+        return *this;
+    }
+};
+
+// writes snapshots of the counters to a file: JSON when the name ends in
+// ".json" ({"snapshots": [...]}), CSV (one row per job plus a total row per
+// snapshot) otherwise
+class MetricsWriter {
+    FILE *out = nullptr;
+    bool json = false;
+    bool first = true;
+
+    void json_counters(const JobStats &st, const Log2Histogram &gap) {
+        fprintf(out, "\"references\": %lld, \"hits\": %lld, \"faults\": %lld, \"evictions_caused\": %lld, "
+                     "\"evictions_suffered\": %lld, \"resident_pages\": %lld, \"internal_frag_bytes\": %lld, "
+                     "\"suspensions\": %lld, \"deferred\": %lld, "
+                     "\"prefetched\": %lld, \"prefetch_hits\": %lld, \"prefetch_wasted\": %lld, "
+                     "\"cow_faults\": %lld, \"shared_maps\": %lld, "
+                     "\"fault_gap\": {\"count\": %lld, \"mean\": %.3f, \"p50\": %lld, \"p99\": %lld, \"max\": %lld, \"buckets\": [",
+                st.references, st.hits, st.faults, st.evictions, st.evicted, st.resident, st.internal_frag,
+                st.suspensions, st.deferred, st.prefetched, st.prefetch_hits, st.prefetch_wasted,
+                st.cow_faults, st.shared_maps, gap.count(), gap.mean(), gap.percentile(0.5), gap.percentile(0.99), gap.max());
+        bool first_bucket = true;
+        for (int b = 0; b < Log2Histogram::BUCKETS; ++b) {
+            if (!gap.bucket(b)) continue;
+            fprintf(out, "%s[%lld, %lld, %lld]", first_bucket ? "" : ", ",
+                    Log2Histogram::bucket_low(b), Log2Histogram::bucket_high(b), gap.bucket(b));
+            first_bucket = false;
+        }
+        fprintf(out, "]}");
+    }
+
+    void csv_row(long long at, const string &policy, const string &job, const JobStats &st, const Log2Histogram &gap) {
+        fprintf(out, "%lld,%s,%s,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%.3f,%lld,%lld,%lld\n",
+                at, policy.c_str(), job.c_str(), st.references, st.hits, st.faults, st.evictions, st.evicted,
+                st.resident, st.internal_frag, st.suspensions, st.deferred,
+                st.prefetched, st.prefetch_hits, st.prefetch_wasted, st.cow_faults, st.shared_maps, gap.count(), gap.mean(), gap.percentile(0.5), gap.percentile(0.99), gap.max());
+    }
+
+public:
+    ~MetricsWriter() { close(); }
+
+    bool open(const string &path) {
+        close();
+        out = fopen(path.c_str(), "w");
+        if (!out) return false;
+        json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        first = true;
+        if (json) fprintf(out, "{\"snapshots\": [\n");
+        else fprintf(out, "at_reference,policy,job,references,hits,faults,evictions_caused,evictions_suffered,"
+                          "resident_pages,internal_frag_bytes,suspensions,deferred,prefetched,prefetch_hits,prefetch_wasted,cow_faults,shared_maps,fault_gaps,fault_gap_mean,fault_gap_p50,fault_gap_p99,fault_gap_max\n");
+        return true;
+    }
+
+    bool is_open() const { return out != nullptr; }
+
+    // job_ids and stats are parallel; fault_gap is measured over all jobs'
+    // references together and stands in for the sum in the total
+    void snapshot(long long at, const string &policy, const vector<int> &job_ids,
+                  const vector<JobStats> &stats, const Log2Histogram &fault_gap) {
+        if (!out) return;
+        JobStats total;
+        for (const JobStats &st : stats) total += st;
+        if (!json) {
+            for (size_t i = 0; i < stats.size(); ++i) csv_row(at, policy, to_string(job_ids[i]), stats[i], stats[i].fault_gap);
+            csv_row(at, policy, "total", total, fault_gap);
+            return;
+        }
+        fprintf(out, "%s  {\"at_reference\": %lld, \"policy\": \"%s\", \"jobs\": [\n", first ? "" : ",\n", at, policy.c_str());
+        for (size_t i = 0; i < stats.size(); ++i) {
+            fprintf(out, "    {\"job\": %d, ", job_ids[i]);
+            json_counters(stats[i], stats[i].fault_gap);
+            fprintf(out, "}%s\n", i + 1 < stats.size() ? "," : "");
+        }
+        fprintf(out, "  ], \"total\": {");
+        json_counters(total, fault_gap);
+        fprintf(out, "}}");
+        first = false;
+    }
+
+    void close() {
+        if (!out) return;
+        if (json) fprintf(out, "\n]}\n");
+        fclose(out);
+        out = nullptr;
+    }
+};
+
+#endif
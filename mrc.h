@@ -0,0 +1,136 @@
+#ifndef MRC_H
+#define MRC_H
+
+// mrc.h
+// One-pass LRU miss-ratio curve from Mattson stack distances.
+//
+// The stack distance of a reference is the number of distinct pages touched
+// since the previous reference to the same page (plus one); LRU with C frames
+// faults exactly on the references whose distance exceeds C, and on first
+// touches. Distances are counted with a Fenwick tree over trace positions
+// that holds a 1 at the latest position of every page, so each reference
+// costs O(log n) and a single pass yields the fault count for every C.
+// When the positions reach the end of the tree, the live positions are
+// renumbered 1..distinct in their order and the tree is rebuilt at twice
+// that, so memory stays O(distinct pages) however long the trace is.
+//
+// With sample_rate < 1 the analyser follows SHARDS (Waldspurger et al.):
+// only pages whose hash falls below rate * 2^24 are tracked, their distances
+// are scaled up by 1/rate and the counts are scaled by total/sampled
+// references, which shrinks both time and memory roughly by the sampling rate.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class StackDistanceAnalyzer {
+    vector<int> tree;                         // Fenwick tree over (renumbered) sampled positions
+    unordered_map<uint64_t, long long> last;  // page -> latest sampled position (1-based)
+    vector<double> hist;                      // hist[d] = references with distance d
+    double cold = 0;                          // first touches
+    long long pos = 0;                        // latest position handed out
+    long long sampled_refs = 0;
+    long long total = 0;
+    double rate;
+    uint64_t threshold;
+
+    static uint64_t mix(uint64_t k) {
+        k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void add(long long i, int v) { for (; i < (long long)tree.size(); i += i & -i) tree[i] += v; }
+    long long sum(long long i) const { long long s = 0; for (; i > 0; i -= i & -i) s += tree[i]; return s; }
+
+    // renumbers the latest positions of the pages to 1..distinct, keeping
+    // their order (and so every distance), and rebuilds the tree with room
+    // for as many positions again
+    void compact() {
+        vector<pair<long long, long long *>> live;
+        live.reserve(last.size());
+        for (auto &kv : last) live.push_back({kv.second, &kv.second});
+        sort(live.begin(), live.end());
+        for (size_t i = 0; i < live.size(); ++i) *live[i].second = (long long)i + 1;
+        pos = (long long)live.size();
+        tree.assign(max<size_t>(2 * live.size(), 1024) + 1, 0);
+        for (long long i = 1; i <= pos; ++i) tree[i] = 1;
+        for (long long i = 1; i < (long long)tree.size(); ++i) { // linear Fenwick build
+            long long parent = i + (i & -i);
+            if (parent < (long long)tree.size()) tree[parent] += tree[i];
+        }
+    }
+
+public:
+    // expected_pages sizes the tree up front; it is rebuilt on demand otherwise
+    explicit StackDistanceAnalyzer(double sample_rate = 1.0, size_t expected_pages = 0)
+        : rate(sample_rate <= 0 || sample_rate > 1 ? 1.0 : sample_rate) {
+        threshold = (uint64_t)(rate * (1 << 24));
+        tree.assign(max<size_t>(expected_pages, 1024) + 1, 0);
+    }
+
+    double sample_rate() const { return rate; }
+    long long references() const { return total; }
+    long long sampled() const { return sampled_refs; }
+    long long distinct_pages() const { return (long long)llround(last.size() / rate); }
+
+    void access(uint64_t key) {
+        ++total;
+        if (rate < 1.0 && (mix(key) & 0xffffff) >= threshold) return;
+        ++sampled_refs;
+        if (pos + 1 >= (long long)tree.size()) compact();
+        ++pos;
+        auto it = last.find(key);
+        if (it == last.end()) {
+            cold += 1;
+            last.emplace(key, pos);
+        } else {
+            long long d = sum(pos - 1) - sum(it->second) + 1; // distinct pages since, plus itself
+            size_t scaled = (size_t)llround(d / rate);
+            if (scaled >= hist.size()) hist.resize(scaled + 1, 0);
+            hist[scaled] += 1;
+            add(it->second, -1);
+            it->second = pos;
+        }
+        add(pos, 1);
+    }
+
+    // faults[c] for c = 0 .. distinct pages, in units of the full trace
+    vector<double> fault_curve() const {
+        size_t n = max<size_t>(hist.size(), (size_t)distinct_pages() + 1);
+        vector<double> faults(n + 1, 0);
+        double scale = sampled_refs ? (double)total / sampled_refs : 0.0;
+        double beyond = 0; // references with distance > c
+        for (size_t c = n; c-- > 0;) {
+            if (c + 1 < hist.size()) beyond += hist[c + 1];
+            faults[c] = (cold + beyond) * scale;
+        }
+        faults.pop_back();
+        return faults;
+    }
+};
+
+// knee of a decreasing curve: the point furthest below the chord from the
+// first to the last point, with both axes normalised (the "kneedle" heuristic)
+inline size_t curve_knee(const vector<double> &y, size_t first = 1) {
+    if (y.size() <= first + 1) return first;
+    size_t lastx = y.size() - 1;
+    double y0 = y[first], y1 = y[lastx];
+    if (y0 <= y1) return first;
+    size_t best = first;
+    double best_gap = 0;
+    for (size_t x = first; x <= lastx; ++x) {
+        double nx = (double)(x - first) / (lastx - first);
+        double ny = (y[x] - y1) / (y0 - y1);
+        double gap = (1.0 - nx) - ny; // chord minus curve
+        if (gap > best_gap) { best_gap = gap; best = x; }
+    }
+    return best;
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+// page_table.h
+// Hierarchical (radix) page table with 64-bit page numbers. The page-number
+// bits of a job are split over 1 to 4 levels; a node is only allocated when a
+// page under it is first mapped, so a sparse job pays for the regions it
+// touches, not for its whole address space. With 1 level the table is a
+// plain dense array, allocated on first use.
+//
+// Each level is one pool of int32 slots; a node is a run of 2^bits slots in
+// its level's pool. Inner slots hold the index of a child node (-1 = none),
+// leaf slots hold a frame number (-1 = not resident). The leaf touched last
+// is cached, so sequential and local references skip the walk.
+
+#include <cstdint>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+class PageTable {
+    int levels = 1;
+    int total_bits = 1;
+    int bits[4] = {1, 0, 0, 0};  // index bits per level, root first
+    int shift[4] = {0, 0, 0, 0}; // page-number shift for each level's index
+    vector<int32_t> pool[4];     // pool[k] holds every node of level k
+    long long mapped = 0;
+
+    mutable uint64_t cached_base = ~0ULL; // page-number prefix above the leaf index of the cached leaf
+    mutable int32_t cached_leaf = -1;
+
+    int32_t new_node(int level) {
+        int32_t id = (int32_t)(pool[level].size() >> bits[level]);
+        pool[level].resize(pool[level].size() + ((size_t)1 << bits[level]), -1);
+        return id;
+    }
+
+    size_t slot(int level, int32_t node, uint64_t page) const {
+        return ((size_t)node << bits[level]) | (size_t)((page >> shift[level]) & ((1ULL << bits[level]) - 1));
+    }
+
+    // leaf node covering page, or -1; allocates the path when create is set
+    int32_t find_leaf(uint64_t page, bool create) {
+        uint64_t base = page >> bits[levels-1]; // the leaf index is the low bits (shift[levels-1] == 0)
+        if (base == cached_base) return cached_leaf;
+        if (pool[0].empty()) {
+            if (!create) return -1;
+            new_node(0);
+        }
+        int32_t node = 0;
+        for (int k = 0; k + 1 < levels; ++k) {
+            size_t s = slot(k, node, page);
+            int32_t child = pool[k][s];
+            if (child == -1) {
+                if (!create) return -1;
+                child = new_node(k+1);
+                pool[k][s] = child;
+            }
+            node = child;
+        }
+        cached_base = base;
+        cached_leaf = node;
+        return node;
+    }
+
+    template <class Fn>
+    void walk(int level, int32_t node, uint64_t prefix, Fn &fn) const {
+        size_t n = (size_t)1 << bits[level];
+        for (size_t i = 0; i < n; ++i) {
+            int32_t v = pool[level][((size_t)node << bits[level]) | i];
+            if (v == -1) continue;
+            uint64_t page = prefix | ((uint64_t)i << shift[level]);
+            if (level >= levels - 1 || level == 3) fn((long long)page, (int)v); // levels <= 4
+            else walk(level + 1, v, page, fn);
+        }
+    }
+
+public:
+    // levels is clamped to 1..4; 0 picks a depth from the job size
+    // (1 level up to 2^20 pages, then 2, 3 and 4 levels)
+    PageTable(long long num_pages = 0, int levels_ = 0) { init(num_pages, levels_); }
+
+    static int auto_levels(long long num_pages) {
+        if (num_pages <= (1LL << 20)) return 1;
+        if (num_pages <= (1LL << 32)) return 2;
+        if (num_pages <= (1LL << 44)) return 3;
+        return 4;
+    }
+
+    void init(long long num_pages, int levels_) {
+        total_bits = 1;
+        while (total_bits < 63 && (1LL << total_bits) < num_pages) ++total_bits;
+        if (levels_ <= 0) levels_ = auto_levels(num_pages);
+        levels = levels_ > 4 ? 4 : levels_;
+        if (levels > total_bits) levels = total_bits;
+        int used = 0;
+        for (int k = levels - 1; k >= 0; --k) {
+            bits[k] = total_bits / levels + (k < total_bits % levels ? 1 : 0);
+            shift[k] = used;
+            used += bits[k];
+        }
+        for (auto &p : pool) p.clear();
+        mapped = 0;
+        cached_base = ~0ULL;
+        cached_leaf = -1;
+    }
+
+    int depth() const { return levels; }
+    int level_bits(int k) const { return bits[k]; }
+    long long resident() const { return mapped; }
+    long long capacity() const { return 1LL << total_bits; }
+
+    // frame holding the page, or -1
+    int lookup(long long page) const {
+        if ((uint64_t)page >> total_bits) return -1;
+        int32_t leaf = const_cast<PageTable*>(this)->find_leaf((uint64_t)page, false);
+        if (leaf == -1) return -1;
+        return pool[levels-1][slot(levels-1, leaf, (uint64_t)page)];
+    }
+    int operator[](long long page) const { return lookup(page); }
+
+    // maps a page to a frame, or unmaps it with frame == -1
+    void set(long long page, int frame) {
+        if ((uint64_t)page >> total_bits) return;
+        int32_t leaf = find_leaf((uint64_t)page, frame != -1);
+        if (leaf == -1) return;
+        int32_t &e = pool[levels-1][slot(levels-1, leaf, (uint64_t)page)];
+        if (e == -1 && frame != -1) ++mapped;
+        else if (e != -1 && frame == -1) --mapped;
+        e = frame;
+    }
+
+    // calls fn(page, frame) for every resident page in page order
+    template <class Fn>
+    void for_each_mapped(Fn fn) const {
+        if (!pool[0].empty()) walk(0, 0, 0, fn);
+    }
+
+    // the entries of a one-level table (capacity() of them), or nullptr for a
+    // deeper table or one with nothing mapped yet
+    const int32_t *flat() const { return levels == 1 && !pool[0].empty() ? pool[0].data() : nullptr; }
+
+    void checkpoint(CheckpointArchive &ar) {
+        ar.io(levels);
+        ar.io(total_bits);
+        ar.io(bits);
+        ar.io(shift);
+        for (auto &p : pool) ar.io(p);
+        ar.io(mapped);
+        cached_base = ~0ULL;
+        cached_leaf = -1;
+        if (ar.loading() && !consistent()) ar.fail();
+    }
+
+    // the level split covers total_bits, every inner slot names an existing
+    // node and `mapped` counts the leaf entries; leaf values are frame
+    // numbers the owner checks against its memory
+    bool consistent() const {
+        if (levels < 1 || levels > 4 || total_bits < 1 || total_bits > 63 || levels > total_bits) return false;
+        int used = 0;
+        for (int k = levels - 1; k >= 0; --k) {
+            if (bits[k] < 1 || shift[k] != used) return false;
+            used += bits[k];
+        }
+        if (used != total_bits) return false;
+        for (int k = 0; k < 4; ++k) {
+            if (k >= levels) { if (!pool[k].empty()) return false; continue; }
+            if (pool[k].size() & (((size_t)1 << bits[k]) - 1)) return false;
+        }
+        if (pool[0].size() > ((size_t)1 << bits[0])) return false; // a single root
+        long long leaves = 0;
+        for (int k = 0; k < levels; ++k)
+            for (int32_t v : pool[k]) {
+                if (v < -1 || (k + 1 < levels && v >= nodes(k + 1))) return false;
+                leaves += k + 1 == levels && v != -1;
+            }
+        return leaves == mapped;
+    }
+
+    long long nodes(int level) const { return (long long)(pool[level].size() >> bits[level]); }
+
+    // bytes held by the table's nodes
+    long long memory_bytes() const {
+        long long total = 0;
+        for (int k = 0; k < levels; ++k) total += (long long)pool[k].size() * sizeof(int32_t);
+        return total;
+    }
+
+    // bytes a dense one-entry-per-page array would need
+    static long long dense_bytes(long long num_pages) { return num_pages * (long long)sizeof(int32_t); }
+};
+
+#endif
@@ -1,5 +1,5 @@
 // paged_memory.cpp
-// Compile: g++ -O2 page_memory.cpp -o page_memory
+// Compile: g++ -O2 -pthread paged_memory.cpp -o paged_memory
 
 #include <iostream>
 #include <vector>
@@ -10,6 +10,26 @@
 #include <unordered_map>
 #include <random>
 #include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <cerrno>
+
+#include "frame_allocator.h"
+#include "demand_engine.h"
+#include "sim_core.h"
+#include "memory_map.h"
+#include "trace.h"
+#include "tlb.h"
+#include "thread_pool.h"
+#include "concurrent_pager.h"
+#include "mrc.h"
+#include "metrics.h"
+#include "huge_pages.h"
+#include "event_log.h"
 
 using namespace std;
 
@@ -19,7 +39,7 @@ Design:
 - Physical memory represented as N frames (user-specified).
 - Each job has:
     id, size (bytes), num_pages, internal_fragmentation, page table (page -> frame or -1)
-- frames[] keeps (job_id, page_no) or (-1,-1) if free.
+- frames (frame_table.h) keep the owning job and page_no, or are marked free.
 - Two modes:
     1) Paged Memory Allocation (single job) - loads pages randomly into free frames once.
     2) Demand Paged Memory Allocation (multiple jobs) - pages loaded only on access;
@@ -30,25 +50,29 @@ Design:
     If not present:
         - non-demand mode: report page not loaded
         - demand mode: simulate page fault, load it (possibly evict random), then resolve.
+- Batch replay (command line: paged_memory --replay <jobs_file> <trace_file> [policies]):
+    streams a (job_id, logical_address) trace through the same demand-paging logic
+    (demand_engine.h) and prints only the per-job summary at the end.
+- Replacement policy (replacement.h): random (original behaviour), fifo, lru, clock,
+  lfu, arc, and opt (replay only, uses trace lookahead).
+- Resident sets (resident_set.h): replacement can be kept inside each job (local
+  quotas, working set WS(tau) or page-fault-frequency quotas), with optional load
+  control that suspends jobs while their demand exceeds memory.
+- Sweep (command line: paged_memory --sweep <jobs_file> <trace_file> [options]):
+    runs every frame count / page size / policy combination in parallel over one
+    shared copy of the trace and writes a CSV table.
+- Miss-ratio curve (command line: paged_memory --mrc <jobs_file> <trace_file>):
+    LRU fault counts for every frame count from one stack-distance pass (mrc.h).
+- Huge pages (a PageSizes line in the job file): --replay maps pages of several
+  sizes at once (huge_pages.h) and compares them with base pages only.
+- Event trace (--events <file> on --replay, --resume and --concurrent): faults,
+  evictions, allocations, read-ahead and job events with timestamps (event_log.h),
+  for event_export to turn into a timeline.
+- Shared pages (Fork and Shared lines in the job file, option 10 of the menu): a
+  forked job shares its parent's frames copy-on-write and region members share
+  the pages they read (shared_pages.h); the summary shows the memory saved.
 */
 
-struct PageRef {
-    int job_id;
-    int page_no;
-    PageRef(): job_id(-1), page_no(-1) {}
-    PageRef(int j, int p): job_id(j), page_no(p) {}
-};
-
-struct Job {
-    int id;
-    long long size; // bytes
-    int num_pages;
-    long long internal_frag; // bytes
-    vector<int> page_table; // page -> frame number or -1
-    Job(int id_=0, long long size_=0, int num_pages_=0, long long internal_frag_=0)
-        : id(id_), size(size_), num_pages(num_pages_), internal_frag(internal_frag_) {}
-};
-
 static std::mt19937 rng((unsigned)chrono::high_resolution_clock::now().time_since_epoch().count());
 
 int get_int_input(const string &prompt) {
@@ -62,6 +86,17 @@ int get_int_input(const string &prompt) {
     }
 }
 
+double get_double_input(const string &prompt) {
+    while (true) {
+        cout << prompt;
+        double v;
+        if (cin >> v) return v;
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << "Invalid input, try again.\n";
+    }
+}
+
 long long get_ll_input(const string &prompt) {
     while (true) {
         cout << prompt;
@@ -79,15 +114,190 @@ void press_enter_to_continue() {
     cin.get();
 }
 
-void show_frames(const vector<PageRef> &frames, int page_size) {
-    cout << "\nPhysical frames (frame_index -> job_id:page_no or FREE):\n";
-    for (size_t i=0;i<frames.size();++i) {
-        cout << " Frame[" << i << "] -> ";
-        if (frames[i].job_id == -1) cout << "FREE\n";
-        else cout << "Job " << frames[i].job_id << " : Page " << frames[i].page_no
-                  << "  (phys addr range " << (i*page_size) << " - " << (i*page_size + page_size - 1) << ")\n";
+// runs of frames show_frames prints before it leaves the rest to a range query
+const size_t FRAME_REPORT_RUNS = 256;
+
+// prints a run of frames as " Frames[0-9] -> Job 1 : pages 0-9 (phys addr range 0 - 999)";
+// job_id(owner) gives the id of the job with that frame-table owner index
+template <class JobIdOf>
+auto frame_run_line(long long page_size, JobIdOf job_id) {
+    return [=](ReportWriter &out, const FrameRun &r) {
+        out.printf(" Frame%s[%s] -> ", r.frames() == 1 ? "" : "s", frame_span(r.first, r.last).c_str());
+        if (r.owner == -1) { out.printf("FREE\n"); return; }
+        out.printf("Job %d : %s  (phys addr range %lld - %lld)", job_id(r.owner), run_pages(r).c_str(),
+                   r.first * page_size, (r.last + 1LL) * page_size - 1);
+        if (r.dirty == 0) out.printf("\n");
+        else if (r.frames() == 1) out.printf(" DIRTY\n");
+        else out.printf(" %d DIRTY\n", r.dirty);
+    };
+}
+
+// run-length summary of the frames, the frames of each job and a heat map
+template <class JobIdOf>
+void show_frames(const FrameTable &frames, long long page_size, JobIdOf job_id) {
+    FrameMap map;
+    map.build(frames);
+    cout.flush(); // cout is not tied to stdio here
+    ReportWriter out;
+    out.printf("\nPhysical frames (frame range -> job_id:pages or FREE):\n");
+    write_range(out, map, frames, 0, map.total - 1, FRAME_REPORT_RUNS, frame_run_line(page_size, job_id));
+    write_occupancy(out, map, [&](int owner) { return "Job " + to_string(job_id(owner)); });
+    out.printf("\n");
+}
+
+void show_frames(const DemandPager &pager) {
+    show_frames(pager.frames, pager.page_size, [&](int owner) { return pager.jobs[owner].id; });
+}
+
+// the frames of one job, or of a frame range, in full
+void query_frames(const DemandPager &pager) {
+    int jid = get_int_input("Job id (0 for a frame range): ");
+    int idx = -1, lo = 0, hi = pager.num_frames - 1;
+    if (jid != 0) {
+        idx = pager.find_job(jid);
+        if (idx == -1) { cout << "Job not found.\n"; return; }
+    } else {
+        lo = max(0, get_int_input("First frame: "));
+        hi = min(pager.num_frames - 1, get_int_input("Last frame: "));
+        if (lo > hi) { cout << "Empty frame range.\n"; return; }
+    }
+    FrameMap map;
+    map.build(pager.frames);
+    cout.flush();
+    ReportWriter out;
+    auto line = frame_run_line(pager.page_size, [&](int owner) { return pager.jobs[owner].id; });
+    if (idx != -1) {
+        out.printf("\nJob %d holds %lld frame(s) in %zu run(s):\n", jid, map.frames_of(idx), map.runs_of(idx).size());
+        write_owner(out, map, idx, SIZE_MAX, line);
+    } else {
+        out.printf("\nFrames %d-%d:\n", lo, hi);
+        write_range(out, map, pager.frames, lo, hi, SIZE_MAX, line);
+    }
+}
+
+// asks for an optional TLB; returns false if the user wants none
+bool prompt_tlb_config(TlbConfig &cfg) {
+    int entries = get_int_input("TLB entries (0 for no TLB): ");
+    if (entries <= 0) return false;
+    cfg.entries = entries;
+    cfg.ways = get_int_input("TLB associativity (ways, " + to_string(entries) + " = fully associative): ");
+    return true;
+}
+
+void print_tlb_stats(const Tlb &tlb, int page_size) {
+    const TlbConfig &cfg = tlb.config();
+    const TlbStats &st = tlb.stats;
+    cout << "TLB: " << cfg.entries << " entries, " << cfg.ways << "-way (" << tlb.sets() << " sets), "
+         << tlb_replacement_name(cfg.replacement) << ", " << (cfg.flush_on_switch ? "flush on job switch" : "ASID-tagged") << "\n"
+         << " hits " << st.hits << ", misses " << st.misses << ", hit rate " << 100.0 * st.hit_rate() << "%"
+         << ", flushes " << st.flushes << ", invalidations " << st.invalidations << "\n"
+         << " reach " << tlb.reach(page_size) << " bytes, effective access time " << tlb.effective_access_time()
+         << " ns (TLB " << cfg.tlb_latency << " ns, memory " << cfg.memory_latency << " ns)\n";
+}
+
+// asks for the resident-set scope of the demand-paged mode
+ResidentSetConfig prompt_resident_set() {
+    ResidentSetConfig cfg;
+    while (true) {
+        cout << "Frame allocation scope (global, local, ws, pff): ";
+        string scope;
+        cin >> scope;
+        if (parse_resident_set(scope, cfg)) break;
+        cout << "Unknown scope, try again.\n";
+    }
+    if (cfg.scope == ResidentScope::WORKING_SET) {
+        cfg.tau = max(1LL, get_ll_input("Working-set window tau (references of the job): "));
+    } else if (cfg.scope == ResidentScope::PFF) {
+        cfg.window = max(1LL, get_ll_input("PFF window (references of the job): "));
+        cfg.low = get_double_input("Shrink below fault rate (faults per reference, e.g. 0.01): ");
+        cfg.high = get_double_input("Grow above fault rate (e.g. 0.05): ");
+    }
+    if (cfg.scope == ResidentScope::WORKING_SET || cfg.scope == ResidentScope::PFF) {
+        cout << "Suspend jobs while memory is overcommitted? (y/n): ";
+        char c; cin >> c;
+        cfg.load_control = (c == 'y' || c == 'Y');
+    }
+    return cfg;
+}
+
+// resident-set scope, per-job quotas and suspensions, and the resident set
+// sizes sampled over the run
+void print_resident_sets(const DemandPager &pager) {
+    const ResidentSetConfig &rs = pager.rs;
+    printf("Resident sets: %s", resident_scope_name(rs.scope));
+    if (rs.scope == ResidentScope::WORKING_SET) printf(" (tau %lld)", rs.tau);
+    if (rs.scope == ResidentScope::PFF) printf(" (window %lld, fault rate %.4f..%.4f)", rs.window, rs.low, rs.high);
+    if (rs.load_control) printf(", load control on (quantum %lld)\n", rs.quantum);
+    else printf(", load control off\n");
+    printf("%-8s %10s %10s %12s %12s\n", "job", "resident", "quota", "suspensions", "deferred");
+    for (size_t i = 0; i < pager.jobs.size(); ++i) {
+        const JobStats &st = pager.stats[i];
+        const JobResidentState &s = pager.rs_state[i];
+        printf("%-8d %10lld ", pager.jobs[i].id, st.resident);
+        if (rs.scope == ResidentScope::LOCAL || rs.scope == ResidentScope::PFF) printf("%10lld", s.quota);
+        else printf("%10s", "-");
+        printf(" %12lld %12lld%s\n", st.suspensions, st.deferred, s.suspended ? "  (suspended)" : "");
+    }
+    const ResidentTimeline &tl = pager.timeline;
+    if (tl.at.empty()) return;
+    printf("Resident set size over time:\n%14s", "reference");
+    for (const Job &job : pager.jobs) printf(" %8d", job.id);
+    printf("\n");
+    for (size_t s = 0; s < tl.at.size(); ++s) {
+        printf("%14lld", tl.at[s]);
+        for (long long r : tl.resident[s]) printf(" %8lld", r);
+        printf("\n");
+    }
+}
+
+// read-ahead pages per job: accuracy is the share of them referenced before
+// eviction, coverage the share of would-be faults they absorbed
+void print_readahead(const DemandPager &pager) {
+    printf("Read-ahead: window %lld..%lld pages\n", pager.ra.min_window, pager.ra.max_window);
+    printf("%-8s %12s %12s %12s %10s %10s\n", "job", "prefetched", "used", "wasted", "accuracy", "coverage");
+    auto row = [](const char *name, const JobStats &st) {
+        double accuracy = st.prefetched ? 100.0 * st.prefetch_hits / st.prefetched : 0.0;
+        long long wanted = st.prefetch_hits + st.faults;
+        double coverage = wanted ? 100.0 * st.prefetch_hits / wanted : 0.0;
+        printf("%-8s %12lld %12lld %12lld %9.2f%% %9.2f%%\n", name, st.prefetched, st.prefetch_hits, st.prefetch_wasted, accuracy, coverage);
+    };
+    for (size_t i = 0; i < pager.jobs.size(); ++i) row(to_string(pager.jobs[i].id).c_str(), pager.stats[i]);
+    row("total", pager.total());
+}
+
+// swap traffic, write-back behaviour and the effective access time
+void print_swap(const DemandPager &pager) {
+    const SwapDevice &dev = pager.swap;
+    const SwapStats &st = dev.stats;
+    printf("Swap: %.0f us latency, %.0f MB/s, %d write buffers", dev.cfg.latency_us, dev.cfg.bandwidth_mb, dev.cfg.queue_depth);
+    if (dev.cfg.clean_every > 0) printf(", cleaner %d pages every %lld references", dev.cfg.clean_batch, dev.cfg.clean_every);
+    if (dev.cfg.prefer_clean > 0)
+        printf(", clean victims within %d%s", dev.cfg.prefer_clean, pager.policy->honours_clean() ? "" : " (not used by this policy)");
+    long long evictions = st.clean_evictions + st.dirty_evictions;
+    printf("\n %-22s %12lld   %-22s %12lld\n", "clean evictions", st.clean_evictions, "dirty evictions", st.dirty_evictions);
+    printf(" %-22s %11.2f%%   %-22s %12lld\n", "dirty share", evictions ? 100.0 * st.dirty_evictions / evictions : 0.0,
+           "cleaner writes", st.cleaner_writes);
+    printf(" %-22s %12.2f   %-22s %12.2f\n", "MB read", dev.bytes_read(pager.page_size) / 1e6, "MB written",
+           dev.bytes_written(pager.page_size) / 1e6);
+    printf(" %-22s %12lld   %-22s %12.3f\n", "write stalls", st.write_stalls, "stall ms", st.write_wait_ns / 1e6);
+    printf(" %-22s %12.3f   %-22s %12.3f\n", "fault read wait ms", st.read_wait_ns / 1e6, "simulated ms", dev.now / 1e6);
+    printf("Effective access time: %.2f ns (memory %.2f ns)\n", dev.effective_access_time(pager.references), dev.cfg.memory_ns);
+}
+
+// frames mapped by more than one page, the memory that saves, and what the
+// copy-on-write faults cost each job
+void print_sharing(const DemandPager &pager) {
+    const ReverseMap &rmap = pager.rmap;
+    long long shared = 0;
+    for (int f = 0; f < pager.num_frames; ++f) shared += rmap.shared(f);
+    printf("Sharing: %lld shared frames; saves %lld frames (%lld KB) now, %lld frames (%lld KB) at peak\n", shared,
+           rmap.saved(), rmap.saved() * pager.page_size / 1024, rmap.peak_saved(), rmap.peak_saved() * pager.page_size / 1024);
+    printf(" %-8s %12s %12s %12s %10s %12s\n", "job", "resident", "shared maps", "COW faults", "COW/ref", "COW/faults");
+    for (size_t i = 0; i < pager.jobs.size(); ++i) {
+        const JobStats &st = pager.stats[i];
+        printf(" %-8d %12lld %12lld %12lld %9.3f%% %11.2f%%\n", pager.jobs[i].id, st.resident, st.shared_maps, st.cow_faults,
+               st.references ? 100.0 * st.cow_faults / st.references : 0.0, st.faults ? 100.0 * st.cow_faults / st.faults : 0.0);
     }
-    cout << endl;
 }
 
 void mode_paged_single_job() {
@@ -99,29 +309,13 @@ void mode_paged_single_job() {
         cout << "Invalid values.\n"; return;
     }
 
-    int num_pages = (int)((job_size + page_size - 1) / page_size);
-    long long last_page_used = job_size % page_size;
-    long long internal_frag = (last_page_used == 0 || num_pages==0) ? 0 : (page_size - last_page_used);
-
-    Job job(1, job_size, num_pages, internal_frag);
-    job.page_table.assign(num_pages, -1);
-
-    vector<PageRef> frames(num_frames, PageRef());
-
-    // Randomly load pages into frames 
-    vector<int> pages(num_pages);
-    iota(pages.begin(), pages.end(), 0);
-    shuffle(pages.begin(), pages.end(), rng);
-    int loaded = 0;
-    for (int p : pages) {
-        // find a free frame
-        int free_idx = -1;
-        for (int i=0;i<num_frames;++i) if (frames[i].job_id == -1) { free_idx = i; break; }
-        if (free_idx == -1) break;
-        frames[free_idx] = PageRef(job.id, p);
-        job.page_table[p] = free_idx;
-        ++loaded;
-    }
+    // Randomly load pages into frames; they stay there (no replacement) and nothing is counted
+    SimCore<NoReplacement, 0, true, false> core(page_size, num_frames, rng());
+    int idx = core.add_job(1, job_size);
+    Job &job = core.jobs[idx];
+    long long num_pages = job.num_pages;
+    long long internal_frag = job.internal_frag;
+    int loaded = core.preload(idx);
 
     // Output summary
     cout << "\nJob summary:\n";
@@ -132,7 +326,10 @@ void mode_paged_single_job() {
     cout << " Internal fragmentation (in last page): " << internal_frag << " bytes\n";
     cout << " Pages loaded into memory: " << loaded << " / " << num_pages << "\n";
 
-    show_frames(frames, page_size);
+    show_frames(core.mem.frames, page_size, [&](int owner) { return core.jobs[owner].id; });
+
+    TlbConfig tlb_cfg;
+    if (prompt_tlb_config(tlb_cfg)) core.enable_tlb(tlb_cfg);
 
     // Allow address resolution queries
     while (true) {
@@ -144,17 +341,17 @@ void mode_paged_single_job() {
             cout << "Logical address out of range (0 .. " << job_size-1 << ").\n";
             continue;
         }
-        int page_no = (int)(logical_addr / page_size);
-        int offset = (int)(logical_addr % page_size);
-        int frame_no = job.page_table[page_no];
-        if (frame_no == -1) {
-            cout << "Page " << page_no << " is NOT loaded into memory. (No demand paging in this mode)\n";
+        CoreAccess a = core.translate(idx, logical_addr);
+        if (core.tlb) cout << (a.tlb_hit ? "TLB hit. " : "TLB miss. ");
+        if (a.frame == -1) {
+            cout << "Page " << a.page << " is NOT loaded into memory. (No demand paging in this mode)\n";
         } else {
-            long long physical_addr = (long long)frame_no * page_size + offset;
-            cout << "Logical address " << logical_addr << " => Page " << page_no << ", Offset " << offset
-                 << ". Physical frame " << frame_no << ". Physical address = " << physical_addr << ".\n";
+            long long physical_addr = (long long)a.frame * page_size + a.offset;
+            cout << "Logical address " << logical_addr << " => Page " << a.page << ", Offset " << a.offset
+                 << ". Physical frame " << a.frame << ". Physical address = " << physical_addr << ".\n";
         }
     }
+    if (core.tlb) print_tlb_stats(*core.tlb, page_size);
     cout << "Exiting single-job paged mode.\n";
 }
 
@@ -166,29 +363,58 @@ void mode_demand_multiple_jobs() {
         cout << "Invalid values.\n"; return;
     }
 
+    string policy_name;
+    while (true) {
+        cout << "Replacement policy (random, fifo, lru, clock, lfu, arc): ";
+        cin >> policy_name;
+        if (policy_name != "opt" && make_policy(policy_name, 0)) break;
+        cout << "Unknown policy" << (policy_name == "opt" ? " (opt needs a trace, use --replay)" : "") << ", try again.\n";
+    }
+
+    ResidentSetConfig rs_cfg = prompt_resident_set();
+    ReadAheadConfig ra_cfg;
+    if (rs_cfg.scope == ResidentScope::GLOBAL) {
+        long long window = get_ll_input("Largest read-ahead window in pages (0 = no read-ahead): ");
+        if (window > 0) {
+            ra_cfg.enabled = true;
+            ra_cfg.max_window = window;
+            ra_cfg.min_window = min(ra_cfg.min_window, window);
+        }
+    }
+
+    TlbConfig tlb_cfg;
+    bool use_tlb = prompt_tlb_config(tlb_cfg);
+
+    SwapConfig swap_cfg;
+    double latency = get_double_input("Swap device latency in microseconds (0 = no swap model): ");
+    if (latency > 0) {
+        swap_cfg.enabled = true;
+        swap_cfg.latency_us = latency;
+        swap_cfg.bandwidth_mb = max(1.0, get_double_input("Swap device bandwidth (MB/s): "));
+        swap_cfg.prefer_clean = max(0, get_int_input("Frames to search for a clean victim (0 = off): "));
+        swap_cfg.memory_ns = tlb_cfg.memory_latency;
+    }
+
     int job_count = get_int_input("How many jobs will you create? ");
     if (job_count <= 0) { cout << "No jobs to do.\n"; return; }
+    if (job_count > FrameTable::MAX_OWNER + 1) { cout << "At most " << FrameTable::MAX_OWNER + 1 << " jobs.\n"; return; }
 
-    vector<Job> jobs;
+    DemandPager pager(page_size, num_frames, rng(), policy_name);
+    if (use_tlb) pager.enable_tlb(tlb_cfg);
+    pager.enable_resident_sets(rs_cfg);
+    pager.enable_readahead(ra_cfg);
+    if (swap_cfg.enabled) pager.enable_swap(swap_cfg);
+    vector<Job> &jobs = pager.jobs;
     jobs.reserve(job_count + 1);
     for (int i=1;i<=job_count;++i) {
         long long jsize = get_ll_input("Enter size for Job " + to_string(i) + " (bytes): ");
         if (jsize < 0) { cout << "Invalid size, setting to 0.\n"; jsize = 0; }
-        int np = (int)((jsize + page_size - 1) / page_size);
-        long long last_used = jsize % page_size;
-        long long frag = (last_used == 0 || np==0) ? 0 : (page_size - last_used);
-        Job job(i, jsize, np, frag);
-        job.page_table.assign(np, -1);
-        jobs.push_back(move(job));
+        pager.add_job(i, jsize);
     }
 
-    vector<PageRef> frames(num_frames, PageRef());
     // frames initially free
-    unordered_map<int,int> job_index; // job_id 
-    for (int i=0;i<jobs.size();++i) job_index[jobs[i].id] = i;
-
     cout << "\nInitial state: all frames FREE.\n";
-    show_frames(frames, page_size);
+    show_frames(pager);
 
     // interactive loop: commands to load pages randomly
     while (true) {
@@ -197,100 +423,1313 @@ void mode_demand_multiple_jobs() {
              << " 2) Resolve logical address (may cause page fault & load)\n"
              << " 3) Show page tables\n"
              << " 4) Show frames\n"
-             << " 5) Quit\n"
+             << " 5) Terminate a job (free its frames)\n"
+             << " 6) Quit\n"
+             << " 7) Save a checkpoint of the simulation\n"
+             << " 8) Restore a checkpoint (replaces the current simulation)\n"
+             << " 9) Show the frames of one job or of a frame range\n"
+             << "10) Fork a job (the child shares its pages copy-on-write)\n"
              << "Choose option: ";
         int opt; cin >> opt;
         if (opt == 1) {
             int jid = get_int_input("Job id to pre-load pages for: ");
-            if (!job_index.count(jid)) { cout << "Job not found.\n"; continue; }
-            Job &job = jobs[job_index[jid]];
-            vector<int> pages(job.num_pages);
-            iota(pages.begin(), pages.end(), 0);
-            shuffle(pages.begin(), pages.end(), rng);
-            int loaded=0;
-            for (int p: pages) {
-                // find free frame
-                int free_idx=-1;
-                for (int i=0;i<num_frames;++i) if (frames[i].job_id == -1) { free_idx = i; break; }
-                if (free_idx == -1) break;
-                frames[free_idx] = PageRef(job.id, p);
-                job.page_table[p] = free_idx;
-                loaded++;
-            }
+            int idx = pager.find_job(jid);
+            if (idx == -1) { cout << "Job not found.\n"; continue; }
+            int loaded = pager.preload(idx);
             cout << "Preloaded " << loaded << " pages for job " << jid << " (random assignment until memory full or job done).\n";
-            show_frames(frames, page_size);
+            show_frames(pager);
         } else if (opt == 2) {
             int jid = get_int_input("Enter job id for address resolution: ");
-            if (!job_index.count(jid)) { cout << "Job not found.\n"; continue; }
-            Job &job = jobs[job_index[jid]];
+            int idx = pager.find_job(jid);
+            if (idx == -1) { cout << "Job not found.\n"; continue; }
+            Job &job = jobs[idx];
             long long logical_addr = get_ll_input("Enter logical address (byte offset from job start): ");
             if (logical_addr < 0 || logical_addr >= job.size) {
                 cout << "Logical address out of range (0 .. " << max(0LL, job.size-1) << ").\n";
                 continue;
             }
-            int page_no = (int)(logical_addr / page_size);
+            string kind;
+            cout << "Read or write? (r/w): ";
+            cin >> kind;
+            bool write = !kind.empty() && (kind[0] == 'w' || kind[0] == 'W');
+            long long page_no = logical_addr / page_size;
             int offset = (int)(logical_addr % page_size);
-            int frame_no = job.page_table[page_no];
-            if (frame_no != -1) {
-                long long physical_addr = (long long)frame_no * page_size + offset;
+            int shared_frame = job.page_table[page_no]; // a fault on a resident page is a COW copy
+            AccessResult r = pager.access_page(idx, page_no, NEVER_USED, write);
+            if (r.deferred) {
+                cout << "Job " << jid << " is suspended (memory overcommitted); reference queued until it is readmitted.\n";
+                continue;
+            }
+            if (pager.tlb) cout << (r.tlb_hit ? "TLB hit. " : "TLB miss. ");
+            if (!r.fault) {
+                long long physical_addr = (long long)r.frame * page_size + offset;
                 cout << "Page present. Logical address " << logical_addr << " => Page " << page_no
-                     << ", Offset " << offset << " -> Physical frame " << frame_no
+                     << ", Offset " << offset << " -> Physical frame " << r.frame
                      << " -> Physical address " << physical_addr << ".\n";
             } else {
-                cout << "Page fault: Page " << page_no << " of Job " << jid << " is not in memory.\n";
-                // try to find free frame
-                int free_idx = -1;
-                for (int i=0;i<num_frames;++i) if (frames[i].job_id == -1) { free_idx = i; break; }
-                if (free_idx != -1) {
-                    cout << "Loading page into free frame " << free_idx << ".\n";
-                    frames[free_idx] = PageRef(job.id, page_no);
-                    job.page_table[page_no] = free_idx;
+                if (shared_frame != -1)
+                    cout << "Copy-on-write fault: Page " << page_no << " of Job " << jid << " shares frame " << shared_frame
+                         << " with another job; the write gets a copy.\n";
+                else
+                    cout << "Page fault: Page " << page_no << " of Job " << jid << " is not in memory.\n";
+                if (r.victim == -1) {
+                    cout << "Loading page into free frame " << r.frame << ".\n";
                 } else {
-                    cout << "No free frames. Evicting a random frame (random replacement).\n";
-                    uniform_int_distribution<int> dist(0, num_frames-1);
-                    int victim = dist(rng);
-                    PageRef victimRef = frames[victim];
-                    cout << " Evicting frame " << victim << ": Job " << victimRef.job_id << " Page " << victimRef.page_no << ".\n";
-                    // update victim's page table
-                    if (victimRef.job_id != -1) {
-                        int vjid = victimRef.job_id;
-                        int vpage = victimRef.page_no;
-                        if (job_index.count(vjid)) {
-                            jobs[job_index[vjid]].page_table[vpage] = -1;
-                        }
-                    }
-                    // load new page
-                    frames[victim] = PageRef(job.id, page_no);
-                    job.page_table[page_no] = victim;
-                    cout << " Loaded Job " << job.id << " Page " << page_no << " into frame " << victim << ".\n";
+                    if (r.evicted.job_id == jid && pager.rs.scope != ResidentScope::GLOBAL)
+                        cout << "Job at its resident-set limit. Replacing its least recently used page.\n";
+                    else
+                        cout << "No free frames. Evicting a frame chosen by " << pager.policy->name() << " replacement.\n";
+                    cout << " Evicting frame " << r.victim << ": Job " << r.evicted.job_id << " Page " << r.evicted.page_no
+                         << (r.written_back ? " (dirty, written back to swap).\n" : " (clean, dropped).\n");
+                    cout << " Loaded Job " << job.id << " Page " << page_no << " into frame " << r.frame << ".\n";
                 }
-                int new_frame = job.page_table[page_no];
-                long long physical_addr = (long long)new_frame * page_size + offset;
-                cout << "Now resolved: Physical frame " << new_frame << ", physical address = " << physical_addr << ".\n";
+                long long physical_addr = (long long)r.frame * page_size + offset;
+                cout << "Now resolved: Physical frame " << r.frame << ", physical address = " << physical_addr << ".\n";
             }
+            if (r.prefetched)
+                cout << "Sequential access detected: read ahead " << r.prefetched << " page(s) (stride "
+                     << pager.ra_state[idx].stride << ").\n";
         } else if (opt == 3) {
-            cout << "\nPage tables (page -> frame or -1 if not loaded):\n";
+            cout << "\nPage tables (resident page -> frame; pages not listed are not loaded):\n";
             for (auto &job : jobs) {
+                if (pager.find_job(job.id) == -1) continue; // terminated
                 cout << " Job " << job.id << " (size " << job.size << " bytes, pages " << job.num_pages
-                     << ", internal_frag " << job.internal_frag << "):\n  ";
-                for (int p=0;p<job.num_pages;++p) {
-                    cout << "[" << p << "->" << job.page_table[p] << "]";
-                    if (p+1 < job.num_pages) cout << " ";
-                }
+                     << ", internal_frag " << job.internal_frag << ", resident " << job.page_table.resident()
+                     << ", table " << job.page_table.memory_bytes() << " bytes in " << job.page_table.depth() << " level(s)";
+                const JobResidentState &s = pager.rs_state[&job - &jobs[0]];
+                if (pager.rs.scope == ResidentScope::LOCAL || pager.rs.scope == ResidentScope::PFF) cout << ", quota " << s.quota;
+                if (s.suspended) cout << ", SUSPENDED";
+                cout << "):\n  ";
+                bool first = true;
+                job.page_table.for_each_mapped([&](long long p, int f) {
+                    if (!first) cout << " ";
+                    cout << "[" << p << "->" << f << "]";
+                    first = false;
+                });
                 cout << "\n";
             }
         } else if (opt == 4) {
-            show_frames(frames, page_size);
+            show_frames(pager);
         } else if (opt == 5) {
+            int jid = get_int_input("Job id to terminate: ");
+            int idx = pager.find_job(jid);
+            if (idx == -1) { cout << "Job not found.\n"; continue; }
+            int freed = pager.terminate_job(idx);
+            cout << "Job " << jid << " terminated, " << freed << " frame(s) returned to the free pool.\n";
+            show_frames(pager);
+        } else if (opt == 6) {
+            if (pager.tlb) print_tlb_stats(*pager.tlb, page_size);
+            if (pager.rs.scope != ResidentScope::GLOBAL || pager.ra.enabled || pager.swap.cfg.enabled || pager.rmap.active()) {
+                cout.flush();
+                if (pager.rs.scope != ResidentScope::GLOBAL) print_resident_sets(pager);
+                if (pager.ra.enabled) print_readahead(pager);
+                if (pager.swap.cfg.enabled) print_swap(pager);
+                if (pager.rmap.active()) print_sharing(pager);
+                fflush(stdout);
+            }
             cout << "Quitting demand-paged simulation.\n";
             break;
+        } else if (opt == 7) {
+            cout << "Checkpoint file: ";
+            string file;
+            cin >> file;
+            if (pager.save_checkpoint(file)) cout << "Saved " << pager.jobs.size() << " job(s) and " << num_frames << " frames to " << file << ".\n";
+            else cout << "Could not write " << file << ".\n";
+        } else if (opt == 8) {
+            cout << "Checkpoint file: ";
+            string file;
+            cin >> file;
+            if (!pager.restore_checkpoint(file)) { cout << "Could not restore " << file << ".\n"; continue; }
+            page_size = pager.page_size;
+            num_frames = pager.num_frames;
+            cout << "Restored " << pager.jobs.size() << " job(s), " << num_frames << " frames of " << page_size
+                 << " bytes, " << pager.policy->name() << " replacement.\n";
+            show_frames(pager);
+        } else if (opt == 9) {
+            query_frames(pager);
+        } else if (opt == 10) {
+            int jid = get_int_input("Job id to fork: ");
+            int idx = pager.find_job(jid);
+            if (idx == -1) { cout << "Job not found.\n"; continue; }
+            int cid = get_int_input("Id of the new job: ");
+            int child = pager.fork_job(idx, cid);
+            if (child == -1) {
+                if (pager.rs.scope != ResidentScope::GLOBAL) cout << "Forking needs the global resident-set scope.\n";
+                else cout << "Job id " << cid << " is already in use.\n";
+                continue;
+            }
+            cout << "Job " << cid << " forked from job " << jid << ", sharing " << pager.stats[child].resident
+                 << " resident page(s) copy-on-write.\n";
+            show_frames(pager);
         } else {
             cout << "Invalid option.\n";
         }
     }
 }
 
-int main() {
+/*
+ * job-definition file for batch replay:
+ *   PageSize <bytes>
+ *   Frames <count>
+ *   Job <id> <size_in_bytes>
+ *   ...
+ * optional:
+ *   Tlb <entries> <ways> [lru|fifo|random] [asid|flush]
+ *   Latency <tlb_ns> <memory_ns>
+ *   PageTableLevels <1-4>        (default: picked from each job's size)
+ *   ResidentSet global | local | ws <tau> | pff <window> <low> <high>
+ *   LoadControl on|off [quantum] (ws and pff: suspend jobs while memory is overcommitted)
+ *   ReadAhead on [min [max]] | off  (read-ahead window in pages, global scope only)
+ *   PageSizes <bytes> <bytes> ...   (several page sizes; the smallest is PageSize)
+ *   HugePages never | always | promote [pct]
+ *   HugeTlb <page_bytes> <entries> <ways>
+ *   Swap <latency_us> <MB_per_s> [write_buffers]  (times page I/O; see swap_device.h)
+ *   Cleaner <every_references> [pages]          (background write-back, needs Swap)
+ *   PreferClean <window>                        (skip dirty victims, needs Swap)
+ *   Fork <child_id> <parent_id> <at_record>     (after at_record trace records the child starts
+ *                                                as a copy-on-write copy of the parent)
+ *   Shared <bytes> <job_id> <job_id> ...        (the jobs' first bytes are one memory)
+ * blank lines and lines starting with '#' are ignored
+ */
+struct ReplayConfig {
+    int page_size = 0;
+    int num_frames = 0;
+    vector<pair<int,long long>> job_defs;
+    bool use_tlb = false;
+    TlbConfig tlb;
+    int pt_levels = 0;
+    ResidentSetConfig rs;
+    ReadAheadConfig ra;
+    HugePageConfig huge;                           // sizes empty unless PageSizes is given
+    unordered_map<long long, pair<int,int>> huge_tlb; // page size -> TLB entries, ways
+    SwapConfig swap;
+    vector<ForkPoint> forks;                       // sorted by trace position
+    vector<pair<long long,vector<int>>> shared;    // region bytes, member job ids
+};
+
+bool load_job_file(const string &filename, ReplayConfig &cfg) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error: Could not open file " << filename << endl;
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        stringstream ss(line);
+        string key;
+        ss >> key;
+        if (key == "PageSize") ss >> cfg.page_size;
+        else if (key == "Frames") ss >> cfg.num_frames;
+        else if (key == "Job") {
+            int id; long long size;
+            if (ss >> id >> size) cfg.job_defs.push_back({id, size});
+        } else if (key == "Tlb") {
+            cfg.use_tlb = true;
+            ss >> cfg.tlb.entries >> cfg.tlb.ways;
+            string word;
+            while (ss >> word) {
+                if (word == "flush") cfg.tlb.flush_on_switch = true;
+                else if (word == "asid") cfg.tlb.flush_on_switch = false;
+                else if (!parse_tlb_replacement(word, cfg.tlb.replacement))
+                    cerr << "Warning: unknown TLB option '" << word << "' ignored.\n";
+            }
+        } else if (key == "PageTableLevels") {
+            ss >> cfg.pt_levels;
+        } else if (key == "ResidentSet") {
+            string spec;
+            getline(ss, spec);
+            if (!parse_resident_set(spec, cfg.rs)) {
+                cerr << "Error: unknown ResidentSet '" << spec << "' in " << filename << ".\n";
+                return false;
+            }
+        } else if (key == "LoadControl") {
+            string word;
+            ss >> word;
+            cfg.rs.load_control = (word == "on");
+            long long quantum;
+            if (ss >> quantum && quantum > 0) cfg.rs.quantum = quantum;
+        } else if (key == "ReadAhead") {
+            string spec;
+            getline(ss, spec);
+            if (!parse_readahead(spec, cfg.ra)) {
+                cerr << "Error: bad ReadAhead '" << spec << "' in " << filename << ".\n";
+                return false;
+            }
+        } else if (key == "Latency") {
+            ss >> cfg.tlb.tlb_latency >> cfg.tlb.memory_latency;
+        } else if (key == "PageSizes") {
+            long long size;
+            while (ss >> size) cfg.huge.sizes.push_back(size);
+            if (!valid_page_sizes(cfg.huge.sizes)) {
+                cerr << "Error: PageSizes must be powers of two times the smallest in " << filename << ".\n";
+                return false;
+            }
+        } else if (key == "HugePages") {
+            string spec;
+            getline(ss, spec);
+            if (!parse_huge_page_mode(spec, cfg.huge)) {
+                cerr << "Error: bad HugePages '" << spec << "' in " << filename << ".\n";
+                return false;
+            }
+        } else if (key == "HugeTlb") {
+            long long size;
+            int entries, ways;
+            if (ss >> size >> entries >> ways) cfg.huge_tlb[size] = {entries, ways};
+        } else if (key == "Swap") {
+            string spec;
+            getline(ss, spec);
+            if (!parse_swap(spec, cfg.swap)) {
+                cerr << "Error: bad Swap '" << spec << "' in " << filename << ".\n";
+                return false;
+            }
+        } else if (key == "Cleaner") {
+            ss >> cfg.swap.clean_every;
+            int batch;
+            if (ss >> batch && batch > 0) cfg.swap.clean_batch = batch;
+        } else if (key == "PreferClean") {
+            ss >> cfg.swap.prefer_clean;
+        } else if (key == "Fork") {
+            ForkPoint fork;
+            if (ss >> fork.child_id >> fork.parent_id >> fork.at) cfg.forks.push_back(fork);
+        } else if (key == "Shared") {
+            long long bytes;
+            int id;
+            vector<int> ids;
+            ss >> bytes;
+            while (ss >> id) ids.push_back(id);
+            if (bytes > 0 && ids.size() > 1) cfg.shared.push_back({bytes, ids});
+        }
+    }
+    if (!cfg.huge.sizes.empty()) {
+        if (cfg.page_size > 0 && cfg.page_size != cfg.huge.sizes[0]) {
+            cerr << "Error: PageSize must be the smallest of PageSizes in " << filename << ".\n";
+            return false;
+        }
+        cfg.page_size = (int)cfg.huge.sizes[0];
+    }
+    if (cfg.page_size <= 0 || cfg.num_frames <= 0) {
+        cerr << "Error: PageSize and Frames must be set to positive values in " << filename << ".\n";
+        return false;
+    }
+    if (cfg.job_defs.size() + cfg.forks.size() > (size_t)FrameTable::MAX_OWNER + 1) {
+        cerr << "Error: more than " << FrameTable::MAX_OWNER + 1 << " jobs and forks in " << filename << ".\n";
+        return false;
+    }
+    if (cfg.ra.enabled && cfg.rs.scope != ResidentScope::GLOBAL)
+        cerr << "Warning: ReadAhead only applies with ResidentSet global; ignored.\n";
+    if (!cfg.swap.enabled && (cfg.swap.clean_every > 0 || cfg.swap.prefer_clean > 0))
+        cerr << "Warning: Cleaner and PreferClean need a Swap line; ignored.\n";
+    cfg.swap.memory_ns = cfg.tlb.memory_latency;
+    if (!cfg.forks.empty() || !cfg.shared.empty()) {
+        if (cfg.rs.scope != ResidentScope::GLOBAL) {
+            cerr << "Warning: Fork and Shared only apply with ResidentSet global; ignored.\n";
+            cfg.forks.clear();
+            cfg.shared.clear();
+        }
+        stable_sort(cfg.forks.begin(), cfg.forks.end(), [](const ForkPoint &a, const ForkPoint &b) { return a.at < b.at; });
+        unordered_map<int,int> known; // job id -> 0 for a Job line, 1 for a forked child
+        for (auto &d : cfg.job_defs) known[d.first] = 0;
+        for (const ForkPoint &fork : cfg.forks) {
+            if (known.count(fork.child_id) || !known.count(fork.parent_id) || fork.at < 0) {
+                cerr << "Error: Fork " << fork.child_id << " " << fork.parent_id << " in " << filename
+                     << " needs a new child id, a parent defined before it and a trace position >= 0.\n";
+                return false;
+            }
+            known[fork.child_id] = 1;
+        }
+        unordered_map<int,int> member;
+        for (auto &region : cfg.shared) {
+            for (int id : region.second) {
+                auto it = known.find(id);
+                if (it == known.end() || it->second != 0 || member.count(id)) {
+                    cerr << "Error: Shared job " << id << " in " << filename
+                         << " must be a Job in at most one region (forked jobs join their parent's).\n";
+                    return false;
+                }
+                member[id] = 1;
+            }
+        }
+    }
+    return true;
+}
+
+// sharing is only modelled by DemandPager; the other engines run without it
+void warn_no_sharing(const ReplayConfig &cfg, const char *mode) {
+    if (!cfg.forks.empty() || !cfg.shared.empty()) cerr << "Warning: Fork and Shared are ignored " << mode << ".\n";
+}
+
+// prints the end-of-run summary of a replay
+void print_replay_summary(const DemandPager &pager, long long invalid, double seconds) {
+    long long refs = 0, faults = 0, evictions = 0;
+    printf("\nPolicy: %s\n", pager.policy->name());
+    printf("%-8s %14s %12s %12s %10s\n", "job", "references", "faults", "evictions", "fault%");
+    for (size_t i=0;i<pager.jobs.size();++i) {
+        const JobStats &st = pager.stats[i];
+        double rate = st.references ? 100.0 * st.faults / st.references : 0.0;
+        printf("%-8d %14lld %12lld %12lld %9.3f%%\n", pager.jobs[i].id, st.references, st.faults, st.evictions, rate);
+        refs += st.references; faults += st.faults; evictions += st.evictions;
+    }
+    double rate = refs ? 100.0 * faults / refs : 0.0;
+    printf("%-8s %14lld %12lld %12lld %9.3f%%\n", "total", refs, faults, evictions, rate);
+    printf("Frame table: %d frames, %lld bytes\n", pager.frames.size(), pager.frames.memory_bytes());
+    printf("Page tables:\n");
+    for (const Job &job : pager.jobs) {
+        const PageTable &pt = job.page_table;
+        printf(" job %-6d %d level(s), %lld resident of %lld pages, %lld bytes (dense: %lld bytes)\n",
+               job.id, pt.depth(), pt.resident(), job.num_pages, pt.memory_bytes(), PageTable::dense_bytes(job.num_pages));
+    }
+    if (pager.rs.scope != ResidentScope::GLOBAL) print_resident_sets(pager);
+    if (pager.ra.enabled) print_readahead(pager);
+    if (pager.swap.cfg.enabled) print_swap(pager);
+    if (pager.rmap.active()) print_sharing(pager);
+    printf("Invalid references skipped: %lld\n", invalid);
+    printf("Replay time: %.3f s (%.2f M references/s)\n", seconds, seconds > 0 ? refs / seconds / 1e6 : 0.0);
+    if (pager.tlb) {
+        fflush(stdout);
+        print_tlb_stats(*pager.tlb, pager.page_size);
+        cout.flush();
+    }
+}
+
+// a validated trace entry held in memory for multi-policy runs
+struct ResolvedRef {
+    int job_idx;
+    long long page_no;
+    bool write;
+};
+
+// splits "lru,clock" (or "all") into policy names; false on an unknown name
+bool parse_policy_list(const string &arg, vector<string> &policies) {
+    if (arg == "all") { policies = policy_names(); return true; }
+    stringstream ss(arg);
+    string name;
+    while (getline(ss, name, ',')) {
+        if (!make_policy(name, 0)) {
+            cerr << "Error: unknown replacement policy '" << name << "'.\n";
+            return false;
+        }
+        policies.push_back(name);
+    }
+    return !policies.empty();
+}
+
+// a fresh engine for one run over the jobs of a replay configuration
+unique_ptr<DemandPager> build_pager(const ReplayConfig &cfg, int page_size, int num_frames, const string &policy, unsigned seed) {
+    unique_ptr<DemandPager> pager(new DemandPager(page_size, num_frames, seed, policy));
+    if (cfg.use_tlb) pager->enable_tlb(cfg.tlb);
+    pager->pt_levels = cfg.pt_levels;
+    pager->enable_resident_sets(cfg.rs);
+    pager->enable_readahead(cfg.ra);
+    if (cfg.swap.enabled) pager->enable_swap(cfg.swap);
+    for (auto &d : cfg.job_defs) pager->add_job(d.first, max(0LL, d.second));
+    for (auto &region : cfg.shared) {
+        vector<int> idxs;
+        for (int id : region.second) idxs.push_back(pager->find_job(id));
+        pager->share_region(idxs, (region.first + page_size - 1) / page_size);
+    }
+    pager->forks = cfg.forks;
+    return pager;
+}
+
+// next_use[i] = position of the next reference to the same page (OPT lookahead);
+// key_of(i) gives the page_key of reference i
+template <class KeyOf>
+vector<long long> compute_next_use(size_t n, KeyOf key_of) {
+    vector<long long> next_use(n, NEVER_USED);
+    unordered_map<uint64_t,long long> seen;
+    for (long long i = (long long)n - 1; i >= 0; --i) {
+        auto it = seen.find(key_of((size_t)i));
+        if (it != seen.end()) { next_use[i] = it->second; it->second = i; }
+        else seen.emplace(key_of((size_t)i), i);
+    }
+    return next_use;
+}
+
+// opens the --events file, if one was given; false after an error message
+bool open_event_log(EventLog &log, const string &file) {
+    if (file.empty() || log.open(file)) return true;
+    cerr << "Error: Could not create file " << file << endl;
+    return false;
+}
+
+// finishes the --events file and says what went into it
+void close_event_log(EventLog &log, const string &file) {
+    if (!log.is_open()) return;
+    log.close();
+    printf("Events: %llu records written to %s (%lld waits for the drain)\n", (unsigned long long)log.records(),
+           file.c_str(), log.stalls());
+}
+
+// where a streamed replay writes a checkpoint: after `at` trace records
+struct CheckpointRequest {
+    long long at = -1;
+    string file;
+};
+
+// feeds the rest of the trace through one engine; consumed counts the trace
+// records read so far (valid or not) and is where a checkpoint resumes.
+// Consecutive references of one job are translated as a batch; metrics
+// snapshots, forks and the checkpoint land exactly on their positions.
+// False if the checkpoint could not be written
+bool stream_trace(DemandPager &pager, TraceInput &trace, const string &label, MetricsWriter &metrics,
+                  long long metrics_every, const CheckpointRequest &save, long long &consumed, long long &invalid) {
+    vector<int> ids = pager.job_ids();
+    long long next_snapshot = metrics.is_open() && metrics_every > 0 ? (pager.references / metrics_every + 1) * metrics_every : -1;
+    const size_t BATCH = 1024;
+    vector<long long> addr(BATCH), phys(BATCH);
+    vector<uint8_t> faulted(BATCH), writes(BATCH);
+    int run_job = -1, last_id = -1, idx = -1;
+    size_t run = 0;
+    auto flush = [&]() {
+        if (run) pager.translate_batch(run_job, addr.data(), run, phys.data(), faulted.data(), writes.data());
+        run = 0;
+    };
+    long long fork_at = pager.next_fork_at();
+    auto fork = [&]() {
+        flush();
+        pager.run_forks(consumed);
+        fork_at = pager.next_fork_at();
+        ids = pager.job_ids();
+        idx = -1;
+    };
+    if (fork_at != -1 && fork_at <= consumed) fork();
+    TraceRef ref;
+    while (trace.next(ref)) {
+        ++consumed;
+        if (ref.job_id != last_id || idx == -1) { idx = pager.find_job(ref.job_id); last_id = ref.job_id; }
+        if (idx == -1 || ref.address < 0 || ref.address >= pager.jobs[idx].size) ++invalid;
+        else {
+            if (idx != run_job || run == BATCH) { flush(); run_job = idx; }
+            writes[run] = ref.write;
+            addr[run++] = ref.address;
+            if (next_snapshot != -1 && pager.references + (long long)run >= next_snapshot) {
+                flush();
+                // deferred references (load control) may leave the count short of the point
+                if (pager.references >= next_snapshot) {
+                    metrics.snapshot(pager.references, label, ids, pager.stats, pager.fault_gap);
+                    next_snapshot = (pager.references / metrics_every + 1) * metrics_every;
+                }
+            }
+        }
+        if (consumed == fork_at) fork();
+        if (consumed == save.at) {
+            flush();
+            auto start = chrono::steady_clock::now();
+            if (!pager.save_checkpoint(save.file, consumed, invalid)) {
+                cerr << "Error: Could not write checkpoint " << save.file << endl;
+                return false;
+            }
+            fprintf(stderr, "Checkpoint after %lld trace records written to %s in %.3f s\n", consumed, save.file.c_str(),
+                    chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    flush();
+    pager.serve_deferred();
+    return true;
+}
+
+// per page size: mappings, memory, internal fragmentation, fault and
+// pressure counters, page-table memory and the size's TLB
+void print_huge_page_report(const HugePagePager &pager, double seconds) {
+    const HugePageConfig &cfg = pager.cfg;
+    printf("\nPolicy: %s, huge pages %s", pager.policy->name(), huge_page_mode_name(cfg.mode));
+    if (cfg.mode == HugePageMode::PROMOTE) printf(" at %d%%", cfg.promote_percent);
+    printf("\n%-11s %9s %11s %9s %9s %9s %9s %9s %8s %11s %12s %8s %12s %9s\n", "page size", "resident",
+           "memory KB", "unused KB", "int.frag", "faults", "fallback", "evicted", "splits", "promotions",
+           "table bytes", "TLB ent", "TLB reach KB", "TLB hit%");
+    for (size_t l = 0; l < cfg.sizes.size(); ++l) {
+        const HugePageStats &st = pager.stats[l];
+        long long frames, unused;
+        pager.residency((int)l, frames, unused);
+        long long bytes = frames * cfg.sizes[0];
+        long long waste = l == 0 ? pager.tail_waste() : unused * cfg.sizes[0];
+        const Tlb &tlb = *pager.tlbs[l];
+        printf("%-11lld %9lld %11lld %9lld %8.2f%% %9lld %9lld %9lld %8lld %11lld %12lld %8d %12lld %8.2f%%\n",
+               cfg.sizes[l], st.resident, bytes / 1024, waste / 1024, bytes ? 100.0 * waste / bytes : 0.0,
+               st.faults, st.fallbacks, st.evictions, st.splits, st.promotions, pager.table_bytes((int)l),
+               tlb.config().entries, tlb.reach(cfg.sizes[l]) / 1024,
+               pager.references ? 100.0 * tlb.stats.hits / pager.references : 0.0);
+    }
+    long long split_freed = 0, copied = 0, failed = 0;
+    for (const HugePageStats &st : pager.stats) { split_freed += st.freed_by_split; copied += st.copied; failed += st.promotion_failures; }
+    printf("References %lld, faults %lld (%.3f%%), TLB misses %lld (%.3f%%), %.3f walk accesses per reference\n",
+           pager.references, pager.faults, pager.references ? 100.0 * pager.faults / pager.references : 0.0,
+           pager.tlb_misses, pager.references ? 100.0 * pager.tlb_misses / pager.references : 0.0,
+           pager.references ? (double)pager.walk_accesses / pager.references : 0.0);
+    printf("Splits freed %lld KB, promotions copied %lld KB, %lld promotions found no free block\n",
+           split_freed * cfg.sizes[0] / 1024, copied * cfg.sizes[0] / 1024, failed);
+    printf("Effective access time %.2f ns, replay time %.3f s\n", pager.effective_access_time(), seconds);
+}
+
+/*
+ * replay with several page sizes (PageSizes in the job file): every policy
+ * runs once with base pages only and once with the HugePages mode, and a
+ * table compares faults, TLB misses, page-table memory and internal
+ * fragmentation. The trace is streamed anew for every run
+ */
+int run_huge_replay(const ReplayConfig &cfg, const string &trace_file, const vector<string> &policies) {
+    HugePageConfig huge = cfg.huge;
+    huge.pt_levels = cfg.pt_levels;
+    for (size_t l = 0; l < huge.sizes.size(); ++l) {
+        // defaults in the style of current x86 L1 data TLBs: 64 base entries,
+        // 32 for the next size, 4 for the larger ones
+        TlbConfig t = cfg.use_tlb ? cfg.tlb : TlbConfig();
+        t.tlb_latency = cfg.tlb.tlb_latency;
+        t.memory_latency = cfg.tlb.memory_latency;
+        if (l == 1) { t.entries = 32; t.ways = 4; }
+        if (l >= 2) { t.entries = 4; t.ways = 4; }
+        auto it = cfg.huge_tlb.find(huge.sizes[l]);
+        if (it != cfg.huge_tlb.end()) { t.entries = it->second.first; t.ways = it->second.second; }
+        huge.tlbs.push_back(t);
+    }
+    if (find(policies.begin(), policies.end(), "opt") != policies.end()) {
+        cerr << "Error: opt is not available with PageSizes.\n";
+        return 1;
+    }
+    if (cfg.rs.scope != ResidentScope::GLOBAL || cfg.rs.load_control || cfg.ra.enabled)
+        cerr << "Warning: ResidentSet, LoadControl and ReadAhead are ignored with PageSizes.\n";
+    warn_no_sharing(cfg, "with PageSizes");
+
+    printf("Replay of %s with %d frames of %d bytes, page sizes", trace_file.c_str(), cfg.num_frames, cfg.page_size);
+    for (long long s : huge.sizes) printf(" %lld", s);
+    printf(", %zu jobs\n", cfg.job_defs.size());
+
+    struct Row { string label; long long faults, misses, walks, refs, tables, waste; double eat; };
+    vector<Row> rows;
+    unsigned seed = rng();
+    for (const string &policy : policies) {
+        vector<HugePageMode> modes = {HugePageMode::NEVER};
+        if (huge.mode != HugePageMode::NEVER) modes.push_back(huge.mode);
+        for (HugePageMode mode : modes) {
+            HugePageConfig run_cfg = huge;
+            run_cfg.mode = mode;
+            HugePagePager pager(run_cfg, cfg.num_frames, policy, seed);
+            for (auto &d : cfg.job_defs) pager.add_job(d.first, max(0LL, d.second));
+            TraceInput trace(trace_file);
+            if (!trace.is_open()) {
+                cerr << "Error: Could not open file " << trace_file << endl;
+                return 1;
+            }
+            long long invalid = 0;
+            int last_id = -1, idx = -1;
+            auto start = chrono::steady_clock::now();
+            TraceRef ref;
+            while (trace.next(ref)) {
+                if (ref.job_id != last_id || idx == -1) { idx = pager.find_job(ref.job_id); last_id = ref.job_id; }
+                if (idx == -1 || ref.address < 0 || ref.address >= pager.jobs[idx].size) { ++invalid; continue; }
+                pager.access(idx, ref.address);
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            print_huge_page_report(pager, seconds);
+            printf("Invalid references skipped: %lld\n", invalid + trace.malformed());
+
+            Row row{policy + "/" + huge_page_mode_name(mode), pager.faults, pager.tlb_misses, pager.walk_accesses,
+                    pager.references, 0, pager.tail_waste(), pager.effective_access_time()};
+            for (size_t l = 0; l < huge.sizes.size(); ++l) {
+                long long frames, unused;
+                pager.residency((int)l, frames, unused);
+                row.tables += pager.table_bytes((int)l);
+                row.waste += unused * huge.sizes[0];
+            }
+            rows.push_back(row);
+        }
+    }
+
+    printf("\nPage size comparison:\n%-16s %12s %12s %10s %10s %14s %14s %10s\n", "policy/mode", "faults", "TLB misses",
+           "TLB miss%", "walks/ref", "table bytes", "int.frag KB", "EAT ns");
+    for (const Row &r : rows)
+        printf("%-16s %12lld %12lld %9.3f%% %10.3f %14lld %14lld %10.2f\n", r.label.c_str(), r.faults, r.misses,
+               r.refs ? 100.0 * r.misses / r.refs : 0.0, r.refs ? (double)r.walks / r.refs : 0.0, r.tables,
+               r.waste / 1024, r.eat);
+    return 0;
+}
+
+// batch mode: no prompts, no per-reference output
+// a single online policy streams the trace; several policies (or opt, which
+// needs lookahead) read it into memory once and replay it for each policy.
+// With a ResidentSet other than global, ReadAhead or PreferClean, every
+// policy also runs with plain global demand paging, so the comparison shows
+// what the per-job scope, the read-ahead or the clean preference changed. --save-at streams a single
+// policy and writes a checkpoint on the way
+int run_replay(const string &jobs_file, const string &trace_file, const string &policy_arg,
+               const string &metrics_file, long long metrics_every, const CheckpointRequest &save,
+               const string &events_file) {
+    ReplayConfig cfg;
+    if (!load_job_file(jobs_file, cfg)) return 1;
+    int page_size = cfg.page_size, num_frames = cfg.num_frames;
+    const vector<pair<int,long long>> &job_defs = cfg.job_defs;
+
+    vector<string> policies;
+    if (!parse_policy_list(policy_arg, policies)) return 1;
+    if (cfg.huge.sizes.size() > 1) {
+        if (save.at >= 0 || !metrics_file.empty() || !events_file.empty()) {
+            cerr << "Error: --save-at, --metrics and --events are not available with PageSizes.\n";
+            return 1;
+        }
+        return run_huge_replay(cfg, trace_file, policies);
+    }
+
+    TraceInput trace(trace_file);
+    if (!trace.is_open()) {
+        cerr << "Error: Could not open file " << trace_file << endl;
+        return 1;
+    }
+
+    MetricsWriter metrics;
+    if (!metrics_file.empty() && !metrics.open(metrics_file)) {
+        cerr << "Error: Could not create file " << metrics_file << endl;
+        return 1;
+    }
+    EventLog events;
+    if (!open_event_log(events, events_file)) return 1;
+
+    unsigned seed = rng();
+    auto make_pager = [&](const string &policy) { return build_pager(cfg, page_size, num_frames, policy, seed); };
+    bool local_scope = cfg.rs.scope != ResidentScope::GLOBAL;
+    bool readahead = cfg.ra.enabled && !local_scope;
+    bool prefer_clean = cfg.swap.enabled && cfg.swap.prefer_clean > 0;
+    printf("Replay of %s with %d frames of %d bytes, %zu jobs\n", trace_file.c_str(), num_frames, page_size, job_defs.size());
+
+    long long invalid = 0;
+    // a checkpoint needs the streamed run, so it skips the comparison runs
+    bool streamed = policies.size() == 1 && policies[0] != "opt" &&
+                    ((!local_scope && !readahead && !prefer_clean) || save.at >= 0);
+    if (save.at >= 0 && !streamed) {
+        cerr << "Error: a checkpoint needs a single online policy (not opt).\n";
+        return 1;
+    }
+    if (streamed) {
+        unique_ptr<DemandPager> pager = make_pager(policies[0]);
+        if (events.is_open()) {
+            events.begin_run(events.ring(0), policies[0]);
+            pager->trace_events(events.ring(0));
+        }
+        long long consumed = 0;
+        auto start = chrono::steady_clock::now();
+        if (!stream_trace(*pager, trace, policies[0], metrics, metrics_every, save, consumed, invalid)) return 1;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (metrics.is_open()) metrics.snapshot(pager->references, policies[0], pager->job_ids(), pager->stats, pager->fault_gap);
+        print_replay_summary(*pager, invalid + trace.malformed(), seconds);
+        close_event_log(events, events_file);
+        return 0;
+    }
+
+    // resolve the trace once against the job table; forked jobs get their
+    // index when the layout forks them, and every run forks at the same
+    // place: fork_stops holds (references before the fork, trace position)
+    unique_ptr<DemandPager> layout = make_pager("random");
+    vector<ResolvedRef> refs;
+    vector<pair<size_t,long long>> fork_stops;
+    long long consumed = 0, fork_at = layout->next_fork_at();
+    TraceRef ref;
+    for (;;) {
+        if (fork_at != -1 && fork_at <= consumed) {
+            layout->run_forks(consumed);
+            fork_stops.push_back({refs.size(), consumed});
+            fork_at = layout->next_fork_at();
+        }
+        if (!trace.next(ref)) break;
+        ++consumed;
+        int idx = layout->find_job(ref.job_id);
+        if (idx == -1 || ref.address < 0 || ref.address >= layout->jobs[idx].size) { ++invalid; continue; }
+        refs.push_back({idx, ref.address / page_size, ref.write});
+    }
+    invalid += trace.malformed();
+
+    // next_use[i] = position of the next reference to the same page (OPT lookahead)
+    vector<long long> next_use;
+    if (find(policies.begin(), policies.end(), "opt") != policies.end())
+        next_use = compute_next_use(refs.size(), [&](size_t i) { return page_key(refs[i].job_idx, refs[i].page_no); });
+
+    // each policy with plain global demand paging, then as configured
+    bool baseline = local_scope || readahead || prefer_clean;
+    vector<pair<string,ReplayConfig>> runs;
+    for (const string &policy : policies) {
+        if (baseline && (local_scope || readahead || make_policy(policy, 0)->honours_clean())) {
+            ReplayConfig plain = cfg;
+            plain.rs = ResidentSetConfig();
+            plain.ra = ReadAheadConfig();
+            plain.swap.prefer_clean = 0;
+            runs.push_back({policy, plain});
+        }
+        runs.push_back({policy, cfg});
+    }
+
+    vector<pair<string,JobStats>> totals;
+    vector<SwapDevice> devices; // parallel to totals when Swap is set
+    for (auto &run : runs) {
+        const string &policy = run.first;
+        const ReplayConfig &run_cfg = run.second;
+        unique_ptr<DemandPager> pager = build_pager(run_cfg, page_size, num_frames, policy, seed);
+        string label = policy;
+        if (local_scope) label += string("/") + resident_scope_name(run_cfg.rs.scope);
+        if (pager->ra.enabled) label += "+ra";
+        if (pager->swap.cfg.prefer_clean > 0 && pager->policy->honours_clean()) label += "+clean";
+        if (events.is_open()) {
+            events.begin_run(events.ring(0), label);
+            pager->trace_events(events.ring(0));
+        }
+        bool lookahead = pager->policy->needs_lookahead();
+        vector<int> ids = pager->job_ids();
+        long long every = metrics.is_open() && metrics_every > 0 ? metrics_every : (long long)refs.size() + 1;
+        size_t next_stop = 0;
+        auto run_forks = [&](size_t i) {
+            for (; next_stop < fork_stops.size() && fork_stops[next_stop].first == i; ++next_stop) {
+                pager->run_forks(fork_stops[next_stop].second);
+                ids = pager->job_ids();
+            }
+        };
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < refs.size();) {
+            run_forks(i);
+            // run up to the next snapshot point or fork without a check per reference
+            size_t stop = min(refs.size(), i + (size_t)every - (size_t)(i % every));
+            if (next_stop < fork_stops.size()) stop = min(stop, fork_stops[next_stop].first);
+            for (; i < stop; ++i)
+                pager->access_page(refs[i].job_idx, refs[i].page_no, lookahead ? next_use[i] : NEVER_USED, refs[i].write);
+            if (i % every == 0 && i < refs.size()) metrics.snapshot(pager->references, label, ids, pager->stats, pager->fault_gap);
+        }
+        run_forks(refs.size());
+        pager->serve_deferred();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        print_replay_summary(*pager, invalid, seconds);
+
+        if (metrics.is_open()) metrics.snapshot(pager->references, label, pager->job_ids(), pager->stats, pager->fault_gap);
+        totals.push_back({label, pager->total()});
+        if (cfg.swap.enabled) devices.push_back(pager->swap);
+    }
+
+    printf("\nPolicy comparison:\n%-12s %14s %12s %12s %10s\n", "policy", "references", "faults", "evictions", "fault%");
+    for (auto &t : totals) {
+        double rate = t.second.references ? 100.0 * t.second.faults / t.second.references : 0.0;
+        printf("%-12s %14lld %12lld %12lld %9.3f%%\n", t.first.c_str(), t.second.references, t.second.faults, t.second.evictions, rate);
+    }
+    if (readahead) {
+        // pages read counts demand faults and read-ahead loads together
+        printf("\nRead-ahead effect:\n%-12s %12s %12s %10s %12s %10s %10s\n", "policy", "faults", "with ra",
+               "change", "pages read", "accuracy", "coverage");
+        for (size_t k = 0; k + 1 < totals.size(); k += 2) {
+            const JobStats &off = totals[k].second, &on = totals[k+1].second;
+            double change = off.faults ? 100.0 * (on.faults - off.faults) / off.faults : 0.0;
+            double accuracy = on.prefetched ? 100.0 * on.prefetch_hits / on.prefetched : 0.0;
+            long long wanted = on.prefetch_hits + on.faults;
+            double coverage = wanted ? 100.0 * on.prefetch_hits / wanted : 0.0;
+            printf("%-12s %12lld %12lld %+9.2f%% %12lld %9.2f%% %9.2f%%\n", totals[k].first.c_str(), off.faults, on.faults,
+                   change, on.faults + on.prefetched, accuracy, coverage);
+        }
+    }
+    if (cfg.swap.enabled) {
+        printf("\nSwap I/O:\n%-14s %12s %12s %10s %12s %12s %12s %10s\n", "policy", "dirty evict", "clean evict",
+               "dirty%", "MB written", "MB read", "stalls", "EAT ns");
+        for (size_t k = 0; k < devices.size(); ++k) {
+            const SwapStats &st = devices[k].stats;
+            long long evictions = st.clean_evictions + st.dirty_evictions;
+            printf("%-14s %12lld %12lld %9.2f%% %12.2f %12.2f %12lld %10.2f\n", totals[k].first.c_str(), st.dirty_evictions,
+                   st.clean_evictions, evictions ? 100.0 * st.dirty_evictions / evictions : 0.0,
+                   devices[k].bytes_written(page_size) / 1e6, devices[k].bytes_read(page_size) / 1e6, st.write_stalls,
+                   devices[k].effective_access_time(totals[k].second.references));
+        }
+    }
+    close_event_log(events, events_file);
+    return 0;
+}
+
+/*
+ * continues a replay from a checkpoint: the engine is mapped back in, the
+ * trace is advanced past the records it had consumed and the rest streams
+ * through it. A different policy branches the run: the resident pages are
+ * handed to it in frame order
+ */
+int run_resume(const string &checkpoint_file, const string &trace_file, const string &policy,
+               const string &metrics_file, long long metrics_every, const CheckpointRequest &save,
+               const string &events_file) {
+    DemandPager pager(1, 1, 0);
+    long long consumed = 0;
+    auto start = chrono::steady_clock::now();
+    long long invalid = 0;
+    if (!pager.restore_checkpoint(checkpoint_file, &consumed, &invalid)) {
+        cerr << "Error: Could not restore checkpoint " << checkpoint_file << endl;
+        return 1;
+    }
+    double restore_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!policy.empty() && policy != pager.policy->name()) {
+        if (policy == "opt" || !pager.switch_policy(policy)) {
+            cerr << "Error: cannot resume with policy '" << policy << "'.\n";
+            return 1;
+        }
+    }
+
+    TraceInput trace(trace_file);
+    if (!trace.is_open()) {
+        cerr << "Error: Could not open file " << trace_file << endl;
+        return 1;
+    }
+    if (trace.skip(consumed) != consumed) {
+        cerr << "Error: " << trace_file << " is shorter than the " << consumed << " records of the checkpoint.\n";
+        return 1;
+    }
+    MetricsWriter metrics;
+    if (!metrics_file.empty() && !metrics.open(metrics_file)) {
+        cerr << "Error: Could not create file " << metrics_file << endl;
+        return 1;
+    }
+    EventLog events;
+    if (!open_event_log(events, events_file)) return 1;
+    if (events.is_open()) {
+        events.begin_run(events.ring(0), string(pager.policy->name()) + " (resumed)", pager.references);
+        pager.trace_events(events.ring(0));
+    }
+    printf("Resumed %s at trace record %lld (%lld references simulated) in %.3f s\n",
+           checkpoint_file.c_str(), consumed, pager.references, restore_seconds);
+    printf("Replay of %s with %d frames of %d bytes, %zu jobs\n", trace_file.c_str(), pager.num_frames, pager.page_size, pager.jobs.size());
+
+    start = chrono::steady_clock::now();
+    if (!stream_trace(pager, trace, pager.policy->name(), metrics, metrics_every, save, consumed, invalid)) return 1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (metrics.is_open()) metrics.snapshot(pager.references, pager.policy->name(), pager.job_ids(), pager.stats, pager.fault_gap);
+    print_replay_summary(pager, invalid + trace.malformed(), seconds);
+    close_event_log(events, events_file);
+    return 0;
+}
+
+/*
+ * parameter sweep: every (page size, frame count, policy) combination runs as
+ * an independent simulation on the work-stealing pool; all of them read one
+ * shared, read-only copy of the trace (addresses, split into pages per run)
+ */
+
+// a validated trace entry kept for the sweep; the page depends on the run's page size
+struct SweepRef {
+    int job_idx;
+    long long address;
+    bool write;
+};
+
+struct SweepResult {
+    int page_size = 0;
+    int num_frames = 0;
+    string policy;
+    JobStats total;
+    double tlb_hit_rate = -1; // -1 when the configuration has no TLB
+    double seconds = 0;
+};
+
+// the option flags of --sweep, --mrc and --concurrent come in pairs; false,
+// with an error, when the flag at argv[i] is the last argument
+bool option_has_value(int argc, char **argv, int i) {
+    if (i + 1 < argc) return true;
+    cerr << "Error: option " << argv[i] << " needs a value" << endl;
+    return false;
+}
+
+// one positive value of a sweep range that fits the int frame counts and
+// page sizes; false for anything else (0, negative, too large, not a number)
+bool parse_range_value(const string &s, long long &v) {
+    char *end = nullptr;
+    errno = 0;
+    v = strtoll(s.c_str(), &end, 10);
+    return !s.empty() && *end == '\0' && errno == 0 && v > 0 && v <= numeric_limits<int>::max();
+}
+
+// "a,b,c", "lo:hi" (step 1), "lo:hi:step" or "lo:hi:*factor"
+bool parse_range(const string &arg, vector<long long> &out) {
+    if (arg.find(':') == string::npos) {
+        stringstream ss(arg);
+        string item;
+        while (getline(ss, item, ',')) {
+            if (item.empty()) continue;
+            long long v;
+            if (!parse_range_value(item, v)) return false;
+            out.push_back(v);
+        }
+        return !out.empty();
+    }
+    long long lo = 0, hi = 0, step = 1;
+    bool geometric = false;
+    string a, b, c;
+    stringstream ss(arg);
+    getline(ss, a, ':'); getline(ss, b, ':'); getline(ss, c);
+    if (!parse_range_value(a, lo) || !parse_range_value(b, hi)) return false;
+    if (!c.empty()) {
+        geometric = c[0] == '*';
+        if (!parse_range_value(c.substr(geometric ? 1 : 0), step)) return false;
+    }
+    if (hi < lo || (geometric && step < 2)) return false;
+    for (long long v = lo; v <= hi; v = geometric ? v * step : v + step) out.push_back(v);
+    return true;
+}
+
+int run_sweep(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " --sweep <jobs_file> <trace_file> [--frames R] [--page-sizes R]"
+             << " [--policies P] [--threads N] [--out file.csv]\n"
+             << "  R: a,b,c | lo:hi | lo:hi:step | lo:hi:*factor   P: policy[,policy...] | all\n";
+        return 1;
+    }
+    ReplayConfig cfg;
+    if (!load_job_file(argv[2], cfg)) return 1;
+    warn_no_sharing(cfg, "in a sweep");
+    cfg.forks.clear();
+    cfg.shared.clear();
+    string trace_file = argv[3];
+
+    vector<long long> frame_counts, page_sizes;
+    vector<string> policies;
+    int threads = 0;
+    string out_file;
+    for (int i = 4; i < argc; i += 2) {
+        if (!option_has_value(argc, argv, i)) return 1;
+        string opt = argv[i], val = argv[i+1];
+        bool ok = true;
+        if (opt == "--frames") ok = parse_range(val, frame_counts);
+        else if (opt == "--page-sizes") ok = parse_range(val, page_sizes);
+        else if (opt == "--policies") ok = parse_policy_list(val, policies);
+        else if (opt == "--threads") threads = atoi(val.c_str());
+        else if (opt == "--out") out_file = val;
+        else ok = false;
+        if (!ok) { cerr << "Error: bad sweep option " << opt << " " << val << endl; return 1; }
+    }
+    if (frame_counts.empty()) frame_counts.push_back(cfg.num_frames);
+    if (page_sizes.empty()) page_sizes.push_back(cfg.page_size);
+    if (policies.empty()) policies.push_back("random");
+
+    // load and validate the trace once
+    TraceInput trace(trace_file);
+    if (!trace.is_open()) {
+        cerr << "Error: Could not open file " << trace_file << endl;
+        return 1;
+    }
+    unique_ptr<DemandPager> layout = build_pager(cfg, cfg.page_size, 1, "random", 0);
+    vector<SweepRef> refs;
+    long long invalid = trace.malformed();
+    TraceRef ref;
+    while (trace.next(ref)) {
+        int idx = layout->find_job(ref.job_id);
+        if (idx == -1 || ref.address < 0 || ref.address >= layout->jobs[idx].size) { ++invalid; continue; }
+        refs.push_back({idx, ref.address, ref.write});
+    }
+    invalid += trace.malformed();
+
+    WorkStealingPool pool(threads);
+    unsigned seed = rng();
+    auto wall_start = chrono::steady_clock::now();
+
+    // OPT lookahead depends on the page size: one shared table per page size
+    bool want_opt = find(policies.begin(), policies.end(), "opt") != policies.end();
+    vector<vector<long long>> next_use(page_sizes.size());
+    vector<function<void()>> tasks;
+    if (want_opt) {
+        for (size_t p = 0; p < page_sizes.size(); ++p)
+            tasks.push_back([&, p] {
+                long long ps = page_sizes[p];
+                next_use[p] = compute_next_use(refs.size(), [&](size_t i) { return page_key(refs[i].job_idx, refs[i].address / ps); });
+            });
+        pool.run(tasks);
+        tasks.clear();
+    }
+
+    vector<SweepResult> results;
+    for (size_t p = 0; p < page_sizes.size(); ++p)
+        for (long long frames : frame_counts)
+            for (const string &policy : policies) {
+                SweepResult r;
+                r.page_size = (int)page_sizes[p];
+                r.num_frames = (int)frames;
+                r.policy = policy;
+                results.push_back(r);
+            }
+    for (size_t k = 0; k < results.size(); ++k)
+        tasks.push_back([&, k] {
+            SweepResult &r = results[k];
+            size_t p = find(page_sizes.begin(), page_sizes.end(), (long long)r.page_size) - page_sizes.begin();
+            // the engine of --replay, so a row matches the replay of its configuration
+            unique_ptr<DemandPager> pager = build_pager(cfg, r.page_size, r.num_frames, r.policy, seed);
+            const vector<long long> *nu = pager->policy->needs_lookahead() ? &next_use[p] : nullptr;
+            auto start = chrono::steady_clock::now();
+            if (nu) {
+                for (size_t i = 0; i < refs.size(); ++i)
+                    pager->access_page(refs[i].job_idx, refs[i].address / r.page_size, (*nu)[i], refs[i].write);
+            } else {
+                // consecutive references of one job are translated as a batch
+                const size_t BATCH = 1024;
+                vector<long long> addr(BATCH), phys(BATCH);
+                vector<uint8_t> faulted(BATCH), writes(BATCH);
+                for (size_t i = 0; i < refs.size();) {
+                    int job = refs[i].job_idx;
+                    size_t n = 0;
+                    for (; i < refs.size() && n < BATCH && refs[i].job_idx == job; ++i, ++n) {
+                        addr[n] = refs[i].address;
+                        writes[n] = refs[i].write;
+                    }
+                    pager->translate_batch(job, addr.data(), n, phys.data(), faulted.data(), writes.data());
+                }
+            }
+            pager->serve_deferred();
+            r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            r.total = pager->total();
+            if (pager->tlb) r.tlb_hit_rate = pager->tlb->stats.hit_rate();
+        });
+    pool.run(tasks);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - wall_start).count();
+
+    FILE *out = stdout;
+    if (!out_file.empty() && !(out = fopen(out_file.c_str(), "w"))) {
+        cerr << "Error: Could not create file " << out_file << endl;
+        return 1;
+    }
+    fprintf(out, "page_size,frames,policy,references,faults,evictions,fault_rate,tlb_hit_rate,seconds\n");
+    long long simulated = 0;
+    for (auto &r : results) {
+        double rate = r.total.references ? (double)r.total.faults / r.total.references : 0.0;
+        fprintf(out, "%d,%d,%s,%lld,%lld,%lld,%.6f,", r.page_size, r.num_frames, r.policy.c_str(),
+                r.total.references, r.total.faults, r.total.evictions, rate);
+        if (r.tlb_hit_rate >= 0) fprintf(out, "%.6f", r.tlb_hit_rate);
+        fprintf(out, ",%.4f\n", r.seconds);
+        simulated += r.total.references;
+    }
+    if (out != stdout) fclose(out);
+
+    fprintf(stderr, "Sweep: %zu configurations, %zu references each (%lld invalid skipped), %d threads\n",
+            results.size(), refs.size(), invalid, pool.size());
+    fprintf(stderr, "Wall time %.3f s, %.2f M simulated references/s, %lld tasks stolen\n",
+            wall, wall > 0 ? simulated / wall / 1e6 : 0.0, pool.steal_count());
+    return 0;
+}
+
+/*
+ * miss-ratio curve: one pass over the trace yields the LRU fault count for
+ * every frame count (mrc.h), optionally from a SHARDS sample of the pages
+ */
+int run_mrc(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " --mrc <jobs_file> <trace_file> [--sample rate] [--out file.csv]\n";
+        return 1;
+    }
+    ReplayConfig cfg;
+    if (!load_job_file(argv[2], cfg)) return 1;
+    warn_no_sharing(cfg, "by --mrc");
+    double sample = 1.0;
+    string out_file;
+    for (int i = 4; i < argc; i += 2) {
+        if (!option_has_value(argc, argv, i)) return 1;
+        string opt = argv[i];
+        if (opt == "--sample") sample = atof(argv[i+1]);
+        else if (opt == "--out") out_file = argv[i+1];
+        else { cerr << "Error: unknown option " << opt << endl; return 1; }
+    }
+
+    TraceInput trace(argv[3]);
+    if (!trace.is_open()) {
+        cerr << "Error: Could not open file " << argv[3] << endl;
+        return 1;
+    }
+    unique_ptr<DemandPager> layout = build_pager(cfg, cfg.page_size, 1, "random", 0);
+    StackDistanceAnalyzer sda(sample, 1 << 20);
+    long long invalid = 0;
+    auto start = chrono::steady_clock::now();
+    TraceRef ref;
+    while (trace.next(ref)) {
+        int idx = layout->find_job(ref.job_id);
+        if (idx == -1 || ref.address < 0 || ref.address >= layout->jobs[idx].size) { ++invalid; continue; }
+        sda.access(page_key(idx, ref.address / cfg.page_size));
+    }
+    invalid += trace.malformed();
+    vector<double> faults = sda.fault_curve();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long long refs = sda.references();
+    auto ratio = [&](size_t c) { return refs ? faults[c] / refs : 0.0; };
+    size_t max_frames = faults.size() - 1;
+
+    if (!out_file.empty()) {
+        FILE *out = fopen(out_file.c_str(), "w");
+        if (!out) { cerr << "Error: Could not create file " << out_file << endl; return 1; }
+        static char buf[1 << 20];
+        setvbuf(out, buf, _IOFBF, sizeof(buf));
+        fprintf(out, "frames,faults,miss_ratio\n");
+        for (size_t c = 1; c <= max_frames; ++c) fprintf(out, "%zu,%.0f,%.6f\n", c, faults[c], ratio(c));
+        fclose(out);
+    }
+
+    printf("LRU miss-ratio curve for %s (%d-byte pages)\n", argv[3], cfg.page_size);
+    printf("References %lld, distinct pages %lld, sampled %lld (rate %.4f), invalid skipped %lld\n",
+           refs, sda.distinct_pages(), sda.sampled(), sda.sample_rate(), invalid);
+    printf("%12s %14s %10s\n", "frames", "faults", "miss%");
+    for (size_t c = 1; c <= max_frames; c = (c * 2 > max_frames && c != max_frames) ? max_frames : c * 2)
+        printf("%12zu %14.0f %9.3f%%\n", c, faults[c], 100.0 * ratio(c));
+    size_t knee = curve_knee(faults, 1);
+    printf("Knee of the working set: %zu frames (%.3f%% misses)\n", knee, 100.0 * ratio(knee));
+    printf("Analysis time: %.3f s\n", seconds);
+    return 0;
+}
+
+/*
+ * concurrent replay: every job's references are replayed by one thread against
+ * a shared frame table (concurrent_pager.h), for 1, 2, 4, ... threads up to
+ * --threads (default: one per job). With fewer threads than jobs a thread
+ * serves several jobs, alternating between them in blocks of references
+ */
+int run_concurrent(int argc, char **argv) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " --concurrent <jobs_file> <trace_file> [--threads N] [--shards N] [--events file.vme]\n";
+        return 1;
+    }
+    ReplayConfig cfg;
+    if (!load_job_file(argv[2], cfg)) return 1;
+    warn_no_sharing(cfg, "in concurrent mode");
+    int max_threads = 0, shards = 0;
+    string events_file;
+    for (int i = 4; i < argc; i += 2) {
+        if (!option_has_value(argc, argv, i)) return 1;
+        string opt = argv[i];
+        if (opt == "--threads") max_threads = atoi(argv[i+1]);
+        else if (opt == "--shards") shards = atoi(argv[i+1]);
+        else if (opt == "--events") events_file = argv[i+1];
+        else { cerr << "Error: unknown option " << opt << endl; return 1; }
+    }
+    int num_jobs = (int)cfg.job_defs.size();
+    if (num_jobs == 0) { cerr << "Error: no jobs in " << argv[2] << endl; return 1; }
+    if (max_threads <= 0 || max_threads > num_jobs) max_threads = num_jobs;
+    if (cfg.use_tlb || cfg.rs.scope != ResidentScope::GLOBAL || cfg.rs.load_control || cfg.pt_levels)
+        cerr << "Warning: Tlb, ResidentSet, LoadControl and PageTableLevels are ignored in concurrent mode.\n";
+
+    // split the trace into one page stream per job
+    TraceInput trace(argv[3]);
+    if (!trace.is_open()) {
+        cerr << "Error: Could not open file " << argv[3] << endl;
+        return 1;
+    }
+    unordered_map<int,int> index;
+    for (int j = 0; j < num_jobs; ++j) index[cfg.job_defs[j].first] = j;
+    vector<vector<long long>> streams(num_jobs);
+    long long invalid = 0, total_refs = 0;
+    TraceRef ref;
+    while (trace.next(ref)) {
+        auto it = index.find(ref.job_id);
+        if (it == index.end() || ref.address < 0 || ref.address >= cfg.job_defs[it->second].second) { ++invalid; continue; }
+        streams[it->second].push_back(ref.address / cfg.page_size);
+        ++total_refs;
+    }
+    invalid += trace.malformed();
+    EventLog events;
+    if (!open_event_log(events, events_file)) return 1;
+
+    printf("Concurrent replay: %d jobs, %lld references (%lld invalid skipped), %d frames of %d bytes, CLOCK\n",
+           num_jobs, total_refs, invalid, cfg.num_frames, cfg.page_size);
+    printf("%7s %6s %9s %10s %8s %8s %11s %12s %10s %13s %11s\n", "threads", "shards", "seconds", "M refs/s",
+           "speedup", "fault%", "pool waits", "hand refills", "scan/evict", "lost claims", "stale hits");
+
+    const size_t BLOCK = 256;
+    double base_rate = 0;
+    vector<int> counts;
+    for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    for (int threads : counts) {
+        ConcurrentPager pager(cfg.page_size, cfg.num_frames, shards > 0 ? shards : threads, num_jobs);
+        for (auto &jd : cfg.job_defs) pager.add_job(jd.second);
+        vector<ConcurrentWorker> workers(threads);
+        if (events.is_open()) {
+            // one run per row, each thread on its own ring
+            int run = events.new_run(to_string(threads) + " thread" + (threads == 1 ? "" : "s"));
+            for (int t = 0; t < threads; ++t) {
+                workers[t].events = events.ring(t);
+                workers[t].events->emit(EV_RUN, 0, run, -1, 0);
+                for (int j = t; j < num_jobs; j += threads) workers[t].events->emit(EV_JOB_START, j, cfg.job_defs[j].first, -1, 0);
+            }
+        }
+        atomic<int> ready{0};
+        atomic<bool> go{false};
+        auto work = [&](int t) {
+            ConcurrentWorker &w = workers[t];
+            w.home_shard = t % pager.pool.size();
+            vector<int> mine;
+            for (int j = t; j < num_jobs; j += threads) mine.push_back(j);
+            vector<size_t> pos(mine.size(), 0);
+            ++ready;
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            for (size_t left = mine.size(); left > 0;) {
+                for (size_t k = 0; k < mine.size(); ++k) {
+                    const vector<long long> &s = streams[mine[k]];
+                    if (pos[k] == s.size()) continue;
+                    size_t end = min(s.size(), pos[k] + BLOCK);
+                    if (w.events) w.events->new_batch(); // the job's own reference count from here
+                    for (size_t i = pos[k]; i < end; ++i) pager.access(w, mine[k], s[i]);
+                    pos[k] = end;
+                    if (end == s.size()) {
+                        --left;
+                        if (w.events) w.events->emit(EV_JOB_END, mine[k], 0, -1, (long long)end);
+                    }
+                }
+            }
+        };
+        vector<thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(work, t);
+        while (ready.load() < threads - 1) this_thread::yield();
+        auto start = chrono::steady_clock::now();
+        go.store(true, memory_order_release);
+        work(0);
+        for (auto &th : pool) th.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        JobStats total;
+        for (auto &st : pager.stats) total += st;
+        long long waits = 0, refills = 0, scanned = 0, lost = 0, stale = 0;
+        for (int s = 0; s < pager.pool.size(); ++s) waits += pager.pool.contended(s);
+        for (auto &w : workers) { refills += w.hand_refills; scanned += w.scanned; lost += w.claim_failures; stale += w.stale_hits; }
+        double rate = seconds > 0 ? total.references / seconds / 1e6 : 0.0;
+        if (threads == 1) base_rate = rate;
+        printf("%7d %6d %9.3f %10.2f %7.2fx %7.3f%% %11lld %12lld %10.2f %13lld %11lld\n", threads, pager.pool.size(),
+               seconds, rate, base_rate > 0 ? rate / base_rate : 0.0,
+               total.references ? 100.0 * total.faults / total.references : 0.0,
+               waits, refills, total.evictions ? (double)scanned / total.evictions : 0.0, lost, stale);
+    }
+    printf("Hardware threads: %u. Fault rates differ between rows because the interleaving of the jobs\n"
+           "changes with the thread count (and with the scheduler's time slices beyond the core count).\n",
+           thread::hardware_concurrency());
+    close_event_log(events, events_file);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // --seed S anywhere on the command line makes random replacement and
+    // preloading repeatable; it is taken out before the modes parse argv
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) != "--seed") continue;
+        rng.seed((unsigned)strtoul(argv[i+1], nullptr, 10));
+        for (int j = i; j + 2 <= argc; ++j) argv[j] = argv[j+2];
+        argc -= 2;
+        break;
+    }
+    bool resume = argc >= 2 && string(argv[1]) == "--resume";
+    if (argc >= 2 && (string(argv[1]) == "--replay" || resume)) {
+        string policy = resume ? "" : "random", metrics_file, events_file;
+        long long metrics_every = 0;
+        CheckpointRequest save;
+        bool ok = argc >= 4;
+        for (int i = 4; ok && i < argc; ++i) {
+            string a = argv[i];
+            if (a == "--metrics" && i + 1 < argc) metrics_file = argv[++i];
+            else if (a == "--metrics-every" && i + 1 < argc) metrics_every = atoll(argv[++i]);
+            else if (a == "--save-at" && i + 2 < argc) { save.at = atoll(argv[i+1]); save.file = argv[i+2]; i += 2; }
+            else if (a == "--events" && i + 1 < argc) events_file = argv[++i];
+            else if (i == 4 && a[0] != '-') policy = a;
+            else ok = false;
+        }
+        if (!ok) {
+            cerr << "Usage: " << argv[0] << " --replay <jobs_file> <trace_file> [policy[,policy...]|all]"
+                 << " [--metrics file.json|file.csv] [--metrics-every N] [--save-at N checkpoint] [--events file.vme]\n"
+                 << "       " << argv[0] << " --resume <checkpoint> <trace_file> [policy]"
+                 << " [--metrics file.json|file.csv] [--metrics-every N] [--save-at N checkpoint] [--events file.vme]\n";
+            return 1;
+        }
+        if (resume) return run_resume(argv[2], argv[3], policy, metrics_file, metrics_every, save, events_file);
+        return run_replay(argv[2], argv[3], policy, metrics_file, metrics_every, save, events_file);
+    }
+    if (argc >= 2 && string(argv[1]) == "--sweep") return run_sweep(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "--mrc") return run_mrc(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "--concurrent") return run_concurrent(argc, argv);
+
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
     cout << "Paged Memory Simulation (C++)\n";
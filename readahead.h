@@ -0,0 +1,102 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+// readahead.h
+// Sequential and strided read-ahead for the demand-paging engine
+// (demand_engine.h), modelled on Linux file read-ahead.
+//
+// Each job remembers the page of its last demand fault (or first use of a
+// read-ahead page) and the stride to the one before. When a fault lands one
+// stride after the previous one the job is streaming: the engine loads the
+// next `window` pages along the stride, starting with min_window pages. The
+// first page of every window is the marker; using it while it is still
+// unreferenced reads the following window ahead of time with the window
+// doubled (up to max_window), so a steady scan stops faulting altogether.
+// A fault off the stride ends the stream and resets the window. When a
+// read-ahead page the stream has not reached yet is evicted, the window was
+// too large for the memory left: the job's limit on it halves, and every
+// window that does get used raises it again by min_window.
+//
+// Read-ahead pages carry FRAME_PREFETCHED until their first use. When memory
+// is full the oldest of them that its job has already passed by is evicted
+// before the replacement policy is asked, so a wrong guess costs a frame for
+// as short a time as possible.
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+struct ReadAheadConfig {
+    bool enabled = false;
+    long long min_window = 4;   // pages read when a stream is first detected
+    long long max_window = 64;  // largest window the doubling reaches
+};
+
+// "off" or "on [min [max]]"; false on anything else. Parameters left out
+// keep their current values
+inline bool parse_readahead(const string &spec, ReadAheadConfig &cfg) {
+    stringstream ss(spec);
+    string word;
+    ss >> word;
+    if (word == "off") { cfg.enabled = false; return true; }
+    if (word != "on") return false;
+    cfg.enabled = true;
+    long long lo, hi;
+    if (ss >> lo) cfg.min_window = lo;
+    if (ss >> hi) cfg.max_window = hi;
+    if (cfg.min_window < 1) cfg.min_window = 1;
+    if (cfg.max_window < cfg.min_window) cfg.max_window = cfg.min_window;
+    return true;
+}
+
+// per-job stream detector
+struct ReadAheadState {
+    long long last = -1;    // page of the last demand fault or first use of a read-ahead page
+    long long stride = 0;   // distance between the last two of them
+    long long window = 0;   // pages in the current window, 0 while not streaming
+    long long next = 0;     // first page not read ahead yet
+    long long marker = -1;  // read-ahead page whose first use triggers the next window
+    long long limit = 0;    // largest window for now, 0 = max_window
+
+    long long cap(const ReadAheadConfig &cfg) const { return limit ? limit : cfg.max_window; }
+
+    // a demand fault on page; returns how many pages to read ahead from next
+    long long on_fault(long long page, const ReadAheadConfig &cfg) {
+        long long d = page - last;
+        last = page;
+        if (d == 0 || d != stride) {
+            stride = d;
+            window = 0;
+            marker = -1;
+            return 0;
+        }
+        window = min(window ? 2 * window : cfg.min_window, cap(cfg));
+        next = page + stride;
+        return window;
+    }
+
+    // first use of a read-ahead page; returns how many pages to read ahead
+    long long on_first_use(long long page, const ReadAheadConfig &cfg) {
+        last = page;
+        if (page != marker || window == 0) return 0;
+        limit = min(cfg.max_window, cap(cfg) + cfg.min_window);
+        window = min(2 * window, limit);
+        return window;
+    }
+
+    // a page of the stream was evicted before the job got to it
+    void on_thrash(const ReadAheadConfig &cfg) {
+        limit = max(cfg.min_window, cap(cfg) / 2);
+        window = min(window, limit);
+    }
+
+    // true if the stream has still to reach page
+    bool ahead(long long page) const {
+        if (window == 0 || stride == 0) return false;
+        return stride > 0 ? page > last && page < next : page < last && page > next;
+    }
+};
+
+#endif
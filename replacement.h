@@ -0,0 +1,431 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+// replacement.h
+// Page-replacement policies for the demand-paging engine (demand_engine.h).
+//
+// The engine tells the policy about every resident page through frame numbers:
+//   on_load(frame, key, next_use)  page `key` was placed in `frame`
+//   on_hit(frame, next_use)        the page in `frame` was referenced again
+//   choose_victim(key)             memory is full and page `key` is faulting:
+//                                  pick a frame to evict and stop tracking it
+//   on_evict(frame)                `frame` was freed for another reason
+// `key` identifies a (job, page) pair (see page_key) and `next_use` is the
+// trace position of the page's next reference (NEVER_USED if none, or if the
+// caller has no lookahead); only OPT looks at it.
+//
+// Costs: RANDOM, FIFO, LRU, CLOCK and ARC are O(1) (CLOCK amortised);
+// LFU and OPT keep an ordered set and are O(log n).
+//
+// prefer_clean(frames, window) lets RANDOM, FIFO, LRU, CLOCK and ARC pass over
+// dirty pages (CFLRU): FIFO, LRU and ARC take the oldest clean page among the
+// window oldest of their list, CLOCK skips up to window unreferenced dirty
+// frames before taking the first of them, RANDOM draws up to window times.
+// Each falls back to its usual victim, so a window of 0 changes nothing.
+//
+// checkpoint(ar) saves or restores a policy's metadata (checkpoint.h); the
+// policy must have been reset() to the same frame count before a restore.
+
+#include <cstdint>
+#include <climits>
+#include <list>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "checkpoint.h"
+#include "frame_table.h"
+
+using namespace std;
+
+const long long NEVER_USED = LLONG_MAX;
+
+// packs a (job, page) pair; unique while job ids stay below 2^24 and page
+// numbers below 2^40 (a 4 PB job address space at 4 KB pages)
+inline uint64_t page_key(int job_id, long long page_no) {
+    return ((uint64_t)(uint32_t)job_id << 40) ^ (uint64_t)page_no;
+}
+
+// doubly linked list threaded through frame numbers; front = oldest
+class FrameList {
+    vector<int> prev_, next_;
+    int head = -1, tail = -1, count = 0;
+public:
+    void reset(int n) { prev_.assign(n, -1); next_.assign(n, -1); head = tail = -1; count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    int front() const { return head; }
+    int after(int f) const { return next_[f]; } // -1 at the back
+    void push_back(int f) {
+        prev_[f] = tail; next_[f] = -1;
+        if (tail != -1) next_[tail] = f; else head = f;
+        tail = f; ++count;
+    }
+    void remove(int f) {
+        if (prev_[f] != -1) next_[prev_[f]] = next_[f]; else head = next_[f];
+        if (next_[f] != -1) prev_[next_[f]] = prev_[f]; else tail = prev_[f];
+        prev_[f] = next_[f] = -1; --count;
+    }
+    void move_to_back(int f) { if (f != tail) { remove(f); push_back(f); } }
+    void checkpoint(CheckpointArchive &ar) {
+        size_t n = prev_.size();
+        ar.io(prev_); ar.io(next_); ar.io(head); ar.io(tail); ar.io(count);
+        if (ar.loading() && !consistent(n)) ar.fail();
+    }
+    // keeps the n frames reset gave it, every link names a frame, and the
+    // links from head form one chain of count frames ending at tail
+    bool consistent(size_t n) const {
+        if (prev_.size() != n || next_.size() != n || count < 0 || count > (int)n) return false;
+        for (size_t i = 0; i < n; ++i)
+            if (prev_[i] < -1 || prev_[i] >= (int)n || next_[i] < -1 || next_[i] >= (int)n) return false;
+        int steps = 0, last = -1;
+        for (int f = head; f != -1; last = f, f = next_[f])
+            if (f < 0 || f >= (int)n || prev_[f] != last || ++steps > count) return false;
+        return last == tail && steps == count;
+    }
+};
+
+class ReplacementPolicy {
+protected:
+    const FrameTable *dirty_bits = nullptr;
+    int clean_window = 0;
+
+    bool dirty(int f) const { return dirty_bits && dirty_bits->test(f, FRAME_DIRTY); }
+
+    // the oldest clean frame among the first clean_window of list, else its front
+    int clean_front(const FrameList &list) const {
+        int f = list.front();
+        for (int k = 0; k < clean_window && f != -1; ++k, f = list.after(f))
+            if (!dirty(f)) return f;
+        return list.front();
+    }
+
+public:
+    virtual ~ReplacementPolicy() {}
+    virtual const char *name() const = 0;
+    virtual void reset(int num_frames) = 0;
+    virtual void on_load(int frame, uint64_t key, long long next_use) = 0;
+    virtual void on_hit(int frame, long long next_use) = 0;
+    // on_hit(frames[i], NEVER_USED) for a run of hits, in order (translate_batch)
+    virtual void on_hits(const int32_t *frames, size_t n) {
+        for (size_t i = 0; i < n; ++i) on_hit(frames[i], NEVER_USED);
+    }
+    virtual int choose_victim(uint64_t key) = 0;
+    virtual void on_evict(int frame) = 0;
+    virtual void checkpoint(CheckpointArchive &ar) = 0;
+    virtual bool needs_lookahead() const { return false; }
+    virtual bool tracks_hits() const { return true; } // false if on_hit does nothing
+    virtual bool honours_clean() const { return false; } // prefer_clean changes its choice
+
+    // victims that need no write-back: look up to window frames past the usual
+    // choice for one whose FRAME_DIRTY bit in frames is clear (0 = off)
+    void prefer_clean(const FrameTable *frames, int window) {
+        dirty_bits = frames;
+        clean_window = window > 0 ? window : 0;
+    }
+};
+
+// the original policy: any resident frame, uniformly at random
+class RandomPolicy : public ReplacementPolicy {
+    vector<int> resident, pos;
+    mt19937 rng;
+public:
+    explicit RandomPolicy(unsigned seed) : rng(seed) {}
+    const char *name() const override { return "random"; }
+    bool tracks_hits() const override { return false; }
+    void reset(int n) override { resident.clear(); resident.reserve(n); pos.assign(n, -1); }
+    void on_load(int frame, uint64_t, long long) override { pos[frame] = (int)resident.size(); resident.push_back(frame); }
+    void on_hit(int, long long) override {}
+    void on_evict(int frame) override {
+        int i = pos[frame];
+        if (i == -1) return;
+        resident[i] = resident.back();
+        pos[resident[i]] = i;
+        resident.pop_back();
+        pos[frame] = -1;
+    }
+    bool honours_clean() const override { return true; }
+    int choose_victim(uint64_t) override {
+        if (resident.empty()) return -1;
+        uniform_int_distribution<int> dist(0, (int)resident.size() - 1);
+        int frame = resident[dist(rng)];
+        for (int k = 0; k < clean_window && dirty(frame); ++k) frame = resident[dist(rng)];
+        on_evict(frame);
+        return frame;
+    }
+    void checkpoint(CheckpointArchive &ar) override {
+        size_t n = pos.size();
+        ar.io(resident); ar.io(pos); ar.io(rng);
+        if (!ar.loading()) return;
+        bool ok = pos.size() == n && resident.size() <= n;
+        for (size_t i = 0; ok && i < resident.size(); ++i)
+            ok = resident[i] >= 0 && resident[i] < (int)n && pos[resident[i]] == (int)i;
+        if (!ok) ar.fail();
+    }
+};
+
+class FifoPolicy : public ReplacementPolicy {
+protected:
+    FrameList order;
+public:
+    const char *name() const override { return "fifo"; }
+    bool tracks_hits() const override { return false; }
+    void reset(int n) override { order.reset(n); }
+    void on_load(int frame, uint64_t, long long) override { order.push_back(frame); }
+    void on_hit(int, long long) override {}
+    void on_evict(int frame) override { order.remove(frame); }
+    bool honours_clean() const override { return true; }
+    int choose_victim(uint64_t) override {
+        int frame = clean_front(order);
+        if (frame != -1) order.remove(frame);
+        return frame;
+    }
+    void checkpoint(CheckpointArchive &ar) override { order.checkpoint(ar); }
+};
+
+// FIFO order refreshed on every hit
+class LruPolicy : public FifoPolicy {
+public:
+    const char *name() const override { return "lru"; }
+    bool tracks_hits() const override { return true; }
+    void on_hit(int frame, long long) override { order.move_to_back(frame); }
+};
+
+// second chance: the hand skips (and clears) frames referenced since its last pass
+class ClockPolicy : public ReplacementPolicy {
+    vector<char> resident, referenced;
+    int hand = 0;
+public:
+    const char *name() const override { return "clock"; }
+    void reset(int n) override { resident.assign(n, 0); referenced.assign(n, 0); hand = 0; }
+    void on_load(int frame, uint64_t, long long) override { resident[frame] = 1; referenced[frame] = 1; }
+    void on_hit(int frame, long long) override { referenced[frame] = 1; }
+    void on_hits(const int32_t *frames, size_t n) override {
+        for (size_t i = 0; i < n; ++i) referenced[frames[i]] = 1;
+    }
+    void on_evict(int frame) override { resident[frame] = 0; referenced[frame] = 0; }
+    bool honours_clean() const override { return true; }
+    int choose_victim(uint64_t) override {
+        int n = (int)resident.size();
+        int first_dirty = -1, skipped = 0;
+        for (int steps = 0; steps < 2 * n + 1; ++steps) {
+            int f = hand;
+            hand = (hand + 1 == n) ? 0 : hand + 1;
+            if (!resident[f]) continue;
+            if (referenced[f]) { referenced[f] = 0; continue; }
+            if (clean_window > 0 && dirty(f)) {
+                if (first_dirty == -1) first_dirty = f;
+                if (++skipped <= clean_window) continue;
+                f = first_dirty;
+            }
+            resident[f] = 0;
+            return f;
+        }
+        if (first_dirty != -1) resident[first_dirty] = 0;
+        return first_dirty;
+    }
+    void checkpoint(CheckpointArchive &ar) override {
+        size_t n = resident.size();
+        ar.io(resident); ar.io(referenced); ar.io(hand);
+        if (ar.loading() && (resident.size() != n || referenced.size() != n || hand < 0 || hand >= max((int)n, 1)))
+            ar.fail();
+    }
+};
+
+// least frequently used, ties broken by least recent use
+class LfuPolicy : public ReplacementPolicy {
+    struct Entry { long long count, last; };
+    vector<Entry> entries;
+    set<pair<pair<long long,long long>,int>> order;
+    long long tick = 0;
+public:
+    const char *name() const override { return "lfu"; }
+    void reset(int n) override { entries.assign(n, Entry{0, 0}); order.clear(); tick = 0; }
+    void on_load(int frame, uint64_t, long long) override {
+        entries[frame] = Entry{1, ++tick};
+        order.insert({{1, tick}, frame});
+    }
+    void on_hit(int frame, long long) override {
+        Entry &e = entries[frame];
+        order.erase({{e.count, e.last}, frame});
+        ++e.count; e.last = ++tick;
+        order.insert({{e.count, e.last}, frame});
+    }
+    void on_evict(int frame) override {
+        Entry &e = entries[frame];
+        order.erase({{e.count, e.last}, frame});
+    }
+    int choose_victim(uint64_t) override {
+        if (order.empty()) return -1;
+        int frame = order.begin()->second;
+        order.erase(order.begin());
+        return frame;
+    }
+    // the order holds the tracked frames; it is rebuilt from their entries
+    void checkpoint(CheckpointArchive &ar) override {
+        vector<int> tracked;
+        for (auto &o : order) tracked.push_back(o.second);
+        size_t n = entries.size();
+        ar.io(entries); ar.io(tick); ar.io(tracked);
+        if (!ar.loading()) return;
+        if (entries.size() != n) ar.fail();
+        order.clear();
+        for (int f : tracked) if (f >= 0 && f < (int)entries.size()) order.insert({{entries[f].count, entries[f].last}, f});
+    }
+};
+
+// Belady's optimal policy: evicts the page whose next reference is furthest away
+class OptPolicy : public ReplacementPolicy {
+    vector<long long> next;
+    set<pair<long long,int>> order;
+public:
+    const char *name() const override { return "opt"; }
+    bool needs_lookahead() const override { return true; }
+    void reset(int n) override { next.assign(n, NEVER_USED); order.clear(); }
+    void on_load(int frame, uint64_t, long long next_use) override { next[frame] = next_use; order.insert({next_use, frame}); }
+    void on_hit(int frame, long long next_use) override {
+        order.erase({next[frame], frame});
+        next[frame] = next_use;
+        order.insert({next_use, frame});
+    }
+    void on_evict(int frame) override { order.erase({next[frame], frame}); }
+    int choose_victim(uint64_t) override {
+        if (order.empty()) return -1;
+        auto it = prev(order.end());
+        int frame = it->second;
+        order.erase(it);
+        return frame;
+    }
+    void checkpoint(CheckpointArchive &ar) override {
+        vector<int> tracked;
+        for (auto &o : order) tracked.push_back(o.second);
+        size_t n = next.size();
+        ar.io(next); ar.io(tracked);
+        if (!ar.loading()) return;
+        if (next.size() != n) ar.fail();
+        order.clear();
+        for (int f : tracked) if (f >= 0 && f < (int)next.size()) order.insert({next[f], f});
+    }
+};
+
+// Adaptive Replacement Cache (Megiddo & Modha): T1/T2 hold resident pages seen
+// once/more than once, B1/B2 remember recently evicted keys and steer the
+// target size p of T1
+class ArcPolicy : public ReplacementPolicy {
+    // ghost list of page keys with O(1) lookup and removal
+    struct GhostList {
+        list<uint64_t> keys; // front = oldest
+        unordered_map<uint64_t, list<uint64_t>::iterator> where;
+        int size() const { return (int)keys.size(); }
+        bool contains(uint64_t k) const { return where.count(k) != 0; }
+        void push_back(uint64_t k) { keys.push_back(k); where[k] = prev(keys.end()); }
+        void erase(uint64_t k) { auto it = where.find(k); keys.erase(it->second); where.erase(it); }
+        void pop_front() { where.erase(keys.front()); keys.pop_front(); }
+        void clear() { keys.clear(); where.clear(); }
+        void checkpoint(CheckpointArchive &ar) {
+            vector<uint64_t> flat(keys.begin(), keys.end());
+            ar.io(flat);
+            if (!ar.loading()) return;
+            clear();
+            for (uint64_t k : flat) push_back(k);
+        }
+    };
+
+    int c = 0, p = 0;
+    FrameList t1, t2;
+    vector<char> in_t2;
+    vector<uint64_t> frame_key;
+    GhostList b1, b2;
+    bool adapted = false; // p already adjusted for the page being loaded
+
+    void adapt(uint64_t key) {
+        if (b1.contains(key)) p = min(c, p + max(b2.size() / max(b1.size(), 1), 1));
+        else if (b2.contains(key)) p = max(0, p - max(b1.size() / max(b2.size(), 1), 1));
+    }
+
+public:
+    const char *name() const override { return "arc"; }
+    bool honours_clean() const override { return true; }
+    void reset(int n) override {
+        c = n; p = 0;
+        t1.reset(n); t2.reset(n);
+        in_t2.assign(n, 0); frame_key.assign(n, 0);
+        b1.clear(); b2.clear();
+        adapted = false;
+    }
+    void on_load(int frame, uint64_t key, long long) override {
+        if (!adapted) adapt(key);
+        adapted = false;
+        frame_key[frame] = key;
+        if (b1.contains(key) || b2.contains(key)) {
+            if (b1.contains(key)) b1.erase(key); else b2.erase(key);
+            in_t2[frame] = 1;
+            t2.push_back(frame);
+            return;
+        }
+        // new page: keep |T1|+|B1| <= c and the whole directory <= 2c
+        if (t1.size() + b1.size() >= c && b1.size() > 0) b1.pop_front();
+        else if (t1.size() + t2.size() + b1.size() + b2.size() >= 2 * c && b2.size() > 0) b2.pop_front();
+        in_t2[frame] = 0;
+        t1.push_back(frame);
+    }
+    void on_hit(int frame, long long) override {
+        if (in_t2[frame]) { t2.move_to_back(frame); return; }
+        t1.remove(frame);
+        in_t2[frame] = 1;
+        t2.push_back(frame);
+    }
+    void on_evict(int frame) override {
+        if (in_t2[frame]) t2.remove(frame); else t1.remove(frame);
+        in_t2[frame] = 0;
+    }
+    int choose_victim(uint64_t key) override {
+        adapt(key);
+        adapted = true;
+        int frame;
+        if (!t1.empty() && (t1.size() > p || (b2.contains(key) && t1.size() == p) || t2.empty())) {
+            frame = clean_front(t1);
+            t1.remove(frame);
+            b1.push_back(frame_key[frame]);
+        } else {
+            frame = clean_front(t2);
+            if (frame == -1) return -1;
+            t2.remove(frame);
+            b2.push_back(frame_key[frame]);
+        }
+        in_t2[frame] = 0;
+        return frame;
+    }
+    void checkpoint(CheckpointArchive &ar) override {
+        size_t n = in_t2.size();
+        ar.io(c); ar.io(p);
+        t1.checkpoint(ar); t2.checkpoint(ar);
+        ar.io(in_t2); ar.io(frame_key);
+        b1.checkpoint(ar); b2.checkpoint(ar);
+        ar.io(adapted);
+        if (ar.loading() && (in_t2.size() != n || frame_key.size() != n || p < 0 || p > c)) ar.fail();
+    }
+};
+
+inline const vector<string> &policy_names() {
+    static const vector<string> names = {"random", "fifo", "lru", "clock", "lfu", "opt", "arc"};
+    return names;
+}
+
+// builds a policy by name (see policy_names); returns nullptr for an unknown name
+inline unique_ptr<ReplacementPolicy> make_policy(const string &name, unsigned seed) {
+    if (name == "random") return unique_ptr<ReplacementPolicy>(new RandomPolicy(seed));
+    if (name == "fifo") return unique_ptr<ReplacementPolicy>(new FifoPolicy());
+    if (name == "lru") return unique_ptr<ReplacementPolicy>(new LruPolicy());
+    if (name == "clock") return unique_ptr<ReplacementPolicy>(new ClockPolicy());
+    if (name == "lfu") return unique_ptr<ReplacementPolicy>(new LfuPolicy());
+    if (name == "opt") return unique_ptr<ReplacementPolicy>(new OptPolicy());
+    if (name == "arc") return unique_ptr<ReplacementPolicy>(new ArcPolicy());
+    return nullptr;
+}
+
+#endif
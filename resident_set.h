@@ -0,0 +1,185 @@
+#ifndef RESIDENT_SET_H
+#define RESIDENT_SET_H
+
+// resident_set.h
+// Per-job resident-set management for the demand-paging engine
+// (demand_engine.h). Without it every job competes for one global pool and
+// the replacement policy may take any job's frame. The other scopes keep
+// replacement inside the faulting job:
+//   local  each job owns an equal share of the frames and replaces its own
+//          least recently used page once it holds that many
+//   ws     working set WS(tau): a page stays resident while the job has
+//          referenced it within its last tau references (job virtual time);
+//          older pages are released as the job runs
+//   pff    page-fault frequency: every `window` references of a job its quota
+//          grows when its fault rate is above `high` and shrinks (dropping
+//          its least recently used pages) when it is below `low`
+// With load control on, the job with the largest demand (working set or pff
+// quota, the faulting job included) is suspended when the jobs' combined
+// demand exceeds memory: all its pages are swapped out and its references
+// are deferred until its demand fits again, or until it has waited `quantum`
+// references of the other jobs, so a job too large for what is left still
+// gets its turn. Deferred references are queued per job and served, in
+// order, when the job is readmitted (whatever is still queued when the trace
+// ends is served then), so every reference of the trace is simulated once.
+//
+// Per-job LRU order is one pair of prev/next arrays threaded through frame
+// numbers with a head and tail per job, so it costs O(1) per reference.
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+enum class ResidentScope { GLOBAL, LOCAL, WORKING_SET, PFF };
+
+struct ResidentSetConfig {
+    ResidentScope scope = ResidentScope::GLOBAL;
+    long long tau = 10000;      // ws: window in references of the job
+    long long window = 1000;    // pff: references between quota decisions
+    double low = 0.01;          // pff: shrink below this many faults per reference
+    double high = 0.05;         // pff: grow above this
+    bool load_control = false;  // suspend jobs when demand exceeds memory
+    long long quantum = 100000; // load control: longest wait before a forced resume
+};
+
+inline const char *resident_scope_name(ResidentScope s) {
+    switch (s) {
+    case ResidentScope::LOCAL: return "local";
+    case ResidentScope::WORKING_SET: return "ws";
+    case ResidentScope::PFF: return "pff";
+    default: return "global";
+    }
+}
+
+// "global", "local", "ws [tau]" or "pff [window [low high]]"; false on an
+// unknown scope. Parameters left out keep their current values
+inline bool parse_resident_set(const string &spec, ResidentSetConfig &cfg) {
+    stringstream ss(spec);
+    string scope;
+    ss >> scope;
+    long long n;
+    double low, high;
+    if (scope == "global") cfg.scope = ResidentScope::GLOBAL;
+    else if (scope == "local") cfg.scope = ResidentScope::LOCAL;
+    else if (scope == "ws") {
+        cfg.scope = ResidentScope::WORKING_SET;
+        if (ss >> n) cfg.tau = n;
+    } else if (scope == "pff") {
+        cfg.scope = ResidentScope::PFF;
+        if (ss >> n) cfg.window = n;
+        if (ss >> low >> high) { cfg.low = low; cfg.high = high; }
+    } else return false;
+    if (cfg.tau < 1) cfg.tau = 1;
+    if (cfg.window < 1) cfg.window = 1;
+    return true;
+}
+
+// one LRU chain of frames per job; front = least recently used
+class JobFrameLists {
+    vector<int> prev_, next_;
+    vector<int> head, tail;
+
+public:
+    void reset(int frames) { prev_.assign(frames, -1); next_.assign(frames, -1); head.clear(); tail.clear(); }
+    void add_job() { head.push_back(-1); tail.push_back(-1); }
+
+    int front(int job) const { return head[job]; }
+
+    void push_back(int job, int f) {
+        prev_[f] = tail[job]; next_[f] = -1;
+        if (tail[job] != -1) next_[tail[job]] = f; else head[job] = f;
+        tail[job] = f;
+    }
+    void remove(int job, int f) {
+        if (prev_[f] != -1) next_[prev_[f]] = next_[f]; else head[job] = next_[f];
+        if (next_[f] != -1) prev_[next_[f]] = prev_[f]; else tail[job] = prev_[f];
+        prev_[f] = next_[f] = -1;
+    }
+    void touch(int job, int f) { if (f != tail[job]) { remove(job, f); push_back(job, f); } }
+    void clear(int job) { head[job] = tail[job] = -1; }
+    void checkpoint(CheckpointArchive &ar) {
+        size_t n = prev_.size();
+        ar.io(prev_); ar.io(next_); ar.io(head); ar.io(tail);
+        if (ar.loading() && !consistent(n)) ar.fail();
+    }
+    // keeps the n frames reset gave it, and each job's links form one chain
+    // from head to tail; together the chains hold at most n frames
+    bool consistent(size_t n) const {
+        if (prev_.size() != n || next_.size() != n || head.size() != tail.size()) return false;
+        for (size_t i = 0; i < n; ++i)
+            if (prev_[i] < -1 || prev_[i] >= (int)n || next_[i] < -1 || next_[i] >= (int)n) return false;
+        size_t steps = 0;
+        for (size_t j = 0; j < head.size(); ++j) {
+            int last = -1;
+            for (int f = head[j]; f != -1; last = f, f = next_[f])
+                if (f < 0 || f >= (int)n || prev_[f] != last || ++steps > n) return false;
+            if (last != tail[j]) return false;
+        }
+        return true;
+    }
+    int jobs() const { return (int)head.size(); }
+};
+
+// per-job state of the resident-set controller
+struct JobResidentState {
+    long long quota = 0;         // local, pff: frames the job may hold
+    long long demand = 0;        // frames wanted when it was suspended
+    long long resume_at = 0;     // global reference count that forces a resume
+    long long window_start = 0;  // pff: job references at the start of the window
+    long long window_faults = 0;
+    bool suspended = false;
+    bool suspend_next = false;   // chosen to be swapped out at its next reference
+};
+
+// a reference held back while its job was suspended; replayed in order
+// when the job is readmitted
+struct DeferredRef {
+    long long page_no = 0;
+    long long next_use = 0;
+    bool write = false;
+};
+
+// resident set size of every job at regular reference counts; when the
+// buffer fills, every other sample is dropped and the interval doubles, so a
+// run of any length keeps between max_samples/2 and max_samples points
+class ResidentTimeline {
+    size_t max_samples;
+    long long interval;
+    long long next_at;
+
+public:
+    vector<long long> at;              // global reference count of each sample
+    vector<vector<long long>> resident; // resident[s][job]
+
+    explicit ResidentTimeline(size_t max_samples_ = 24, long long interval_ = 1024)
+        : max_samples(max_samples_ < 2 ? 2 : max_samples_), interval(interval_ < 1 ? 1 : interval_), next_at(interval) {}
+
+    bool due(long long references) const { return references >= next_at; }
+
+    template <class StatsVec>
+    void record(long long references, const StatsVec &stats) {
+        at.push_back(references);
+        resident.emplace_back();
+        for (const auto &st : stats) resident.back().push_back(st.resident);
+        if (at.size() >= max_samples) {
+            size_t k = 0;
+            for (size_t i = 1; i < at.size(); i += 2, ++k) { at[k] = at[i]; resident[k].swap(resident[i]); }
+            at.resize(k);
+            resident.resize(k);
+            interval *= 2;
+        }
+        next_at = references + interval;
+    }
+
+    void checkpoint(CheckpointArchive &ar) {
+        ar.io(max_samples); ar.io(interval); ar.io(next_at);
+        ar.io(at); ar.io(resident);
+    }
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef SHARED_PAGES_H
+#define SHARED_PAGES_H
+
+// shared_pages.h
+// Frames mapped by more than one (job, page) in DemandPager: a forked child
+// shares its parent's resident pages copy-on-write, and jobs in a shared
+// region (a Shared line in the job file, e.g. a library every job maps) map
+// a page another of them already holds instead of loading it again.
+//
+// The FrameTable keeps one mapper per frame, its primary. ReverseMap holds
+// the others: a singly linked list per frame whose nodes come from one pool
+// with a free list, so adding a mapper is O(1), visiting or removing them is
+// O(mappers of that frame), and a frame nobody shares costs only its list
+// head and count. The map is allocated by the first fork or shared mapping;
+// until then active() is false and DemandPager skips every sharing path.
+//
+// FRAME_COW (frame_table.h) marks a frame that may be shared and has not
+// been written since: a forked page, or a shared-region page loaded by a
+// read. A write while other mappers remain copies the page to a frame of
+// the writer's own (a COW fault); a write by the only mapper just clears the
+// bit. Only frames with the bit set are handed to other region members.
+
+#include <cstdint>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+// a forked job: at trace record `at`, job child_id starts as a copy of parent_id
+struct ForkPoint {
+    long long at = 0;
+    int parent_id = 0;
+    int child_id = 0;
+};
+
+// jobs whose first `pages` pages are the same memory
+struct SharedRegion {
+    long long pages = 0;
+    vector<int> members; // job indexes
+};
+
+class ReverseMap {
+    struct Node {
+        long long page;
+        int job;
+        int next;  // next node of the frame, or the next free node
+    };
+    vector<int> head;    // per frame: first extra mapper, -1 if none
+    vector<int> count;   // per frame: extra mappers
+    vector<Node> nodes;
+    int free_node = -1;
+    long long extra = 0, peak = 0;
+
+public:
+    bool active() const { return !head.empty(); }
+    int size() const { return (int)head.size(); }
+
+    void reset(int frames) {
+        head.assign(frames, -1);
+        count.assign(frames, 0);
+        nodes.clear();
+        free_node = -1;
+        extra = peak = 0;
+    }
+
+    // mappers of frame f, the primary included
+    int refs(int f) const { return active() ? 1 + count[f] : 1; }
+    bool shared(int f) const { return active() && count[f] > 0; }
+
+    // mappings beyond one per frame: the frames sharing saves, now and at most
+    long long saved() const { return extra; }
+    long long peak_saved() const { return peak; }
+
+    void add(int f, int job, long long page) {
+        int n;
+        if (free_node != -1) { n = free_node; free_node = nodes[n].next; }
+        else { n = (int)nodes.size(); nodes.push_back(Node()); }
+        nodes[n] = {page, job, head[f]};
+        head[f] = n;
+        ++count[f];
+        if (++extra > peak) peak = extra;
+    }
+
+    // drops (job, page) from the extra mappers of f; false if it is not one
+    bool remove(int f, int job, long long page) {
+        for (int *link = &head[f]; *link != -1; link = &nodes[*link].next) {
+            Node &node = nodes[*link];
+            if (node.job != job || node.page != page) continue;
+            int n = *link;
+            *link = node.next;
+            node.next = free_node;
+            free_node = n;
+            --count[f];
+            --extra;
+            return true;
+        }
+        return false;
+    }
+
+    // takes one extra mapper off f (to become its primary); false if none
+    bool pop(int f, int &job, long long &page) {
+        int n = head[f];
+        if (n == -1) return false;
+        job = nodes[n].job;
+        page = nodes[n].page;
+        head[f] = nodes[n].next;
+        nodes[n].next = free_node;
+        free_node = n;
+        --count[f];
+        --extra;
+        return true;
+    }
+
+    // fn(job, page) for each extra mapper of f
+    template <class F>
+    void for_each(int f, F fn) const {
+        if (!active()) return;
+        for (int n = head[f]; n != -1; n = nodes[n].next) fn(nodes[n].job, nodes[n].page);
+    }
+
+    // forgets every extra mapper of f
+    void clear(int f) {
+        while (head[f] != -1) {
+            int n = head[f];
+            head[f] = nodes[n].next;
+            nodes[n].next = free_node;
+            free_node = n;
+        }
+        extra -= count[f];
+        count[f] = 0;
+    }
+
+    void checkpoint(CheckpointArchive &ar) {
+        ar.io(head);
+        ar.io(count);
+        ar.io(nodes);
+        ar.io(free_node);
+        ar.io(extra);
+        ar.io(peak);
+        if (ar.loading() && !consistent()) ar.fail();
+    }
+
+    // every list ends within the node array and the per-frame lists and the
+    // free list together hold each node once, so no walk can loop
+    bool consistent() const {
+        if (head.size() != count.size() || extra > peak) return false;
+        long long n = (long long)nodes.size(), listed = 0;
+        // length of the list from `from`, or -1 past `limit` nodes or off the array
+        auto length = [&](int from, long long limit) {
+            long long steps = 0;
+            for (int i = from; i != -1; i = nodes[i].next)
+                if (i < 0 || i >= n || ++steps > limit) return -1LL;
+            return steps;
+        };
+        for (size_t f = 0; f < head.size(); ++f) {
+            if (count[f] < 0 || length(head[f], count[f]) != count[f]) return false;
+            listed += count[f];
+        }
+        if (listed != extra || listed > n) return false;
+        return length(free_node, n - listed) == n - listed;
+    }
+
+    // false if fn(job, page) is false for any extra mapper (after consistent())
+    template <class F>
+    bool mappers_valid(F fn) const {
+        for (size_t f = 0; f < head.size(); ++f)
+            for (int n = head[f]; n != -1; n = nodes[n].next)
+                if (!fn(nodes[n].job, nodes[n].page)) return false;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+// sim_core.h
+// The paging model the three programs share: one Job, one PhysicalMemory
+// and a compile-time configured translation core.
+//
+//   Job             a job, its size and the page table of its pages
+//   PhysicalMemory  frame owners, job names and free frames, with whole-job
+//                   placement (PMA.cpp)
+//   SimCore<Policy, PAGE_SHIFT, WITH_TLB, WITH_STATS>
+//                   jobs over a PhysicalMemory plus the translate / fault
+//                   path. demand_paged.cpp and the single-job mode of
+//                   paged_memory.cpp run on it; DemandPager
+//                   (demand_engine.h), the engine of every replay and of
+//                   --sweep, adds the run-time features on top of the same
+//                   Job and FrameTable.
+//
+// The choices of a SimCore are template parameters, so a build compiles
+// only what it uses and the hot path inlines completely:
+//   Policy      NoReplacement: pages stay where they were placed and a
+//               missing page is reported, not loaded; or a policy class from
+//               replacement.h, held by value so its calls are direct
+//   PAGE_SHIFT  log2 of a page size fixed at compile time (a shift and a
+//               mask per address), or 0 for a run-time page size (PageDivider)
+//   WITH_TLB    room for a TLB switched on by enable_tlb; false leaves out
+//               every probe
+//   WITH_STATS  per-job JobStats counters; false leaves out every counter
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_allocator.h"
+#include "frame_table.h"
+#include "metrics.h"
+#include "page_table.h"
+#include "replacement.h"
+#include "tlb.h"
+#include "translate.h"
+
+using namespace std;
+
+struct Job {
+    int id;
+    string name;             // as entered (PMA.cpp, demand_paged.cpp); empty for numbered jobs
+    long long size;          // bytes (KB in PMA.cpp)
+    long long num_pages;
+    long long internal_frag; // unused part of the last page, in the unit of size
+    PageTable page_table;    // page -> frame number or -1, allocated as pages are touched
+    long long start = -1;    // first unit of its block under contiguous allocation, -1 if none
+    Job(int id_=0, long long size_=0, long long num_pages_=0, long long internal_frag_=0)
+        : id(id_), size(size_), num_pages(num_pages_), internal_frag(internal_frag_) {}
+};
+
+// builds a job with its page count, last-page fragmentation and an empty page table;
+// pt_levels = 0 lets the page table pick its depth from the job size
+inline Job make_job(int id, long long size, long long page_size, int pt_levels = 0) {
+    long long np = (size + page_size - 1) / page_size;
+    long long last_used = size % page_size;
+    long long frag = (last_used == 0 || np==0) ? 0 : (page_size - last_used);
+    Job job(id, size, np, frag);
+    job.page_table.init(np, pt_levels);
+    return job;
+}
+
+// physical memory: the job page in each frame, job names and the free frames
+struct PhysicalMemory {
+    FrameTable frames;                       // owner id and page per frame
+    JobTable jobNames;                       // job name <-> id, for callers that name jobs
+    FreeFrameAllocator freeFrames{0, false};
+
+    // every frame free; random placement keeps the free array allocateRandom needs
+    void reset(int numFrames, bool randomPlacement = false) {
+        frames.reset(numFrames);
+        freeFrames = FreeFrameAllocator(numFrames, randomPlacement);
+    }
+
+    // gives every page of the job one of the lowest free frames, or none at
+    // all if memory is short or the owner id does not fit the frame table;
+    // true if the whole job was placed
+    bool placeJob(Job &job, int owner) {
+        if (!FrameTable::valid_owner(owner) || freeFrames.freeCount() < job.num_pages) return false;
+        vector<int> got((size_t)job.num_pages);
+        freeFrames.allocateFirstN((int)job.num_pages, got.data()); // a bitmap word at a time
+        job.page_table.init(job.num_pages, 0);
+        for (long long p = 0; p < job.num_pages; ++p) {
+            frames.assign(got[p], owner, p);
+            job.page_table.set(p, got[p]);
+        }
+        return true;
+    }
+
+    // hands all of a job's frames back to the free pool and drops its page
+    // table; one step per resident page, independent of memory size
+    void releaseJob(Job &job) {
+        job.page_table.for_each_mapped([&](long long, int f) {
+            frames.clear(f);
+            freeFrames.release(f);
+        });
+        job.page_table = PageTable();
+    }
+};
+
+// the Policy of a core that never evicts
+struct NoReplacement {};
+
+// outcome of SimCore::translate
+struct CoreAccess {
+    long long page = 0;
+    long long offset = 0;
+    int frame = -1;       // -1: not resident and not loaded
+    bool fault = false;   // the page was not resident
+    bool tlb_hit = false;
+    int victim = -1;      // frame evicted for it, -1 if none
+};
+
+// a policy with its seed if it takes one (RandomPolicy), default-built otherwise
+template <class P>
+P seeded_policy(unsigned seed) {
+    if constexpr (is_constructible<P, unsigned>::value) return P(seed);
+    else { (void)seed; return P(); }
+}
+
+template <class Policy, int PAGE_SHIFT = 0, bool WITH_TLB = false, bool WITH_STATS = true>
+class SimCore {
+public:
+    static constexpr bool REPLACES = !is_same<Policy, NoReplacement>::value;
+    static constexpr bool FIXED_PAGE = PAGE_SHIFT > 0;
+
+    int page_size;
+    int num_frames;
+    PhysicalMemory mem;
+    vector<Job> jobs;
+    vector<JobStats> stats;           // parallel to jobs, empty without WITH_STATS
+    unique_ptr<Tlb> tlb;              // WITH_TLB only, null until enable_tlb
+    int pt_levels = 0;                // page-table depth for new jobs, 0 = automatic
+
+private:
+    PageDivider divider;
+    unordered_map<int,int> job_index; // job id -> index into jobs
+    mt19937 rng;
+    Policy policy;
+
+public:
+    // the generator is drawn from in the same order as DemandPager's, so a
+    // core and an engine with the same seed make the same random choices
+    SimCore(int page_size_, int num_frames_, unsigned seed, bool random_placement = false)
+        : page_size(FIXED_PAGE ? 1 << PAGE_SHIFT : page_size_), num_frames(num_frames_),
+          divider((uint64_t)page_size), rng(seed), policy(seeded_policy<Policy>(rng())) {
+        mem.reset(num_frames, random_placement);
+        if constexpr (REPLACES) policy.reset(num_frames);
+    }
+
+    void enable_tlb(const TlbConfig &config) {
+        static_assert(WITH_TLB, "this core is built without a TLB");
+        tlb.reset(new Tlb(config, rng()));
+    }
+
+    const char *policy_name() const {
+        if constexpr (REPLACES) return policy.name();
+        else return "none";
+    }
+
+    // true if access wants the position of each page's next reference (OPT)
+    bool needs_lookahead() const {
+        if constexpr (REPLACES) return policy.needs_lookahead();
+        else return false;
+    }
+
+    // registers a job and returns its index (its owner id in the frame table),
+    // or -1 once that index would not fit a frame's owner field
+    int add_job(int id, long long size, const string &name = "") {
+        if ((long long)jobs.size() > FrameTable::MAX_OWNER) return -1;
+        jobs.push_back(make_job(id, size, page_size, pt_levels));
+        jobs.back().name = name;
+        if constexpr (WITH_STATS) {
+            stats.emplace_back();
+            stats.back().internal_frag = jobs.back().internal_frag;
+        }
+        job_index[id] = (int)jobs.size() - 1;
+        return (int)jobs.size() - 1;
+    }
+
+    // index of the job with this id, or -1
+    int find_job(int id) const {
+        auto it = job_index.find(id);
+        return it == job_index.end() ? -1 : it->second;
+    }
+
+    // id of the job owning a frame, or -1 if the frame is free
+    int frame_job_id(int frame) const {
+        int owner = mem.frames.owner(frame);
+        return owner == -1 ? -1 : jobs[owner].id;
+    }
+
+    // counters summed over every job
+    JobStats total() const {
+        JobStats sum;
+        for (const JobStats &st : stats) sum += st;
+        return sum;
+    }
+
+    uint64_t page_of(long long addr) const {
+        if constexpr (FIXED_PAGE) return (uint64_t)addr >> PAGE_SHIFT;
+        else return divider.page((uint64_t)addr);
+    }
+
+    // puts a page of job idx in a uniformly random free frame (the core must
+    // have been built with random placement); the frame, or -1 if memory is full
+    int place_random(int idx, long long page_no) {
+        int f = mem.freeFrames.allocateRandom(rng);
+        if (f != -1) map_page(idx, page_no, f, NEVER_USED);
+        return f;
+    }
+
+    // loads the job's non-resident pages in random order into the lowest
+    // free frames until memory is full or the job is done; returns the pages loaded
+    int preload(int idx) {
+        Job &job = jobs[idx];
+        int loaded = 0;
+        auto load = [&](long long p) {
+            if (job.page_table[p] != -1) return true;
+            int f = mem.freeFrames.allocateFirst();
+            if (f == -1) return false;
+            map_page(idx, p, f, NEVER_USED);
+            ++loaded;
+            return true;
+        };
+        if (job.num_pages <= 4LL * num_frames) {
+            vector<long long> pages(job.num_pages);
+            iota(pages.begin(), pages.end(), 0LL);
+            shuffle(pages.begin(), pages.end(), rng);
+            for (long long p : pages) if (!load(p)) break;
+        } else {
+            uniform_int_distribution<long long> dist(0, job.num_pages - 1);
+            while (mem.freeFrames.freeCount() > 0) load(dist(rng));
+        }
+        return loaded;
+    }
+
+    // translates byte addr of job idx (0 <= addr < size) with a full report
+    CoreAccess translate(int idx, long long addr, long long next_use = NEVER_USED) {
+        CoreAccess a;
+        a.page = (long long)page_of(addr);
+        a.offset = addr - a.page * page_size;
+        a.frame = access(idx, a.page, next_use, &a);
+        return a;
+    }
+
+    // references one page of job idx and returns its frame: through the TLB,
+    // then the page table; a missing page is faulted in if Policy replaces
+    // pages, and otherwise gives -1. next_use is only read by OPT
+    int access(int idx, long long page_no, long long next_use = NEVER_USED, CoreAccess *out = nullptr) {
+        Job &job = jobs[idx];
+        if constexpr (WITH_STATS) ++stats[idx].references;
+        if constexpr (WITH_TLB) {
+            if (tlb) {
+                tlb->switch_to(job.id);
+                int f;
+                if (tlb->lookup(job.id, (uint64_t)page_no, f)) {
+                    if (out) out->tlb_hit = true;
+                    hit(idx, f, next_use);
+                    return f;
+                }
+            }
+        }
+        const int32_t *flat = job.page_table.flat();
+        int f = flat ? flat[page_no] : job.page_table.lookup(page_no);
+        if (f != -1) {
+            if constexpr (WITH_TLB) if (tlb) tlb->insert(job.id, (uint64_t)page_no, f);
+            hit(idx, f, next_use);
+            return f;
+        }
+        if (out) out->fault = true;
+        if constexpr (WITH_STATS) ++stats[idx].faults;
+        if constexpr (!REPLACES) return -1;
+        else return fault(idx, page_no, next_use, out);
+    }
+
+private:
+    void hit(int idx, int f, long long next_use) {
+        if constexpr (WITH_STATS) ++stats[idx].hits;
+        if constexpr (REPLACES) policy.on_hit(f, next_use);
+        (void)idx; (void)f; (void)next_use;
+    }
+
+    void map_page(int idx, long long page_no, int f, long long next_use) {
+        Job &job = jobs[idx];
+        mem.frames.assign(f, idx, page_no);
+        job.page_table.set(page_no, f);
+        if constexpr (WITH_STATS) ++stats[idx].resident;
+        if constexpr (REPLACES) policy.on_load(f, page_key(job.id, page_no), next_use);
+        (void)next_use;
+    }
+
+    // a free frame, or the policy's victim taken from its page
+    int fault(int idx, long long page_no, long long next_use, CoreAccess *out) {
+        Job &job = jobs[idx];
+        int f = mem.freeFrames.allocateFirst();
+        if (f == -1) {
+            f = policy.choose_victim(page_key(job.id, page_no));
+            if (f == -1) return -1;
+            int v = mem.frames.owner(f);
+            long long vp = mem.frames.page(f);
+            jobs[v].page_table.set(vp, -1);
+            if constexpr (WITH_TLB) if (tlb) tlb->invalidate(jobs[v].id, (uint64_t)vp);
+            if constexpr (WITH_STATS) {
+                ++stats[idx].evictions;
+                ++stats[v].evicted;
+                --stats[v].resident;
+            }
+            if (out) out->victim = f;
+        }
+        map_page(idx, page_no, f, next_use);
+        if constexpr (WITH_TLB) if (tlb) tlb->insert(job.id, (uint64_t)page_no, f);
+        return f;
+    }
+};
+
+#endif
@@ -3,36 +3,26 @@
 
 #include <string>
 #include <vector>
+#include "sim_core.h"
 using namespace std;
 
-// Represents a single page belonging to a job
-struct Page {
-    int pageNumber;
-    int frameNumber; // -1 if not allocated
-};
-
-// Represents a job
-struct Job {
-    string name;
-    int size;          // job size in KB
-    int numPages;      // computed from job size and page size
-    vector<Page> pages;
-};
+// Jobs (name, size in KB, page table) are sim_core.h's Job
 
-// Represents a single frame in main memory
-struct Frame {
-    int frameNumber;
-    bool isFree;
+// An arrival or exit in a stream of jobs (churn simulation)
+struct JobEvent {
+    enum Type { ARRIVE, EXIT };
+    Type type;
+    double time;
     string jobName;
-    int pageNumber;
+    int size;          // KB, arrivals only
+    double duration;   // run time once admitted; <= 0 runs until an explicit Exit
 };
 
 // Represents the entire main memory
-struct Memory {
+struct Memory : PhysicalMemory {
     int totalSize;
     int pageSize;
     int numFrames;
-    vector<Frame> frames;
 };
 
 #endif
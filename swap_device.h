@@ -0,0 +1,161 @@
+#ifndef SWAP_DEVICE_H
+#define SWAP_DEVICE_H
+
+// swap_device.h
+// Backing-store model for the demand-paging engine (DemandPager::enable_swap).
+//
+// Time is simulated: every reference costs one memory access, and page
+// transfers occupy one swap device for latency + page_size / bandwidth each.
+// A fault reads its page and waits for it; the read goes ahead of write-backs
+// that are queued but not started yet. Evicting a dirty page hands its
+// contents to one of queue_depth write-back buffers and the fault goes on at
+// once; only when every buffer is still waiting for the device does the
+// eviction stall until the oldest write completes. Clean pages are dropped
+// for free. A background cleaner (DemandPager) writes aged dirty pages while
+// buffers are idle, so that later evictions find them clean.
+//
+// The effective access time is the simulated time divided by references:
+// memory latency plus the waits for page reads and write-back buffers.
+
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <string>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+struct SwapConfig {
+    bool enabled = false;
+    double latency_us = 100.0;     // per transfer (command and seek overhead)
+    double bandwidth_mb = 500.0;   // MB/s (10^6 bytes)
+    int queue_depth = 32;          // write-back buffers
+    long long clean_every = 0;     // references between cleaner runs, 0 = no cleaner
+    int clean_batch = 32;          // pages a cleaner run writes at most
+    int prefer_clean = 0;          // frames past the policy's choice searched for a clean victim
+    double memory_ns = 100.0;      // cost of one reference that does not fault
+};
+
+// "<latency_us> <MB/s> [queue_depth]"; false if the numbers are missing
+inline bool parse_swap(const string &spec, SwapConfig &cfg) {
+    stringstream ss(spec);
+    double latency, bandwidth;
+    if (!(ss >> latency >> bandwidth) || latency < 0 || bandwidth <= 0) return false;
+    cfg.enabled = true;
+    cfg.latency_us = latency;
+    cfg.bandwidth_mb = bandwidth;
+    int depth;
+    if (ss >> depth) cfg.queue_depth = max(1, depth);
+    return true;
+}
+
+struct SwapStats {
+    long long reads = 0;            // pages read for faults and read-ahead
+    long long writes = 0;           // dirty pages written on eviction
+    long long cleaner_writes = 0;   // dirty pages written ahead by the cleaner
+    long long clean_evictions = 0;
+    long long dirty_evictions = 0;
+    long long write_stalls = 0;     // evictions that found every buffer busy
+    double read_wait_ns = 0;        // faults waiting for their page
+    double write_wait_ns = 0;       // evictions waiting for a buffer
+};
+
+class SwapDevice {
+    double service_ns = 0;        // one page transfer
+    double free_at = 0;           // the device finishes its queue
+    deque<double> pending;        // completion times of writes in the buffers, ascending
+
+    // drops writes that completed by now
+    void retire() {
+        while (!pending.empty() && pending.front() <= now) pending.pop_front();
+    }
+
+    double queue_write() {
+        double done = max(now, free_at) + service_ns;
+        free_at = done;
+        pending.push_back(done);
+        return done;
+    }
+
+public:
+    SwapConfig cfg;
+    SwapStats stats;
+    double now = 0;               // simulated ns
+
+    void init(const SwapConfig &config, int page_size) {
+        cfg = config;
+        service_ns = cfg.latency_us * 1000.0 + (double)page_size / (cfg.bandwidth_mb * 1e6) * 1e9;
+    }
+
+    void tick() { now += cfg.memory_ns; }
+
+    bool buffer_free() {
+        retire();
+        return (int)pending.size() < cfg.queue_depth;
+    }
+
+    // a dirty page leaves memory
+    void write_back() {
+        ++stats.dirty_evictions;
+        ++stats.writes;
+        if (!buffer_free()) {
+            ++stats.write_stalls;
+            stats.write_wait_ns += pending.front() - now;
+            now = pending.front();
+            retire();
+        }
+        queue_write();
+    }
+
+    // the cleaner writes a dirty page that stays resident; false if every buffer is busy
+    bool clean() {
+        if (!buffer_free()) return false;
+        ++stats.cleaner_writes;
+        queue_write();
+        return true;
+    }
+
+    // reads a page; the reference waits for it unless it is read ahead. The
+    // read starts once the transfer in progress ends and delays the writes
+    // queued behind it
+    void read(bool wait = true) {
+        ++stats.reads;
+        retire();
+        double start;
+        if (pending.empty()) {
+            start = max(now, free_at);
+            free_at = start + service_ns;
+        } else {
+            double first = pending.front() - service_ns; // the oldest write starts here
+            start = first < now ? pending.front() : first;
+            for (auto &t : pending) if (t > start) t += service_ns;
+            free_at += service_ns;
+        }
+        double done = start + service_ns;
+        if (!wait) return;
+        stats.read_wait_ns += done - now;
+        now = done;
+    }
+
+    // average ns per reference so far
+    double effective_access_time(long long references) const { return references ? now / references : 0.0; }
+
+    // bytes moved in each direction
+    long long bytes_read(int page_size) const { return stats.reads * (long long)page_size; }
+    long long bytes_written(int page_size) const { return (stats.writes + stats.cleaner_writes) * (long long)page_size; }
+
+    // cfg comes from DemandPager::enable_swap and is saved by the caller
+    void checkpoint(CheckpointArchive &ar) {
+        ar.section("swap");
+        ar.io(service_ns);
+        ar.io(free_at);
+        ar.io(now);
+        ar.io(stats);
+        vector<double> queued(pending.begin(), pending.end());
+        ar.io(queued);
+        if (ar.loading()) pending.assign(queued.begin(), queued.end());
+    }
+};
+
+#endif
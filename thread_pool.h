@@ -0,0 +1,81 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// thread_pool.h
+// Work-stealing pool for batches of independent simulations. run() deals the
+// tasks round-robin onto one deque per worker; a worker pops from the back of
+// its own deque and, once that is empty, steals from the front of the others,
+// so a few long configurations do not leave the other cores idle.
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class WorkStealingPool {
+    struct Queue {
+        mutex m;
+        deque<function<void()>> tasks;
+    };
+
+    int num_threads;
+    vector<unique_ptr<Queue>> queues;
+    atomic<long long> steals{0};
+
+    bool pop_own(int id, function<void()> &task) {
+        Queue &q = *queues[id];
+        lock_guard<mutex> lock(q.m);
+        if (q.tasks.empty()) return false;
+        task = move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int id, function<void()> &task) {
+        for (int k = 1; k < num_threads; ++k) {
+            Queue &q = *queues[(id + k) % num_threads];
+            lock_guard<mutex> lock(q.m);
+            if (q.tasks.empty()) continue;
+            task = move(q.tasks.front());
+            q.tasks.pop_front();
+            ++steals;
+            return true;
+        }
+        return false;
+    }
+
+    void worker(int id) {
+        function<void()> task;
+        while (pop_own(id, task) || steal(id, task)) task();
+    }
+
+public:
+    // threads <= 0 uses every hardware thread
+    explicit WorkStealingPool(int threads = 0) {
+        if (threads <= 0) threads = (int)thread::hardware_concurrency();
+        num_threads = max(1, threads);
+        for (int i = 0; i < num_threads; ++i) queues.emplace_back(new Queue());
+    }
+
+    int size() const { return num_threads; }
+    long long steal_count() const { return steals.load(); }
+
+    // runs every task and returns when all have finished
+    void run(vector<function<void()>> &tasks) {
+        for (size_t i = 0; i < tasks.size(); ++i)
+            queues[i % num_threads]->tasks.push_back(move(tasks[i]));
+        tasks.clear();
+        vector<thread> threads;
+        for (int i = 1; i < num_threads; ++i) threads.emplace_back(&WorkStealingPool::worker, this, i);
+        worker(0);
+        for (auto &t : threads) t.join();
+    }
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef TLB_H
+#define TLB_H
+
+// tlb.h
+// Set-associative translation lookaside buffer placed in front of the page
+// table lookups. Entries are tagged with the job id as an ASID, or the whole
+// TLB is flushed whenever the running job changes (flush_on_switch).
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+enum class TlbReplacement { LRU, FIFO, RANDOM };
+
+struct TlbConfig {
+    int entries = 64;
+    int ways = 4;                 // associativity; ways == entries is fully associative
+    TlbReplacement replacement = TlbReplacement::LRU;
+    bool flush_on_switch = false; // false: entries carry an ASID and survive job switches
+    double tlb_latency = 1.0;     // ns per TLB probe
+    double memory_latency = 100.0; // ns per memory access
+    int walk_accesses = 1;        // memory accesses per page-table walk
+};
+
+inline bool parse_tlb_replacement(const string &name, TlbReplacement &out) {
+    if (name == "lru") out = TlbReplacement::LRU;
+    else if (name == "fifo") out = TlbReplacement::FIFO;
+    else if (name == "random") out = TlbReplacement::RANDOM;
+    else return false;
+    return true;
+}
+
+inline const char *tlb_replacement_name(TlbReplacement r) {
+    return r == TlbReplacement::LRU ? "lru" : r == TlbReplacement::FIFO ? "fifo" : "random";
+}
+
+struct TlbStats {
+    long long hits = 0;
+    long long misses = 0;
+    long long flushes = 0;
+    long long invalidations = 0;
+    double hit_rate() const { long long n = hits + misses; return n ? (double)hits / n : 0.0; }
+};
+
+class Tlb {
+    struct Entry {
+        uint64_t vpn;
+        int asid;
+        int frame;
+        uint64_t stamp; // last use (LRU) or insertion (FIFO)
+        bool valid;
+    };
+
+    TlbConfig cfg;
+    int num_sets;
+    vector<Entry> entries; // num_sets * ways, one set after another
+    uint64_t clock = 0;
+    int current_asid = -1;
+    mt19937 rng;
+
+    Entry *set_of(int asid, uint64_t vpn) {
+        uint64_t h = vpn ^ ((uint64_t)(uint32_t)asid * 0x9E3779B97F4A7C15ULL);
+        return &entries[(size_t)(h % (uint64_t)num_sets) * cfg.ways];
+    }
+
+public:
+    TlbStats stats;
+
+    explicit Tlb(const TlbConfig &config, unsigned seed = 1) : cfg(config), rng(seed) {
+        if (cfg.entries < 1) cfg.entries = 1;
+        if (cfg.ways < 1 || cfg.ways > cfg.entries) cfg.ways = cfg.entries;
+        num_sets = cfg.entries / cfg.ways;
+        cfg.entries = num_sets * cfg.ways;
+        entries.assign(cfg.entries, Entry{0, -1, -1, 0, false});
+    }
+
+    const TlbConfig &config() const { return cfg; }
+    int sets() const { return num_sets; }
+
+    // called before every translation; flushes when a flush-on-switch TLB sees a new job
+    void switch_to(int asid) {
+        if (asid == current_asid) return;
+        current_asid = asid;
+        if (cfg.flush_on_switch) flush();
+    }
+
+    // probes the TLB; on a hit stores the frame and returns true
+    bool lookup(int asid, uint64_t vpn, int &frame) {
+        Entry *set = set_of(asid, vpn);
+        for (int w = 0; w < cfg.ways; ++w) {
+            Entry &e = set[w];
+            if (e.valid && e.vpn == vpn && e.asid == asid) {
+                if (cfg.replacement == TlbReplacement::LRU) e.stamp = ++clock;
+                frame = e.frame;
+                ++stats.hits;
+                return true;
+            }
+        }
+        ++stats.misses;
+        return false;
+    }
+
+    // caches a translation after a miss (page-table walk or page fault)
+    void insert(int asid, uint64_t vpn, int frame) {
+        Entry *set = set_of(asid, vpn);
+        Entry *victim = nullptr;
+        for (int w = 0; w < cfg.ways && !victim; ++w)
+            if (!set[w].valid) victim = &set[w];
+        if (!victim) {
+            if (cfg.replacement == TlbReplacement::RANDOM) {
+                victim = &set[uniform_int_distribution<int>(0, cfg.ways - 1)(rng)];
+            } else {
+                victim = &set[0];
+                for (int w = 1; w < cfg.ways; ++w)
+                    if (set[w].stamp < victim->stamp) victim = &set[w];
+            }
+        }
+        *victim = Entry{vpn, asid, frame, ++clock, true};
+    }
+
+    // drops a translation whose page was evicted
+    void invalidate(int asid, uint64_t vpn) {
+        Entry *set = set_of(asid, vpn);
+        for (int w = 0; w < cfg.ways; ++w)
+            if (set[w].valid && set[w].vpn == vpn && set[w].asid == asid) {
+                set[w].valid = false;
+                ++stats.invalidations;
+            }
+    }
+
+    void flush() {
+        for (auto &e : entries) e.valid = false;
+        ++stats.flushes;
+    }
+
+    // the configuration comes from the constructor and must match
+    void checkpoint(CheckpointArchive &ar) {
+        ar.section("tlb");
+        size_t n = entries.size();
+        ar.io(entries);
+        ar.io(clock);
+        ar.io(current_asid);
+        ar.io(rng);
+        ar.io(stats);
+        if (ar.loading() && entries.size() != n) ar.fail();
+    }
+
+    // every valid entry maps to one of the frames of memory
+    bool frames_valid(int frames) const {
+        for (const Entry &e : entries)
+            if (e.valid && (e.frame < 0 || e.frame >= frames)) return false;
+        return true;
+    }
+
+    // bytes of address space covered by a full TLB
+    long long reach(long long page_size) const { return (long long)cfg.entries * page_size; }
+
+    // average ns per reference: every reference probes the TLB and then reads
+    // memory; a miss adds the page-table walk
+    double effective_access_time() const {
+        double miss = 1.0 - stats.hit_rate();
+        if (stats.hits + stats.misses == 0) miss = 0.0;
+        return cfg.tlb_latency + cfg.memory_latency + miss * cfg.walk_accesses * cfg.memory_latency;
+    }
+};
+
+#endif
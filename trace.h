@@ -0,0 +1,378 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// trace.h
+// Address-trace input for batch replay.
+//
+// Text traces have one reference per line: "<job_id> <logical_address> [R|W]";
+// blank lines and lines starting with '#' are skipped. The reader pulls the
+// file in large blocks and parses numbers in place, so next() does no heap
+// allocation and no stream formatting.
+//
+// Binary traces (written by trace_convert) start with a 32-byte header
+//   char     magic[8]      "VMTRACE1"
+//   uint32   encoding      TRACE_FIXED or TRACE_DELTA
+//   uint32   flags         TRACE_HAS_RW if the write bits are meaningful
+//   uint64   record_count
+//   uint64   reserved
+// followed by the records, little-endian:
+//   TRACE_FIXED  12 bytes: uint64 address, uint32 job_id | write << 31
+//   TRACE_DELTA  varint(job_id << 1 | write), then the zigzag varint of the
+//                address minus the previous address of the same job
+// MappedTraceReader maps the file and decodes records straight from the
+// mapping; fixed-width records can also be walked in place via records().
+//
+// A trace name of the form "gen:<spec>" is not a file: TraceInput generates
+// the references from the workload spec (workload.h) as they are read.
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "workload.h"
+
+using namespace std;
+
+struct TraceRef {
+    int job_id;
+    long long address; // logical byte address within the job
+    bool write = false;
+};
+
+const char TRACE_MAGIC[8] = {'V','M','T','R','A','C','E','1'};
+const uint32_t TRACE_FIXED = 0;
+const uint32_t TRACE_DELTA = 1;
+const uint32_t TRACE_HAS_RW = 1;
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t encoding;
+    uint32_t flags;
+    uint64_t record_count;
+    uint64_t reserved;
+};
+static_assert(sizeof(TraceHeader) == 32, "trace header must stay 32 bytes");
+
+#pragma pack(push, 1)
+struct TraceRecord {
+    uint64_t address;
+    uint32_t job_and_rw; // job id in the low 31 bits, write flag in bit 31
+    int job_id() const { return (int)(job_and_rw & 0x7fffffffu); }
+    bool write() const { return (job_and_rw >> 31) != 0; }
+};
+#pragma pack(pop)
+static_assert(sizeof(TraceRecord) == 12, "fixed trace records are 12 bytes");
+
+class TextTraceReader {
+    FILE *file = nullptr;
+    vector<char> buf;
+    size_t pos = 0, len = 0;
+    long long line_no = 0;
+
+    int peek() {
+        if (pos == len) {
+            if (!file) return EOF;
+            len = fread(buf.data(), 1, buf.size(), file);
+            pos = 0;
+            if (len == 0) return EOF;
+        }
+        return (unsigned char)buf[pos];
+    }
+    int get() { int c = peek(); if (c != EOF) ++pos; return c; }
+
+    void skip_blanks() { int c; while ((c = peek()) == ' ' || c == '\t' || c == '\r') ++pos; }
+    void skip_line() { int c; while ((c = get()) != EOF && c != '\n') {} ++line_no; }
+
+    bool read_number(long long &v) {
+        skip_blanks();
+        bool neg = false;
+        int c = peek();
+        if (c == '-') { neg = true; ++pos; c = peek(); }
+        if (c < '0' || c > '9') return false;
+        long long x = 0;
+        while ((c = peek()) >= '0' && c <= '9') { x = x*10 + (c - '0'); ++pos; }
+        v = neg ? -x : x;
+        return true;
+    }
+
+public:
+    long long malformed = 0; // lines skipped because they did not parse
+
+    explicit TextTraceReader(const string &filename, size_t block = 1 << 20) : buf(block) {
+        file = fopen(filename.c_str(), "rb");
+    }
+    ~TextTraceReader() { if (file) fclose(file); }
+    TextTraceReader(const TextTraceReader &) = delete;
+    TextTraceReader &operator=(const TextTraceReader &) = delete;
+
+    bool is_open() const { return file != nullptr; }
+
+    // reads the next reference; returns false at end of file
+    bool next(TraceRef &ref) {
+        while (true) {
+            skip_blanks();
+            int c = peek();
+            if (c == EOF) return false;
+            if (c == '\n' || c == '#') { skip_line(); continue; }
+            long long job, addr;
+            if (read_number(job) && read_number(addr)) {
+                skip_blanks();
+                c = peek();
+                ref.write = (c == 'W' || c == 'w');
+                skip_line();
+                ref.job_id = (int)job;
+                ref.address = addr;
+                return true;
+            }
+            ++malformed;
+            skip_line();
+        }
+    }
+};
+
+// previous address of each job, for delta coding; small ids use a flat array
+class LastAddressTable {
+    vector<long long> low;
+    unordered_map<int,long long> high;
+public:
+    void clear() { low.clear(); high.clear(); }
+    long long &operator[](int job_id) {
+        if ((unsigned)job_id < 65536u) {
+            if ((size_t)job_id >= low.size()) low.resize((size_t)job_id + 1, 0);
+            return low[job_id];
+        }
+        return high[job_id];
+    }
+};
+
+// appends references to a binary trace; the header is finalised by close()
+class BinaryTraceWriter {
+    FILE *file = nullptr;
+    uint32_t encoding;
+    bool has_rw;
+    uint64_t count = 0;
+    vector<unsigned char> buf;
+    LastAddressTable last_addr;
+
+    void flush_buf() {
+        if (!buf.empty()) fwrite(buf.data(), 1, buf.size(), file);
+        buf.clear();
+    }
+    void put_varint(uint64_t v) {
+        while (v >= 0x80) { buf.push_back((unsigned char)(v | 0x80)); v >>= 7; }
+        buf.push_back((unsigned char)v);
+    }
+
+public:
+    BinaryTraceWriter(const string &filename, uint32_t encoding_ = TRACE_DELTA, bool has_rw_ = true)
+        : encoding(encoding_), has_rw(has_rw_) {
+        file = fopen(filename.c_str(), "wb");
+        TraceHeader h = {};
+        if (file) fwrite(&h, sizeof(h), 1, file); // placeholder until close()
+        buf.reserve(1 << 20);
+    }
+    ~BinaryTraceWriter() { close(); }
+    BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+    BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+
+    bool is_open() const { return file != nullptr; }
+    uint64_t written() const { return count; }
+
+    void write(const TraceRef &ref) {
+        bool w = has_rw && ref.write;
+        if (encoding == TRACE_FIXED) {
+            TraceRecord rec;
+            rec.address = (uint64_t)ref.address;
+            rec.job_and_rw = ((uint32_t)ref.job_id & 0x7fffffffu) | ((uint32_t)w << 31);
+            const unsigned char *p = (const unsigned char *)&rec;
+            buf.insert(buf.end(), p, p + sizeof(rec));
+        } else {
+            put_varint(((uint64_t)(uint32_t)ref.job_id << 1) | (uint64_t)w);
+            long long &last = last_addr[ref.job_id];
+            long long delta = ref.address - last;
+            last = ref.address;
+            put_varint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        }
+        ++count;
+        if (buf.size() >= (1 << 20)) flush_buf();
+    }
+
+    void close() {
+        if (!file) return;
+        flush_buf();
+        TraceHeader h;
+        memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+        h.encoding = encoding;
+        h.flags = has_rw ? TRACE_HAS_RW : 0;
+        h.record_count = count;
+        h.reserved = 0;
+        fseek(file, 0, SEEK_SET);
+        fwrite(&h, sizeof(h), 1, file);
+        fclose(file);
+        file = nullptr;
+    }
+};
+
+// memory-maps a binary trace and decodes it in place
+class MappedTraceReader {
+    const unsigned char *base = nullptr;
+    size_t size = 0;
+    TraceHeader header = {};
+    const unsigned char *cur = nullptr, *end = nullptr;
+    uint64_t remaining = 0;
+    LastAddressTable last_addr;
+
+    bool get_varint(uint64_t &v) {
+        v = 0;
+        for (int shift = 0; cur < end && shift < 64; shift += 7) {
+            unsigned char b = *cur++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+public:
+    explicit MappedTraceReader(const string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TraceHeader)) {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                base = (const unsigned char *)p;
+                size = (size_t)st.st_size;
+                madvise(p, size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if (!base) return;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+            (header.encoding == TRACE_FIXED && header.record_count > (size - sizeof(header)) / sizeof(TraceRecord))) {
+            munmap((void *)base, size);
+            base = nullptr;
+            return;
+        }
+        rewind();
+    }
+    ~MappedTraceReader() { if (base) munmap((void *)base, size); }
+    MappedTraceReader(const MappedTraceReader &) = delete;
+    MappedTraceReader &operator=(const MappedTraceReader &) = delete;
+
+    bool is_open() const { return base != nullptr; }
+    const TraceHeader &info() const { return header; }
+    uint64_t record_count() const { return header.record_count; }
+    bool has_rw() const { return (header.flags & TRACE_HAS_RW) != 0; }
+
+    // fixed-width traces only: the records as they sit in the mapping
+    const TraceRecord *records() const {
+        return header.encoding == TRACE_FIXED ? (const TraceRecord *)(base + sizeof(TraceHeader)) : nullptr;
+    }
+
+    // passes over up to n references; fixed-width records are skipped in
+    // one step, delta records have to be decoded
+    uint64_t skip(uint64_t n) {
+        if (n > remaining) n = remaining;
+        if (header.encoding == TRACE_FIXED) {
+            n = min<uint64_t>(n, (uint64_t)(end - cur) / sizeof(TraceRecord));
+            cur += n * sizeof(TraceRecord);
+            remaining -= n;
+            return n;
+        }
+        TraceRef ref;
+        uint64_t done = 0;
+        while (done < n && next(ref)) ++done;
+        return done;
+    }
+
+    void rewind() {
+        cur = base + sizeof(TraceHeader);
+        end = base + size;
+        remaining = header.record_count;
+        last_addr.clear();
+    }
+
+    // decodes the next reference; returns false at the end of the trace
+    bool next(TraceRef &ref) {
+        if (remaining == 0) return false;
+        if (header.encoding == TRACE_FIXED) {
+            if ((size_t)(end - cur) < sizeof(TraceRecord)) { remaining = 0; return false; }
+            const TraceRecord *rec = (const TraceRecord *)cur;
+            cur += sizeof(TraceRecord);
+            ref.job_id = rec->job_id();
+            ref.address = (long long)rec->address;
+            ref.write = rec->write();
+        } else {
+            uint64_t tag, zz;
+            if (!get_varint(tag) || !get_varint(zz)) { remaining = 0; return false; }
+            ref.job_id = (int)(tag >> 1);
+            ref.write = (tag & 1) != 0;
+            long long delta = (long long)(zz >> 1) ^ -(long long)(zz & 1);
+            ref.address = last_addr[ref.job_id] += delta;
+        }
+        --remaining;
+        return true;
+    }
+};
+
+// true if the file starts with the binary trace magic
+inline bool is_binary_trace(const string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    char magic[8] = {};
+    bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return ok;
+}
+
+// any kind of trace behind one next(); the format is picked from the file's
+// magic, or a workload is generated for "gen:<spec>"
+class TraceInput {
+    TextTraceReader *text = nullptr;
+    MappedTraceReader *mapped = nullptr;
+    WorkloadGenerator *gen = nullptr;
+    bool spec_ok = false;
+
+public:
+    explicit TraceInput(const string &filename) {
+        if (filename.compare(0, 4, "gen:") == 0) {
+            WorkloadSpec spec;
+            spec_ok = load_workload(filename.substr(4), spec);
+            gen = new WorkloadGenerator(spec);
+        } else if (is_binary_trace(filename)) mapped = new MappedTraceReader(filename);
+        else text = new TextTraceReader(filename);
+    }
+    ~TraceInput() { delete text; delete mapped; delete gen; }
+    TraceInput(const TraceInput &) = delete;
+    TraceInput &operator=(const TraceInput &) = delete;
+
+    bool is_open() const { return gen ? spec_ok : mapped ? mapped->is_open() : text->is_open(); }
+    bool is_binary() const { return mapped != nullptr; }
+    bool is_generated() const { return gen != nullptr; }
+    long long malformed() const { return text ? text->malformed : 0; }
+
+    bool next(TraceRef &ref) { return text ? text->next(ref) : mapped ? mapped->next(ref) : gen->next(ref); }
+
+    // passes over the next n references (to resume from a checkpoint);
+    // returns how many there were
+    long long skip(long long n) {
+        if (n <= 0) return 0;
+        if (mapped) return (long long)mapped->skip((uint64_t)n);
+        TraceRef ref;
+        long long done = 0;
+        while (done < n && next(ref)) ++done;
+        return done;
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+// trace_convert.cpp
+// Compile: g++ -O2 trace_convert.cpp -o trace_convert
+//
+// Converts address traces between the text format read by
+// paged_memory --replay ("<job_id> <logical_address> [R|W]" per line) and the
+// compact binary format described in trace.h.
+//
+//   trace_convert <in.txt> <out.vmt> [--fixed|--delta]   text -> binary (delta by default)
+//   trace_convert <in.vmt> <out.txt> --text              binary -> text
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+
+#include "trace.h"
+
+using namespace std;
+
+int to_binary(const string &in, const string &out, uint32_t encoding) {
+    TextTraceReader reader(in);
+    if (!reader.is_open()) { cerr << "Error: Could not open file " << in << endl; return 1; }
+    BinaryTraceWriter writer(out, encoding, true);
+    if (!writer.is_open()) { cerr << "Error: Could not create file " << out << endl; return 1; }
+
+    TraceRef ref;
+    while (reader.next(ref)) {
+        if (ref.job_id < 0 || ref.address < 0) { ++reader.malformed; continue; }
+        writer.write(ref);
+    }
+    writer.close();
+    cout << "Wrote " << writer.written() << " references to " << out << " ("
+         << (encoding == TRACE_FIXED ? "fixed" : "delta") << " encoding)";
+    if (reader.malformed) cout << ", skipped " << reader.malformed << " malformed lines";
+    cout << ".\n";
+    return 0;
+}
+
+int to_text(const string &in, const string &out) {
+    MappedTraceReader reader(in);
+    if (!reader.is_open()) { cerr << "Error: " << in << " is not a binary trace" << endl; return 1; }
+    FILE *f = fopen(out.c_str(), "w");
+    if (!f) { cerr << "Error: Could not create file " << out << endl; return 1; }
+
+    static char buf[1 << 20];
+    setvbuf(f, buf, _IOFBF, sizeof(buf));
+    bool rw = reader.has_rw();
+    TraceRef ref;
+    long long n = 0;
+    while (reader.next(ref)) {
+        if (rw) fprintf(f, "%d %lld %c\n", ref.job_id, ref.address, ref.write ? 'W' : 'R');
+        else fprintf(f, "%d %lld\n", ref.job_id, ref.address);
+        ++n;
+    }
+    fclose(f);
+    cout << "Wrote " << n << " references to " << out << ".\n";
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 4) {
+        cerr << "Usage: " << argv[0] << " <in.txt> <out.vmt> [--fixed|--delta]\n"
+             << "       " << argv[0] << " <in.vmt> <out.txt> --text\n";
+        return 1;
+    }
+    string mode = argc == 4 ? argv[3] : "--delta";
+    auto start = chrono::steady_clock::now();
+    int rc;
+    if (mode == "--text") rc = to_text(argv[1], argv[2]);
+    else if (mode == "--fixed") rc = to_binary(argv[1], argv[2], TRACE_FIXED);
+    else if (mode == "--delta") rc = to_binary(argv[1], argv[2], TRACE_DELTA);
+    else { cerr << "Unknown option " << mode << endl; return 1; }
+    if (rc == 0)
+        cout << "Took " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s.\n";
+    return rc;
+}
@@ -0,0 +1,113 @@
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+// translate.h
+// Building blocks of batched address translation (DemandPager::translate_batch).
+//
+// PageDivider splits byte addresses into page number and offset: a shift and
+// a mask when the page size is a power of two, otherwise a multiply by a
+// precomputed reciprocal (high half of a 64x64-bit product) and at most one
+// correction step, instead of a hardware divide per address.
+//
+// gather_pages looks up the frames of a batch of pages in a flat (one-level)
+// page table. On x86-64 CPUs with AVX2 it splits and gathers four addresses
+// per instruction; the choice is made at run time, so the program builds and
+// runs without -mavx2, and every other target uses the scalar loop.
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VM_HAVE_AVX2_PATH 1
+#endif
+
+using namespace std;
+
+class PageDivider {
+    uint64_t d;
+    int shift_ = -1;      // log2(d) when d is a power of two
+    uint64_t magic = 0;   // floor((2^64 - 1) / d)
+
+public:
+    explicit PageDivider(uint64_t page_size = 1) : d(page_size ? page_size : 1) {
+        if ((d & (d - 1)) == 0) shift_ = __builtin_ctzll(d);
+        else magic = ~0ULL / d;
+    }
+
+    uint64_t divisor() const { return d; }
+    bool power_of_two() const { return shift_ >= 0; }
+    int shift() const { return shift_; }
+
+    // a / d; the estimate from the reciprocal is low by at most one
+    uint64_t page(uint64_t a) const {
+        if (shift_ >= 0) return a >> shift_;
+        uint64_t q = (uint64_t)(((unsigned __int128)a * magic) >> 64);
+        return q + (a - q * d >= d);
+    }
+
+    void split(uint64_t a, uint64_t &page_no, uint64_t &offset) const {
+        if (shift_ >= 0) { page_no = a >> shift_; offset = a & (d - 1); return; }
+        page_no = page(a);
+        offset = a - page_no * d;
+    }
+};
+
+// pages[i] and frames[i] for every address; table holds one frame (or -1)
+// per page and every page must be below the table size
+inline void gather_pages_scalar(const int32_t *table, const PageDivider &div,
+                                const long long *addr, size_t n, uint64_t *pages, int32_t *frames) {
+    if (div.power_of_two()) {
+        int s = div.shift();
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = (uint64_t)addr[i] >> s;
+            pages[i] = p;
+            frames[i] = table[p];
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = div.page((uint64_t)addr[i]);
+            pages[i] = p;
+            frames[i] = table[p];
+        }
+    }
+}
+
+#ifdef VM_HAVE_AVX2_PATH
+__attribute__((target("avx2")))
+inline void gather_pages_avx2(const int32_t *table, int shift,
+                              const long long *addr, size_t n, uint64_t *pages, int32_t *frames) {
+    size_t i = 0;
+    __m128i count = _mm_cvtsi32_si128(shift);
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(addr + i));
+        __m256i p = _mm256_srl_epi64(a, count);
+        _mm256_storeu_si256((__m256i *)(pages + i), p);
+        __m128i f = _mm256_i64gather_epi32((const int *)table, p, 4);
+        _mm_storeu_si128((__m128i *)(frames + i), f);
+    }
+    for (; i < n; ++i) {
+        uint64_t p = (uint64_t)addr[i] >> shift;
+        pages[i] = p;
+        frames[i] = table[p];
+    }
+}
+
+inline bool cpu_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+inline void gather_pages(const int32_t *table, const PageDivider &div,
+                         const long long *addr, size_t n, uint64_t *pages, int32_t *frames) {
+#ifdef VM_HAVE_AVX2_PATH
+    if (div.power_of_two() && cpu_has_avx2()) {
+        gather_pages_avx2(table, div.shift(), addr, n, pages, frames);
+        return;
+    }
+#endif
+    gather_pages_scalar(table, div, addr, n, pages, frames);
+}
+
+#endif
@@ -0,0 +1,414 @@
+// vm_tests.cpp
+// Compile: g++ -O2 -pthread vm_tests.cpp -o vm_tests   (or build the vm_tests target and run ctest)
+//
+// Self-checks of the engine that ctest runs, one named test per argument:
+//   batch       DemandPager::translate_batch against access_page on a copy of
+//               the same engine: physical addresses, fault flags, counters
+//               and the frame table agree, for every policy, with writes,
+//               forks and shared regions, and with a TLB (the replay path)
+//   checkpoint  a run saved halfway, restored into a new engine and finished
+//               ends in the same state, byte for byte, as the run without
+//               the break, with swap, read-ahead, forks or load control
+//   allocator   FreeFrameAllocator against a plain bitmap (lowest free frame,
+//               allocateFirstN order, random placement, consistent()) and
+//               the contiguous allocators against a list of live blocks
+//               (no overlap, free units add up)
+//   cow         fork and copy-on-write reference counts: every frame's
+//               ReverseMap::refs equals the page-table entries that map it,
+//               through forks, COW writes, evictions and job ends
+//
+//   vm_tests <batch|checkpoint|allocator|cow>
+//
+// A failed check prints "FAIL: ..." to stderr and the exit status is 1.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "demand_engine.h"
+#include "contiguous_allocator.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static bool check(bool ok, const string &what) {
+    if (!ok) {
+        ++failures;
+        cerr << "FAIL: " << what << "\n";
+    }
+    return ok;
+}
+
+// a reference of the generated workload
+struct TestRef {
+    int job;
+    long long addr;
+    bool write;
+};
+
+// references of `jobs` jobs of `pages` pages each: runs of sequential pages
+// mixed with random ones, about one write in eight
+static vector<TestRef> make_refs(int jobs, long long pages, int page_size, size_t n, unsigned seed) {
+    mt19937_64 gen(seed);
+    vector<TestRef> refs;
+    refs.reserve(n);
+    vector<long long> next(jobs, 0);
+    while (refs.size() < n) {
+        int job = (int)(gen() % jobs);
+        size_t run = 1 + gen() % 200;
+        bool sequential = gen() % 2;
+        for (size_t k = 0; k < run && refs.size() < n; ++k) {
+            long long page = sequential ? next[job]++ % pages : (long long)(gen() % pages);
+            refs.push_back({job, page * page_size + (long long)(gen() % page_size), gen() % 8 == 0});
+        }
+    }
+    return refs;
+}
+
+// the counters and the frame table of two engines agree
+static bool same_state(const DemandPager &a, const DemandPager &b, const string &what) {
+    if (!check(a.references == b.references, what + ": references")) return false;
+    for (size_t j = 0; j < a.stats.size(); ++j) {
+        const JobStats &x = a.stats[j], &y = b.stats[j];
+        if (!check(x.references == y.references && x.hits == y.hits && x.faults == y.faults &&
+                       x.evictions == y.evictions && x.evicted == y.evicted && x.resident == y.resident &&
+                       x.cow_faults == y.cow_faults && x.shared_maps == y.shared_maps,
+                   what + ": counters of job " + to_string(j)))
+            return false;
+    }
+    for (int f = 0; f < a.num_frames; ++f)
+        if (!check(a.frames.owner(f) == b.frames.owner(f) && a.frames.page(f) == b.frames.page(f) &&
+                       a.frames.test(f, FRAME_DIRTY) == b.frames.test(f, FRAME_DIRTY),
+                   what + ": frame " + to_string(f)))
+            return false;
+    return true;
+}
+
+// an engine with three jobs; with sharing, job 1 shares its first pages with
+// job 0 and the workload forks job 0 into a fourth job halfway
+static DemandPager make_pager(const string &policy, int frames, bool sharing, bool with_tlb) {
+    DemandPager p(4096, frames, 7, policy);
+    if (with_tlb) {
+        TlbConfig cfg;
+        cfg.entries = 32;
+        cfg.ways = 4;
+        p.enable_tlb(cfg);
+    }
+    for (int j = 0; j < 3; ++j) p.add_job(j + 1, 600LL * 4096);
+    if (sharing) p.share_region({0, 1}, 100);
+    return p;
+}
+
+static void test_batch() {
+    const int page_size = 4096, frames = 256;
+    vector<TestRef> refs = make_refs(3, 600, page_size, 60000, 11);
+    for (const string &policy : policy_names()) {
+        if (policy == "opt") continue; // needs next-use times, which batches do not carry
+        for (int config = 0; config < 3; ++config) {
+            bool sharing = config == 1, with_tlb = config == 2;
+            string what = "batch " + policy + (sharing ? " shared" : with_tlb ? " tlb" : "");
+            DemandPager scalar = make_pager(policy, frames, sharing, with_tlb);
+            DemandPager batched = make_pager(policy, frames, sharing, with_tlb);
+            vector<long long> addr, phys;
+            vector<uint8_t> writes, faults;
+            size_t i = 0;
+            bool ok = true;
+            while (ok && i < refs.size()) {
+                if (sharing && i >= refs.size() / 2 && scalar.jobs.size() == 3) {
+                    scalar.fork_job(0, 4);
+                    batched.fork_job(0, 4);
+                }
+                // a batch is a run of one job's references, cut at most 1024 long
+                int job = refs[i].job;
+                size_t end = i;
+                while (end < refs.size() && refs[end].job == job && end - i < 1024) ++end;
+                addr.clear();
+                writes.clear();
+                for (size_t k = i; k < end; ++k) {
+                    addr.push_back(refs[k].addr);
+                    writes.push_back(refs[k].write);
+                }
+                phys.assign(addr.size(), 0);
+                faults.assign(addr.size(), 0);
+                batched.translate_batch(job, addr.data(), addr.size(), phys.data(), faults.data(), writes.data());
+                for (size_t k = i; k < end && ok; ++k) {
+                    long long page = refs[k].addr / page_size, off = refs[k].addr % page_size;
+                    AccessResult r = scalar.access_page(job, page, NEVER_USED, refs[k].write);
+                    ok = check(faults[k - i] == (uint8_t)r.fault &&
+                                   phys[k - i] == (long long)r.frame * page_size + off,
+                               what + ": reference " + to_string(k));
+                }
+                i = end;
+            }
+            if (ok) same_state(scalar, batched, what);
+        }
+    }
+}
+
+// runs refs[from, to) on the engine, forking job 0 at fork_at
+static void run_refs(DemandPager &p, const vector<TestRef> &refs, size_t from, size_t to, size_t fork_at) {
+    const int page_size = p.page_size;
+    for (size_t i = from; i < to; ++i) {
+        if (i == fork_at) p.fork_job(0, 4);
+        p.access_page(refs[i].job, refs[i].addr / page_size, NEVER_USED, refs[i].write);
+    }
+    if (to == refs.size()) p.serve_deferred();
+}
+
+static bool read_file(const string &path, string &out) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[1 << 16];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0) out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+static void test_checkpoint() {
+    const string half = "vm_tests_half.ckpt", full = "vm_tests_full.ckpt", resumed = "vm_tests_resumed.ckpt";
+    vector<TestRef> refs = make_refs(3, 600, 4096, 80000, 23);
+    const size_t save_at = refs.size() / 2 + 17;
+    const char *configs[] = {"plain", "swap+readahead", "fork", "load control"};
+    for (const string &policy : {string("fifo"), string("lru"), string("clock"), string("lfu"), string("arc"),
+                                 string("random")}) {
+        for (int config = 0; config < 4; ++config) {
+            string what = string("checkpoint ") + policy + " " + configs[config];
+            auto make = [&]() {
+                DemandPager p(4096, 200, 5, policy);
+                if (config == 1) {
+                    SwapConfig swap;
+                    swap.enabled = true;
+                    swap.clean_every = 1000;
+                    p.enable_swap(swap);
+                    ReadAheadConfig ra;
+                    ra.enabled = true;
+                    p.enable_readahead(ra);
+                }
+                if (config == 3) {
+                    ResidentSetConfig rs;
+                    rs.scope = ResidentScope::PFF;
+                    rs.window = 500;
+                    rs.load_control = true;
+                    rs.quantum = 5000;
+                    p.enable_resident_sets(rs);
+                }
+                for (int j = 0; j < 3; ++j) p.add_job(j + 1, 600LL * 4096);
+                return p;
+            };
+            size_t fork_at = config == 2 ? refs.size() / 3 : refs.size();
+
+            DemandPager straight = make();
+            run_refs(straight, refs, 0, refs.size(), fork_at);
+
+            DemandPager first = make();
+            run_refs(first, refs, 0, save_at, fork_at);
+            if (!check(first.save_checkpoint(half, (long long)save_at, 3), what + ": save")) continue;
+            DemandPager second(512, 16, 99, "fifo"); // overwritten entirely by the restore
+            long long pos = 0, invalid = 0;
+            if (!check(second.restore_checkpoint(half, &pos, &invalid), what + ": restore")) continue;
+            check(pos == (long long)save_at && invalid == 3, what + ": trace position and invalid count");
+            check(second.indices_valid(), what + ": restored indices");
+            run_refs(second, refs, (size_t)pos, refs.size(), fork_at);
+
+            string a, b;
+            bool saved = straight.save_checkpoint(full, (long long)refs.size()) &&
+                         second.save_checkpoint(resumed, (long long)refs.size());
+            if (check(saved && read_file(full, a) && read_file(resumed, b), what + ": final state"))
+                check(a == b, what + ": resumed run differs from the run without a break");
+        }
+    }
+    remove(half.c_str());
+    remove(full.c_str());
+    remove(resumed.c_str());
+}
+
+static void test_allocator() {
+    mt19937_64 gen(3);
+    for (bool random_placement : {false, true}) {
+        string what = string("FreeFrameAllocator") + (random_placement ? " (random placement)" : "");
+        const int n = 5000; // not a multiple of 64, and three bitmap levels deep
+        FreeFrameAllocator alloc(n, random_placement);
+        vector<char> used(n, 0);
+        int used_count = 0;
+        auto lowest_free = [&]() {
+            for (int f = 0; f < n; ++f) if (!used[f]) return f;
+            return -1;
+        };
+        bool ok = true;
+        for (int step = 0; step < 40000 && ok; ++step) {
+            int op = (int)(gen() % 10);
+            if (op < 3) {
+                int expect = lowest_free();
+                int f = alloc.allocateFirst();
+                ok = check(f == expect, what + ": allocateFirst gave " + to_string(f) + ", lowest free " + to_string(expect));
+                if (f >= 0) { used[f] = 1; ++used_count; }
+            } else if (op < 5) {
+                int want = 1 + (int)(gen() % 150);
+                vector<int> got(want);
+                int k = alloc.allocateFirstN(want, got.data());
+                ok = check(k == min(want, n - used_count), what + ": allocateFirstN count");
+                for (int i = 0; i < k && ok; ++i) {
+                    ok = check(got[i] == lowest_free(), what + ": allocateFirstN order");
+                    used[got[i]] = 1;
+                    ++used_count;
+                }
+            } else if (op < 6 && random_placement) {
+                int f = alloc.allocateRandom(gen);
+                ok = check((f == -1) == (used_count == n) && (f == -1 || !used[f]), what + ": allocateRandom");
+                if (f >= 0) { used[f] = 1; ++used_count; }
+            } else {
+                // release a run of frames, some of them already free (a no-op)
+                int from = (int)(gen() % n), len = 1 + (int)(gen() % 120);
+                for (int f = from; f < min(n, from + len); ++f) {
+                    alloc.release(f);
+                    if (used[f]) { used[f] = 0; --used_count; }
+                }
+            }
+            if (ok) ok = check(alloc.freeCount() == n - used_count, what + ": free count");
+            if (ok && step % 97 == 0) {
+                ok = check(alloc.consistent(), what + ": consistent()");
+                for (int f = 0; f < n && ok; ++f) ok = check(alloc.isFree(f) == !used[f], what + ": isFree");
+            }
+        }
+    }
+
+    for (const string &name : contiguous_allocator_names()) {
+        const long long total = 1 << 14;
+        unique_ptr<ContiguousAllocator> alloc = make_contiguous_allocator(name, total);
+        string what = "contiguous " + name;
+        struct Block { long long start, size; };
+        vector<Block> live;
+        vector<char> taken(total, 0);
+        long long reserved = 0;
+        bool ok = true;
+        for (int step = 0; step < 20000 && ok; ++step) {
+            if (live.empty() || gen() % 5 < 3) {
+                long long size = 1 + (long long)(gen() % 700);
+                long long start = alloc->allocate(size);
+                if (start < 0) continue;
+                long long r = alloc->reserved(size);
+                ok = check(start + r <= total, what + ": block past the end");
+                for (long long u = start; u < start + r && ok; ++u) {
+                    ok = check(!taken[u], what + ": overlapping blocks at " + to_string(u));
+                    taken[u] = 1;
+                }
+                live.push_back({start, size});
+                reserved += r;
+            } else {
+                size_t k = gen() % live.size();
+                Block b = live[k];
+                live[k] = live.back();
+                live.pop_back();
+                alloc->release(b.start, b.size);
+                long long r = alloc->reserved(b.size);
+                for (long long u = b.start; u < b.start + r; ++u) taken[u] = 0;
+                reserved -= r;
+            }
+            if (ok) ok = check(alloc->free_units() == total - reserved, what + ": free units");
+            if (ok) ok = check(alloc->largest_free() <= alloc->free_units(), what + ": largest free block");
+        }
+        for (const Block &b : live) alloc->release(b.start, b.size);
+        check(alloc->free_units() == total && alloc->largest_free() == total, what + ": everything released coalesces");
+    }
+}
+
+// every frame's mapper count equals the page-table entries pointing at it,
+// and the reverse map and the engine's indices hold together
+static bool refs_match(const DemandPager &p, const string &what) {
+    vector<int> mapped(p.num_frames, 0);
+    for (const Job &job : p.jobs)
+        job.page_table.for_each_mapped([&](long long, int f) { ++mapped[f]; });
+    for (int f = 0; f < p.num_frames; ++f) {
+        int expect = p.frames.used(f) ? mapped[f] : 0;
+        int got = p.frames.used(f) ? p.rmap.refs(f) : 0;
+        if (!check(expect == got, what + ": frame " + to_string(f) + " has " + to_string(got) + " mappers, " +
+                                      to_string(expect) + " page-table entries"))
+            return false;
+    }
+    return check(p.rmap.consistent(), what + ": reverse map") && check(p.indices_valid(), what + ": indices");
+}
+
+static void test_cow() {
+    // parent with 8 resident pages, two generations of children
+    DemandPager p(4096, 64, 1, "lru");
+    int parent = p.add_job(1, 8 * 4096);
+    for (long long pg = 0; pg < 8; ++pg) p.access_page(parent, pg, NEVER_USED, pg < 4);
+    int child = p.fork_job(parent, 2);
+    int grandchild = p.fork_job(child, 3);
+    if (!check(child != -1 && grandchild != -1, "cow: fork")) return;
+    int f0 = p.jobs[parent].page_table[0];
+    check(p.rmap.refs(f0) == 3 && p.frames.test(f0, FRAME_COW), "cow: a forked page has three mappers and FRAME_COW");
+    refs_match(p, "cow after forks");
+
+    // the child writes page 0: it gets its own copy, the others keep sharing
+    AccessResult r = p.access_page(child, 0, NEVER_USED, true);
+    check(r.fault && r.frame != f0 && p.stats[child].cow_faults == 1, "cow: a write to a shared page copies it");
+    check(p.rmap.refs(f0) == 2 && p.rmap.refs(r.frame) == 1, "cow: mapper counts after the copy");
+    check(p.jobs[parent].page_table[0] == f0 && p.jobs[grandchild].page_table[0] == f0,
+          "cow: the other mappers keep the original frame");
+    refs_match(p, "cow after a copy");
+
+    // the grandchild writes it too; then the parent is the last mapper and
+    // its write only clears the bit
+    AccessResult g = p.access_page(grandchild, 0, NEVER_USED, true);
+    check(g.fault && p.rmap.refs(f0) == 1, "cow: second copy");
+    AccessResult w = p.access_page(parent, 0, NEVER_USED, true);
+    check(!w.fault && w.frame == f0 && !p.frames.test(f0, FRAME_COW), "cow: the last mapper writes in place");
+    refs_match(p, "cow after the last writer");
+
+    // ending the child gives back its copy and its share of the rest
+    p.terminate_job(child);
+    check(p.rmap.refs(p.jobs[parent].page_table[1]) == 2, "cow: job end drops its mappings");
+    refs_match(p, "cow after a job end");
+
+    // random workload with forks, writes and evictions, checked as it goes
+    DemandPager q(4096, 96, 9, "clock");
+    for (int j = 0; j < 3; ++j) q.add_job(j + 1, 200LL * 4096);
+    q.share_region({1, 2}, 50);
+    vector<TestRef> refs = make_refs(3, 200, 4096, 30000, 5);
+    int next_id = 10;
+    for (size_t i = 0; i < refs.size(); ++i) {
+        // fork a running job, later end the newest child; the children take
+        // a third of the references while they run
+        int newest = (int)q.jobs.size() - 1;
+        bool child_running = newest >= 3 && q.find_job(q.jobs[newest].id) != -1;
+        if (i % 5000 == 2500) {
+            int parent = (int)(i / 5000) % 3;
+            if (q.fork_job(parent, next_id++) != -1) child_running = true, newest = (int)q.jobs.size() - 1;
+        }
+        if (i % 5000 == 4000 && child_running && newest > 3) {
+            q.terminate_job(newest);
+            child_running = false;
+        }
+        int job = refs[i].job;
+        if (i % 3 == 0 && child_running) job = newest;
+        q.access_page(job, refs[i].addr / 4096, NEVER_USED, refs[i].write);
+        if (i % 1000 == 0 && !refs_match(q, "cow workload at reference " + to_string(i))) return;
+    }
+    refs_match(q, "cow workload at the end");
+    check(q.rmap.peak_saved() > 0, "cow: the workload shared frames");
+}
+
+int main(int argc, char **argv) {
+    string test = argc == 2 ? argv[1] : "";
+    if (test == "batch") test_batch();
+    else if (test == "checkpoint") test_checkpoint();
+    else if (test == "allocator") test_allocator();
+    else if (test == "cow") test_cow();
+    else {
+        cerr << "Usage: " << argv[0] << " <batch|checkpoint|allocator|cow>\n";
+        return 1;
+    }
+    if (failures) {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    cout << test << ": ok\n";
+    return 0;
+}
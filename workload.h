@@ -0,0 +1,320 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+// workload.h
+// Deterministic synthetic address streams for the simulators. A workload
+// spec describes jobs and the access pattern of each over time; the same
+// spec and seed always give the same stream, on any machine.
+//
+//   Seed <n>
+//   References <total>            length of the stream (default 1000000)
+//   Block <bytes>                 unit of the zipf and uniform patterns (default 4096)
+//   Burst <refs>                  references a job issues once scheduled (default 1)
+//   WriteRatio <fraction>         share of references marked as writes (default 0)
+//   Job <id> <size_bytes> [weight]
+//   Phase <job_id> <refs> seq [stride]
+//   Phase <job_id> <refs> loop <start> <length> [stride]
+//   Phase <job_id> <refs> zipf <theta> [hot_bytes]
+//   Phase <job_id> <refs> uniform
+//
+// Jobs are scheduled at random in proportion to their weights. Each job runs
+// its phases in order, `refs` of its own references each (0 = forever), and
+// starts over after the last; a job without phases is uniform. seq scans the
+// whole job, loop cycles over [start, start+length), both `stride` bytes a
+// step (default 64). zipf draws blocks of the first hot_bytes (default all)
+// with P(rank k) ~ 1/k^theta; ranks are scattered over the region so hot
+// blocks are not adjacent.
+//
+// Random numbers come from xoshiro256** (one stream for the scheduler and
+// one per job, seeded through splitmix64) and Zipf ranks from
+// rejection-inversion sampling (Hormann & Derflinger), so every reference
+// costs a handful of multiplies and no table grows with the job size.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+inline uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman & Vigna); also usable as a standard URBG
+class Xoshiro256 {
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    typedef uint64_t result_type;
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return ~0ULL; }
+
+    explicit Xoshiro256(uint64_t seed = 1) { this->seed(seed); }
+    void seed(uint64_t seed) { for (auto &w : s) w = splitmix64(seed); }
+
+    uint64_t operator()() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // uniform in [0, n) (Lemire's multiply-shift; the bias is below 2^-32 for n < 2^32)
+    uint64_t below(uint64_t n) { return (uint64_t)(((unsigned __int128)(*this)() * n) >> 64); }
+    // uniform in [0, 1)
+    double unit() { return (double)((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+// Zipf ranks 1..n with P(k) ~ 1/k^theta, in O(1) expected time per sample
+class ZipfSampler {
+    uint64_t n;
+    double theta, h_x1, h_n, sd;
+
+    static double helper1(double x) { return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+    static double helper2(double x) { return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+    double h(double x) const { return exp(-theta * log(x)); }
+    double h_integral(double x) const { double lx = log(x); return helper2((1 - theta) * lx) * lx; }
+    double h_integral_inverse(double x) const {
+        double t = x * (1 - theta);
+        if (t < -1) t = -1;
+        return exp(helper1(t) * x);
+    }
+
+public:
+    ZipfSampler(uint64_t n_ = 1, double theta_ = 1.0) : n(n_ < 1 ? 1 : n_), theta(theta_ <= 0 ? 1e-9 : theta_) {
+        h_x1 = h_integral(1.5) - 1;
+        h_n = h_integral((double)n + 0.5);
+        sd = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+    }
+
+    uint64_t operator()(Xoshiro256 &rng) const {
+        while (true) {
+            double u = h_n + rng.unit() * (h_x1 - h_n);
+            double x = h_integral_inverse(u);
+            double kd = floor(x + 0.5);
+            if (kd < 1) kd = 1;
+            else if (kd > (double)n) kd = (double)n;
+            if (kd - x <= sd || u >= h_integral(kd + 0.5) - h(kd)) return (uint64_t)kd;
+        }
+    }
+};
+
+enum class PatternKind { SEQ, LOOP, ZIPF, UNIFORM };
+
+struct WorkloadPhase {
+    PatternKind kind = PatternKind::UNIFORM;
+    long long refs = 0;       // references of the job in this phase, 0 = forever
+    long long start = 0;      // loop
+    long long length = 0;     // loop
+    long long stride = 64;    // seq, loop
+    double theta = 1.0;       // zipf
+    long long hot_bytes = 0;  // zipf, 0 = whole job
+};
+
+struct WorkloadJob {
+    int id = 0;
+    long long size = 0;
+    double weight = 1;
+    vector<WorkloadPhase> phases;
+};
+
+struct WorkloadSpec {
+    uint64_t seed = 1;
+    long long references = 1000000;
+    long long block = 4096;
+    long long burst = 1;
+    double write_ratio = 0;
+    vector<WorkloadJob> jobs;
+};
+
+// reads a workload spec; errors go to stderr
+inline bool load_workload(const string &filename, WorkloadSpec &spec) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Error: Could not open file " << filename << endl;
+        return false;
+    }
+    string line;
+    long long line_no = 0;
+    auto find_job = [&](int id) -> WorkloadJob * {
+        for (auto &j : spec.jobs) if (j.id == id) return &j;
+        return nullptr;
+    };
+    while (getline(file, line)) {
+        ++line_no;
+        if (line.empty() || line[0] == '#') continue;
+        stringstream ss(line);
+        string key;
+        if (!(ss >> key)) continue;
+        bool ok = true;
+        if (key == "Seed") ok = (bool)(ss >> spec.seed);
+        else if (key == "References") ok = (bool)(ss >> spec.references);
+        else if (key == "Block") ok = (bool)(ss >> spec.block) && spec.block > 0;
+        else if (key == "Burst") ok = (bool)(ss >> spec.burst) && spec.burst > 0;
+        else if (key == "WriteRatio") ok = (bool)(ss >> spec.write_ratio);
+        else if (key == "Job") {
+            WorkloadJob job;
+            ok = (bool)(ss >> job.id >> job.size) && job.size > 0 && !find_job(job.id);
+            double weight;
+            if (ss >> weight) job.weight = weight;
+            if (ok) spec.jobs.push_back(job);
+        } else if (key == "Phase") {
+            int id;
+            string kind;
+            WorkloadPhase ph;
+            ok = (bool)(ss >> id >> ph.refs >> kind);
+            WorkloadJob *job = ok ? find_job(id) : nullptr;
+            if (!job) ok = false;
+            else if (kind == "seq") { ph.kind = PatternKind::SEQ; ss >> ph.stride; }
+            else if (kind == "loop") { ph.kind = PatternKind::LOOP; ok = (bool)(ss >> ph.start >> ph.length); ss >> ph.stride; }
+            else if (kind == "zipf") { ph.kind = PatternKind::ZIPF; ok = (bool)(ss >> ph.theta); ss >> ph.hot_bytes; }
+            else if (kind == "uniform") ph.kind = PatternKind::UNIFORM;
+            else ok = false;
+            if (ok) {
+                if (ph.stride <= 0) ph.stride = 64;
+                if (ph.kind == PatternKind::LOOP) {
+                    ph.start = min(max(0LL, ph.start), job->size - 1);
+                    ph.length = min(max(1LL, ph.length), job->size - ph.start);
+                }
+                if (ph.hot_bytes <= 0 || ph.hot_bytes > job->size) ph.hot_bytes = job->size;
+                job->phases.push_back(ph);
+            }
+        } else ok = false;
+        if (!ok) {
+            cerr << "Error: bad workload line " << line_no << " in " << filename << ": " << line << endl;
+            return false;
+        }
+    }
+    if (spec.jobs.empty()) {
+        cerr << "Error: no Job lines in " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+// streams the references of a workload; next() fills anything with job_id,
+// address and write fields (TraceRef), so it can stand in for a trace file
+class WorkloadGenerator {
+    struct JobState {
+        Xoshiro256 rng;
+        size_t phase = 0;
+        long long in_phase = 0;   // references issued in the current phase
+        long long cursor = 0;     // seq, loop: offset of the next reference
+        long long blocks = 1;     // zipf: blocks in the hot region
+        uint64_t scatter = 1;     // zipf: multiplier coprime to blocks
+        ZipfSampler zipf;
+    };
+
+    WorkloadSpec spec;
+    Xoshiro256 sched;
+    vector<double> cumulative; // running sum of the job weights
+    vector<JobState> state;
+    long long issued = 0;
+    int current = 0;
+    long long burst_left = 0;
+    uint64_t write_threshold = 0;
+
+    static uint64_t gcd(uint64_t a, uint64_t b) { while (b) { uint64_t t = a % b; a = b; b = t; } return a; }
+
+    void enter_phase(int j) {
+        JobState &js = state[j];
+        const WorkloadJob &job = spec.jobs[j];
+        js.in_phase = 0;
+        js.cursor = 0;
+        if (job.phases.empty()) return;
+        const WorkloadPhase &ph = job.phases[js.phase];
+        if (ph.kind == PatternKind::ZIPF) {
+            js.blocks = max(1LL, (ph.hot_bytes + spec.block - 1) / spec.block);
+            js.zipf = ZipfSampler((uint64_t)js.blocks, ph.theta);
+            js.scatter = 0x9E3779B97F4A7C15ULL % (uint64_t)js.blocks;
+            while (js.blocks > 1 && (js.scatter == 0 || gcd(js.scatter, (uint64_t)js.blocks) != 1)) ++js.scatter;
+        }
+    }
+
+    int pick_job() {
+        if (cumulative.size() == 1) return 0;
+        double x = sched.unit() * cumulative.back();
+        return (int)min(cumulative.size() - 1, (size_t)(upper_bound(cumulative.begin(), cumulative.end(), x) - cumulative.begin()));
+    }
+
+    long long address_of(int j) {
+        JobState &js = state[j];
+        const WorkloadJob &job = spec.jobs[j];
+        if (job.phases.empty()) return (long long)js.rng.below((uint64_t)job.size);
+        const WorkloadPhase *ph = &job.phases[js.phase];
+        if (ph->refs > 0 && js.in_phase >= ph->refs) {
+            js.phase = (js.phase + 1) % job.phases.size();
+            enter_phase(j);
+            ph = &job.phases[js.phase];
+        }
+        ++js.in_phase;
+        long long addr;
+        switch (ph->kind) {
+        case PatternKind::SEQ:
+            addr = js.cursor;
+            js.cursor += ph->stride;
+            if (js.cursor >= job.size) js.cursor = 0;
+            return addr;
+        case PatternKind::LOOP:
+            addr = ph->start + js.cursor;
+            js.cursor += ph->stride;
+            if (js.cursor >= ph->length) js.cursor = 0;
+            return addr;
+        case PatternKind::ZIPF: {
+            uint64_t rank = js.zipf(js.rng) - 1;
+            uint64_t blk = (uint64_t)(((unsigned __int128)rank * js.scatter) % (uint64_t)js.blocks);
+            addr = (long long)blk * spec.block + (long long)js.rng.below((uint64_t)spec.block);
+            return min(addr, ph->hot_bytes - 1);
+        }
+        default:
+            return (long long)js.rng.below((uint64_t)job.size);
+        }
+    }
+
+public:
+    explicit WorkloadGenerator(const WorkloadSpec &spec_) : spec(spec_), sched(spec_.seed) {
+        double sum = 0;
+        for (size_t j = 0; j < spec.jobs.size(); ++j) {
+            sum += max(0.0, spec.jobs[j].weight);
+            cumulative.push_back(sum);
+            JobState js;
+            uint64_t s = spec.seed ^ (0xD1B54A32D192ED03ULL * (j + 1));
+            js.rng.seed(splitmix64(s));
+            state.push_back(js);
+            enter_phase((int)j);
+        }
+        double wr = min(max(spec.write_ratio, 0.0), 1.0);
+        write_threshold = wr >= 1.0 ? ~0ULL : (uint64_t)(wr * 18446744073709551616.0);
+    }
+
+    const WorkloadSpec &workload() const { return spec; }
+    long long remaining() const { return spec.references - issued; }
+
+    template <class Ref>
+    bool next(Ref &ref) {
+        if (issued >= spec.references) return false;
+        if (burst_left == 0) {
+            current = pick_job();
+            burst_left = spec.burst;
+        }
+        --burst_left;
+        ++issued;
+        ref.job_id = spec.jobs[current].id;
+        ref.address = address_of(current);
+        ref.write = write_threshold && state[current].rng() < write_threshold;
+        return true;
+    }
+};
+
+#endif